@@ -0,0 +1,124 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "attempt_limiter.h"
+
+// Slot layout: tag in the top 24 bits (never 0, so an empty slot is all zeroes, and 0 in the overflow slot),
+// failures in the next 8, and the last failure in the low 32 as seconds since limiter->base.
+#define SLOT_TAG(slot) ((slot) >> 40)
+#define SLOT_FAILURES(slot) (((slot) >> 32) & 0xFF)
+#define SLOT_TIME(slot) ((uint32_t)(slot))
+#define MAKE_SLOT(tag, failures, time) ((uint64_t)(tag) << 40 | (uint64_t)(failures) << 32 | (time))
+
+bool attempt_limiter_init(AttemptLimiter* limiter, size_t tokens, unsigned max_failures, unsigned lockout_seconds, uint64_t now) {
+  size_t lines = 1;
+  while (lines * ATTEMPT_LIMITER_TOKEN_SLOTS < tokens * 2) {
+    lines *= 2;
+  }
+  limiter->lines = aligned_alloc(sizeof(AttemptLimiterLine), lines * sizeof(AttemptLimiterLine));
+  if (!limiter->lines) return false;
+  memset(limiter->lines, 0, lines * sizeof(AttemptLimiterLine));
+  limiter->mask = lines - 1;
+  limiter->max_failures = max_failures < ATTEMPT_LIMITER_MAX_FAILURES ? max_failures : ATTEMPT_LIMITER_MAX_FAILURES;
+  limiter->lockout = lockout_seconds;
+  limiter->base = now;
+  return true;
+}
+
+void attempt_limiter_free(AttemptLimiter* limiter) {
+  free(limiter->lines);
+  limiter->lines = NULL;
+}
+
+static AttemptLimiterLine* line_for(const AttemptLimiter* limiter, uint32_t id, uint32_t* tag) {
+  uint64_t hash = id * 0x9E3779B97F4A7C15ULL;
+  *tag = (hash >> 40) | 1;
+  return &limiter->lines[hash & limiter->mask];
+}
+
+static uint32_t elapsed(const AttemptLimiter* limiter, uint64_t now) {
+  return now > limiter->base ? now - limiter->base : 0;
+}
+
+// Seconds since the slot's last failure - 0 if another thread's clock has run ahead of ours.
+static uint32_t slot_age(uint64_t slot, uint32_t time) {
+  return time > SLOT_TIME(slot) ? time - SLOT_TIME(slot) : 0;
+}
+
+// Whether a slot's failures are still counting - not yet lockout seconds old.
+static bool slot_active(const AttemptLimiter* limiter, uint64_t slot, uint32_t time) {
+  return slot && slot_age(slot, time) < limiter->lockout;
+}
+
+// Whether a slot's failures have reached the limit and are still counting.
+static bool slot_locked(const AttemptLimiter* limiter, uint64_t slot, uint32_t time) {
+  return SLOT_FAILURES(slot) >= limiter->max_failures && slot_active(limiter, slot, time);
+}
+
+bool attempt_limiter_allow(const AttemptLimiter* limiter, uint32_t id, uint64_t now) {
+  uint32_t tag;
+  AttemptLimiterLine* line = line_for(limiter, id, &tag);
+  uint32_t time = elapsed(limiter, now);
+  for (int i = 0; i < ATTEMPT_LIMITER_TOKEN_SLOTS; ++i) {
+    uint64_t slot = atomic_load_explicit(&line->slots[i], memory_order_relaxed);
+    if (SLOT_TAG(slot) == tag) {
+      return !slot_locked(limiter, slot, time);
+    }
+  }
+  return !slot_locked(limiter, atomic_load_explicit(&line->slots[ATTEMPT_LIMITER_TOKEN_SLOTS], memory_order_relaxed), time);
+}
+
+void attempt_limiter_record(AttemptLimiter* limiter, uint32_t id, uint64_t now, bool success) {
+  uint32_t tag;
+  AttemptLimiterLine* line = line_for(limiter, id, &tag);
+  uint32_t time = elapsed(limiter, now);
+  for (;;) {
+    _Atomic uint64_t* own = NULL;
+    _Atomic uint64_t* free_slot = NULL;
+    uint64_t own_slot = 0, free_value = 0;
+    for (int i = 0; i < ATTEMPT_LIMITER_TOKEN_SLOTS; ++i) {
+      uint64_t slot = atomic_load_explicit(&line->slots[i], memory_order_relaxed);
+      if (SLOT_TAG(slot) == tag) {
+        own = &line->slots[i];
+        own_slot = slot;
+        break;
+      }
+      if (!free_slot && !slot_active(limiter, slot, time)) {
+        free_slot = &line->slots[i];
+        free_value = slot;
+      }
+    }
+
+    uint64_t desired;
+    if (success) {
+      // The common case - a token that hasn't been failing - reads the line and writes nothing.
+      if (!own) return;
+      desired = 0;
+    } else if (own || !free_slot) {
+      // Its own count, or with every slot still counting, the line's overflow count - never someone else's.
+      bool overflow = !own;
+      if (overflow) {
+        own = &line->slots[ATTEMPT_LIMITER_TOKEN_SLOTS];
+        own_slot = atomic_load_explicit(own, memory_order_relaxed);
+      }
+      unsigned failures = slot_active(limiter, own_slot, time) ? SLOT_FAILURES(own_slot) : 0;
+      desired = MAKE_SLOT(overflow ? 0 : tag, failures < ATTEMPT_LIMITER_MAX_FAILURES ? failures + 1 : failures, time);
+    } else {
+      own = free_slot;
+      own_slot = free_value;
+      desired = MAKE_SLOT(tag, 1, time);
+    }
+    if (atomic_compare_exchange_weak_explicit(own, &own_slot, desired, memory_order_relaxed, memory_order_relaxed)) return;
+  }
+}
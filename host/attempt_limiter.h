@@ -0,0 +1,60 @@
+// Per-token failure counts and lockouts, checked before any hashing so guesses at a locked token cost a
+// cache line read rather than an HMAC.
+//
+// A token that fails max_failures times, with no more than lockout seconds between one failure and the next,
+// is locked until lockout seconds after its last failure; a success clears it. Each token's count is one
+// 64-bit word - a tag from its ID, the count and the time of its last failure - updated by compare-and-swap.
+// A token's word lives in one of the first seven slots of the cache line its ID hashes to. Only failures
+// claim a slot, and one whose lockout has lapsed is free for the taking. A slot still counting is never
+// given up - otherwise guesses spread over more tokens than a line holds would keep pushing each other's
+// counts out before any reached the limit. Failures of tokens that find the line full are counted together
+// in its last slot instead, and once that reaches the limit every token without a slot of its own in the
+// line is locked with them.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef ATTEMPT_LIMITER_H__
+#define ATTEMPT_LIMITER_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ATTEMPT_LIMITER_SLOTS_PER_LINE 8
+#define ATTEMPT_LIMITER_TOKEN_SLOTS (ATTEMPT_LIMITER_SLOTS_PER_LINE - 1) // The last is the line's overflow count
+#define ATTEMPT_LIMITER_MAX_FAILURES 255
+
+typedef struct AttemptLimiterLine {
+  _Atomic uint64_t slots[ATTEMPT_LIMITER_SLOTS_PER_LINE];
+} __attribute__((aligned(64))) AttemptLimiterLine;
+
+typedef struct AttemptLimiter {
+  AttemptLimiterLine* lines;
+  size_t mask;
+  unsigned max_failures;
+  unsigned lockout;
+  uint64_t base; // Unix time the slots' times count from
+} AttemptLimiter;
+
+// Sized for about tokens tokens failing at once.
+bool attempt_limiter_init(AttemptLimiter* limiter, size_t tokens, unsigned max_failures, unsigned lockout_seconds, uint64_t now);
+void attempt_limiter_free(AttemptLimiter* limiter);
+
+// Whether token id may try a code at Unix time now - false while it's locked out. Never writes.
+// Checks already past this when the limit is reached can still finish, so a burst can overrun it by as many.
+bool attempt_limiter_allow(const AttemptLimiter* limiter, uint32_t id, uint64_t now);
+
+void attempt_limiter_record(AttemptLimiter* limiter, uint32_t id, uint64_t now, bool success);
+
+#endif
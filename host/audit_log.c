@@ -0,0 +1,243 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "audit_log.h"
+
+#define SEGMENT_NAME_FORMAT "audit-%010" PRIu64 ".log"
+#define RING_WAIT_NS 100000
+
+static bool sync_directory(const char* directory) {
+  int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return false;
+  bool ok = !fsync(fd);
+  close(fd);
+  return ok;
+}
+
+// The highest segment number already in the directory, or 0 if there are none.
+static uint64_t last_segment(const char* directory) {
+  uint64_t last = 0;
+  DIR* dir = opendir(directory);
+  if (!dir) return 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir))) {
+    uint64_t segment;
+    char tail;
+    if (sscanf(entry->d_name, "audit-%" SCNu64 ".lo%c", &segment, &tail) == 2 && tail == 'g' && segment > last) {
+      last = segment;
+    }
+  }
+  closedir(dir);
+  return last;
+}
+
+static bool open_segment(AuditLog* log, uint64_t segment) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/" SEGMENT_NAME_FORMAT, log->directory, segment);
+  int fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0640);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  AuditSegmentHeader header = {.version = AUDIT_LOG_VERSION, .record_size = sizeof(AuditRecord), .segment = segment, .created = audit_now()};
+  memcpy(header.magic, AUDIT_LOG_MAGIC, sizeof(header.magic));
+  if (write(fd, &header, sizeof(header)) != sizeof(header) || fdatasync(fd) || !sync_directory(log->directory)) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+  if (log->fd >= 0) {
+    close(log->fd);
+  }
+  log->fd = fd;
+  log->segment = segment;
+  log->written = sizeof(header);
+  log->rotate_at = log->segment_bytes;
+  return true;
+}
+
+// Writes every iovec in full, picking up after short writes.
+static bool write_all(int fd, struct iovec* iov, int count) {
+  while (count) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    while (count && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count) {
+      iov->iov_base = (uint8_t*)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+
+// Writes and syncs whatever the rings hold, then hands their space back.
+static void commit(AuditLog* log) {
+  struct iovec iov[2 * AUDIT_LOG_MAX_RINGS];
+  uint64_t heads[AUDIT_LOG_MAX_RINGS];
+  int iov_count = 0;
+  size_t total = 0;
+  int rings = atomic_load_explicit(&log->ring_count, memory_order_acquire);
+  for (int i = 0; i < rings; ++i) {
+    AuditRing* ring = log->rings[i];
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    heads[i] = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t count = heads[i] - tail;
+    if (!count) continue;
+    // The ring's records go straight from its memory, in at most two pieces if they wrap.
+    size_t start = tail % AUDIT_RING_RECORDS;
+    size_t first = count < AUDIT_RING_RECORDS - start ? count : AUDIT_RING_RECORDS - start;
+    iov[iov_count++] = (struct iovec){&ring->records[start], first * sizeof(AuditRecord)};
+    if (count > first) {
+      iov[iov_count++] = (struct iovec){ring->records, (count - first) * sizeof(AuditRecord)};
+    }
+    total += count * sizeof(AuditRecord);
+  }
+  if (!total) return;
+
+  if (!write_all(log->fd, iov, iov_count) || fdatasync(log->fd)) {
+    // Cut off anything partly written, so the next try doesn't leave a torn record behind it.
+    if (!atomic_exchange(&log->failed, true)) {
+      fprintf(stderr, "%s: audit write failed: %s\n", log->directory, strerror(errno));
+    }
+    (void)!ftruncate(log->fd, log->written);
+    return;
+  }
+  log->written += total;
+  for (int i = 0; i < rings; ++i) {
+    atomic_store_explicit(&log->rings[i]->tail, heads[i], memory_order_release);
+  }
+  if (log->written >= log->rotate_at && !open_segment(log, log->segment + 1)) {
+    // Carry on in the current segment rather than lose anything, and try again once it's grown as much again.
+    atomic_store(&log->failed, true);
+    log->rotate_at += log->segment_bytes;
+  }
+}
+
+static void* run_writer(void* context) {
+  AuditLog* log = context;
+  pthread_mutex_lock(&log->lock);
+  while (!atomic_load(&log->stopping)) {
+    if (!atomic_load(&log->kicked)) {
+      struct timespec until;
+      clock_gettime(CLOCK_MONOTONIC, &until);
+      until.tv_nsec += (long)log->interval_ms * 1000000;
+      until.tv_sec += until.tv_nsec / 1000000000;
+      until.tv_nsec %= 1000000000;
+      pthread_cond_timedwait(&log->wake, &log->lock, &until);
+    }
+    atomic_store(&log->kicked, false);
+    pthread_mutex_unlock(&log->lock);
+    commit(log);
+    pthread_mutex_lock(&log->lock);
+  }
+  pthread_mutex_unlock(&log->lock);
+  commit(log);
+  return NULL;
+}
+
+bool audit_log_open(AuditLog* log, const char* directory, size_t segment_bytes, unsigned interval_ms) {
+  memset(log, 0, sizeof(AuditLog));
+  log->fd = -1;
+  log->segment_bytes = segment_bytes ? segment_bytes : AUDIT_DEFAULT_SEGMENT_BYTES;
+  log->interval_ms = interval_ms ? interval_ms : AUDIT_DEFAULT_INTERVAL_MS;
+  log->directory = strdup(directory);
+  if (!log->directory) return false;
+  if (mkdir(directory, 0750) && errno != EEXIST) {
+    fprintf(stderr, "%s: %s\n", directory, strerror(errno));
+    free(log->directory);
+    return false;
+  }
+  pthread_condattr_t attributes;
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+  pthread_mutex_init(&log->lock, NULL);
+  pthread_cond_init(&log->wake, &attributes);
+  pthread_condattr_destroy(&attributes);
+  if (!open_segment(log, last_segment(directory) + 1) || pthread_create(&log->writer, NULL, run_writer, log)) {
+    if (log->fd >= 0) {
+      close(log->fd);
+    }
+    free(log->directory);
+    return false;
+  }
+  return true;
+}
+
+bool audit_log_close(AuditLog* log) {
+  pthread_mutex_lock(&log->lock);
+  atomic_store(&log->stopping, true);
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->lock);
+  pthread_join(log->writer, NULL);
+  close(log->fd);
+  int rings = atomic_load(&log->ring_count);
+  for (int i = 0; i < rings; ++i) {
+    free(log->rings[i]);
+  }
+  pthread_cond_destroy(&log->wake);
+  pthread_mutex_destroy(&log->lock);
+  free(log->directory);
+  return !atomic_load(&log->failed);
+}
+
+AuditRing* audit_log_register(AuditLog* log) {
+  AuditRing* ring = aligned_alloc(64, sizeof(AuditRing));
+  if (!ring) return NULL;
+  memset(ring, 0, offsetof(AuditRing, records));
+  ring->log = log;
+  pthread_mutex_lock(&log->lock);
+  int count = atomic_load(&log->ring_count);
+  if (count == AUDIT_LOG_MAX_RINGS) {
+    pthread_mutex_unlock(&log->lock);
+    free(ring);
+    return NULL;
+  }
+  log->rings[count] = ring;
+  atomic_store_explicit(&log->ring_count, count + 1, memory_order_release);
+  pthread_mutex_unlock(&log->lock);
+  return ring;
+}
+
+void audit_log_wake_writer(AuditLog* log) {
+  pthread_mutex_lock(&log->lock);
+  atomic_store(&log->kicked, true);
+  pthread_cond_signal(&log->wake);
+  pthread_mutex_unlock(&log->lock);
+}
+
+void audit_ring_wait(AuditRing* ring) {
+  atomic_fetch_add_explicit(&ring->log->waits, 1, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  struct timespec pause = {0, RING_WAIT_NS};
+  while (head - ring->tail_seen >= AUDIT_RING_RECORDS) {
+    audit_log_kick(ring->log);
+    nanosleep(&pause, NULL);
+    ring->tail_seen = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  }
+}
@@ -0,0 +1,127 @@
+// An append-only log of every verification, kept off the verifiers' critical path.
+//
+// Each verifying thread registers a ring and appends fixed-size records to it without locks or system
+// calls. A writer thread wakes every commit interval - or sooner, once a ring is half full - and writes
+// whatever the rings hold in one writev() and one fdatasync(), so a record is on disk within about one
+// interval of being appended. A ring that fills makes its thread wait for the writer rather than lose
+// records. Segments are numbered files in one directory; the writer starts a new one past segment_bytes,
+// and never appends to a segment left by an earlier run.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef AUDIT_LOG_H__
+#define AUDIT_LOG_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define AUDIT_LOG_MAGIC "pTOTPaud"
+#define AUDIT_LOG_VERSION 1
+#define AUDIT_LOG_MAX_RINGS 64
+#define AUDIT_RING_RECORDS (1 << 15)
+#define AUDIT_DEFAULT_SEGMENT_BYTES (64 << 20)
+#define AUDIT_DEFAULT_INTERVAL_MS 10
+
+typedef struct AuditSegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size; // sizeof(AuditRecord) when written
+  uint64_t segment; // Its number, as in the file name
+  uint64_t created; // Unix time in nanoseconds
+} AuditSegmentHeader;
+
+typedef struct AuditRecord {
+  uint64_t time; // Unix time in nanoseconds the check was made
+  uint64_t step; // Matched, or the one checked around if nothing matched (at the default period for an unknown token)
+  uint32_t id;
+  uint8_t result; // VerifyStatus
+  int8_t offset; // Of the matched step from the one asked for
+  uint8_t reserved[2];
+} AuditRecord;
+
+_Static_assert(sizeof(AuditSegmentHeader) == 32, "audit segment header layout changed");
+_Static_assert(sizeof(AuditRecord) == 24, "audit record layout changed");
+
+typedef struct AuditRing {
+  _Atomic uint64_t head; // Written only by the owning thread
+  uint64_t tail_seen; // The owning thread's last look at tail
+  struct AuditLog* log;
+  _Atomic uint64_t tail __attribute__((aligned(64))); // Written only by the writer
+  AuditRecord records[AUDIT_RING_RECORDS] __attribute__((aligned(64)));
+} AuditRing;
+
+typedef struct AuditLog {
+  char* directory;
+  int fd;
+  uint64_t segment;
+  size_t segment_bytes;
+  size_t written; // To the current segment
+  size_t rotate_at;
+  unsigned interval_ms;
+  pthread_t writer;
+  pthread_mutex_t lock; // Guards registration and the writer's sleep
+  pthread_cond_t wake;
+  AuditRing* rings[AUDIT_LOG_MAX_RINGS];
+  _Atomic int ring_count;
+  _Atomic bool stopping;
+  _Atomic bool kicked; // A ring passed half full since the writer last woke
+  _Atomic bool failed;
+  _Atomic uint64_t waits; // Appends that found their ring full
+} AuditLog;
+
+// Opens the next segment in directory (created if need be) and starts the writer thread.
+bool audit_log_open(AuditLog* log, const char* directory, size_t segment_bytes, unsigned interval_ms);
+
+// Writes out everything appended so far and stops the writer. Every ring must be done appending.
+// Returns false if any write failed.
+bool audit_log_close(AuditLog* log);
+
+// Gives the calling thread its own ring, or NULL if there are no more to give.
+AuditRing* audit_log_register(AuditLog* log);
+
+// For audit_log_append(): waits for the writer to make room, and wakes it early.
+void audit_ring_wait(AuditRing* ring);
+void audit_log_wake_writer(AuditLog* log);
+
+static inline void audit_log_kick(AuditLog* log) {
+  if (!atomic_load_explicit(&log->kicked, memory_order_relaxed)) {
+    audit_log_wake_writer(log);
+  }
+}
+
+static inline uint64_t audit_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void audit_log_append(AuditRing* ring, uint32_t id, uint64_t step, int offset, uint8_t result) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head - ring->tail_seen >= AUDIT_RING_RECORDS / 2) {
+    ring->tail_seen = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - ring->tail_seen >= AUDIT_RING_RECORDS) {
+      audit_ring_wait(ring);
+    } else if (head - ring->tail_seen >= AUDIT_RING_RECORDS / 2) {
+      audit_log_kick(ring->log);
+    }
+  }
+  AuditRecord* record = &ring->records[head % AUDIT_RING_RECORDS];
+  *record = (AuditRecord){.time = audit_now(), .step = step + offset, .id = id, .result = result, .offset = offset};
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,180 @@
+// audit_read: prints the records of audit log segments, reading each through a memory map.
+//
+//   audit_read [-i id] [-c] (directory | segments...)
+//
+// Prints "time id step offset result" per record, time as Unix seconds with nanoseconds; -i keeps one
+// token's records, and -c prints only a count of each result. A directory stands for all its segments,
+// oldest first. A record cut short at the end of a segment - a crash mid-write - is left out.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "audit_log.h"
+#include "buffered_writer.h"
+#include "verify_protocol.h"
+
+#define OUTPUT_LINE_MAX 96
+
+static const char* result_names[] = {"ok", "fail", "unknown", "locked"};
+#define RESULT_COUNT (sizeof(result_names) / sizeof(result_names[0]))
+
+typedef struct Options {
+  bool filter;
+  uint32_t id;
+  bool counts_only;
+} Options;
+
+static void usage(void) {
+  fprintf(stderr, "usage: audit_read [-i id] [-c] (directory | segments...)\n");
+  exit(2);
+}
+
+static int read_segment(const char* path, const Options* options, BufferedWriter* out, uint64_t* counts) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    if (fd >= 0) close(fd);
+    return 2;
+  }
+  if ((size_t)st.st_size < sizeof(AuditSegmentHeader)) {
+    close(fd);
+    fprintf(stderr, "%s: not an audit segment\n", path);
+    return 1;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return 2;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  const AuditSegmentHeader* header = map;
+  int status = 0;
+  if (memcmp(header->magic, AUDIT_LOG_MAGIC, sizeof(header->magic)) || header->version != AUDIT_LOG_VERSION ||
+      header->record_size != sizeof(AuditRecord)) {
+    fprintf(stderr, "%s: not an audit segment this reads\n", path);
+    status = 1;
+  } else {
+    const AuditRecord* records = (const AuditRecord*)(header + 1);
+    size_t count = (st.st_size - sizeof(AuditSegmentHeader)) / sizeof(AuditRecord);
+    for (size_t i = 0; i < count; ++i) {
+      const AuditRecord* record = &records[i];
+      if (options->filter && record->id != options->id) continue;
+      counts[record->result < RESULT_COUNT ? record->result : RESULT_COUNT]++;
+      if (options->counts_only) continue;
+      char* p = buffered_writer_reserve(out, OUTPUT_LINE_MAX);
+      p += sprintf(p, "%" PRIu64 ".%09" PRIu64 " %" PRIu32 " %" PRIu64 " %d %s\n", record->time / 1000000000,
+                   record->time % 1000000000, record->id, record->step, record->offset,
+                   record->result < RESULT_COUNT ? result_names[record->result] : "?");
+      buffered_writer_commit(out, p);
+    }
+  }
+  munmap(map, st.st_size);
+  return status;
+}
+
+static int compare_names(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// The segment names in a directory, sorted - which is oldest first, as the numbers are zero-padded.
+static char** list_segments(const char* directory, size_t* count) {
+  DIR* dir = opendir(directory);
+  if (!dir) return NULL;
+  char** names = NULL;
+  size_t capacity = 0;
+  *count = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir))) {
+    size_t length = strlen(entry->d_name);
+    if (strncmp(entry->d_name, "audit-", 6) || length < 10 || strcmp(entry->d_name + length - 4, ".log")) continue;
+    if (*count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      char** grown = realloc(names, capacity * sizeof(char*));
+      if (!grown) break;
+      names = grown;
+    }
+    names[*count] = malloc(strlen(directory) + length + 2);
+    if (!names[*count]) break;
+    sprintf(names[*count], "%s/%s", directory, entry->d_name);
+    ++*count;
+  }
+  closedir(dir);
+  if (names) {
+    qsort(names, *count, sizeof(char*), compare_names);
+  }
+  return names;
+}
+
+int main(int argc, char** argv) {
+  Options options = {0};
+  int opt;
+  while ((opt = getopt(argc, argv, "i:ch")) != -1) {
+    switch (opt) {
+      case 'i':
+        options.filter = true;
+        options.id = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        options.counts_only = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind == argc) usage();
+
+  BufferedWriter out;
+  if (!buffered_writer_open(&out, STDOUT_FILENO, 0)) return 2;
+  uint64_t counts[RESULT_COUNT + 1] = {0};
+  int status = 0;
+  for (int i = optind; i < argc; ++i) {
+    struct stat st;
+    if (!stat(argv[i], &st) && S_ISDIR(st.st_mode)) {
+      size_t count = 0;
+      char** names = list_segments(argv[i], &count);
+      for (size_t n = 0; n < count; ++n) {
+        int result = read_segment(names[n], &options, &out, counts);
+        status = result > status ? result : status;
+        free(names[n]);
+      }
+      free(names);
+    } else {
+      int result = read_segment(argv[i], &options, &out, counts);
+      status = result > status ? result : status;
+    }
+  }
+  if (options.counts_only) {
+    for (size_t r = 0; r <= RESULT_COUNT; ++r) {
+      if (!counts[r]) continue;
+      char* p = buffered_writer_reserve(&out, OUTPUT_LINE_MAX);
+      p += sprintf(p, "%s %" PRIu64 "\n", r < RESULT_COUNT ? result_names[r] : "?", counts[r]);
+      buffered_writer_commit(&out, p);
+    }
+  }
+  if (!buffered_writer_close(&out)) {
+    fprintf(stderr, "audit_read: write failed\n");
+    status = 2;
+  }
+  return status;
+}
@@ -0,0 +1,161 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base32.h"
+#include "base32_simd.h"
+
+// Value of each character, or 0xFF if it isn't part of the alphabet; 0xFE for skipped spaces.
+static const uint8_t base32_values[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x0E, 0x0B, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+  0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const char base32_alphabet[32] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+typedef size_t (*Base32BlockDecoder)(const char* in, size_t length, uint8_t* out);
+
+static size_t base32_decode_blocks_none(const char* in, size_t length, uint8_t* out) {
+  return 0;
+}
+
+static const struct {
+  const char* name;
+  Base32BlockDecoder blocks;
+} base32_implementations[Base32ImplementationCount] = {
+  [Base32Scalar] = {"scalar", base32_decode_blocks_none},
+  [Base32SSSE3] = {"ssse3", base32_decode_blocks_ssse3},
+  [Base32AVX2] = {"avx2", base32_decode_blocks_avx2},
+  [Base32NEON] = {"neon", base32_decode_blocks_neon},
+};
+
+static Base32Implementation base32_current = Base32Scalar;
+
+static bool base32_supported(Base32Implementation implementation) {
+  switch (implementation) {
+    case Base32Scalar:
+      return true;
+#if defined(__x86_64__) || defined(__i386__)
+    case Base32SSSE3:
+      return __builtin_cpu_supports("ssse3");
+    case Base32AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+    case Base32NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+// Settled before main() so base32_decode never races to pick.
+__attribute__((constructor))
+static void base32_select(void) {
+  for (int i = Base32ImplementationCount - 1; i >= 0; --i) {
+    if (base32_supported(i)) {
+      base32_current = i;
+      return;
+    }
+  }
+}
+
+Base32Implementation base32_implementation(void) {
+  return base32_current;
+}
+
+const char* base32_implementation_name(Base32Implementation implementation) {
+  return implementation < Base32ImplementationCount ? base32_implementations[implementation].name : "unknown";
+}
+
+bool base32_use(Base32Implementation implementation) {
+  if (implementation >= Base32ImplementationCount || !base32_supported(implementation)) return false;
+  base32_current = implementation;
+  return true;
+}
+
+static ssize_t base32_decode_scalar(const char* in, size_t length, uint8_t* out) {
+  uint32_t buffer = 0;
+  int bits = 0;
+  size_t written = 0;
+  size_t characters = 0;
+  for (size_t i = 0; i < length; ++i) {
+    uint8_t value = base32_values[(uint8_t)in[i]];
+    if (value == 0xFE) continue;
+    if (value == 0xFF) return -1;
+    buffer = (buffer << 5) | value;
+    bits += 5;
+    characters++;
+    if (bits >= 8) {
+      bits -= 8;
+      out[written++] = buffer >> bits;
+    }
+  }
+  // 1, 3 or 6 characters past a whole group leave bits that can't make up a byte.
+  switch (characters % 8) {
+    case 1:
+    case 3:
+    case 6:
+      return -1;
+  }
+  return written;
+}
+
+ssize_t base32_decode(const char* in, size_t length, uint8_t* out) {
+  while (length && in[length - 1] == '=') {
+    length--;
+  }
+  // The block decoders only ever stop on a group boundary, so the scalar decoder picks up with no bits pending.
+  size_t consumed = base32_implementations[base32_current].blocks(in, length, out);
+  ssize_t tail = base32_decode_scalar(in + consumed, length - consumed, out + consumed / 8 * 5);
+  return tail < 0 ? -1 : (ssize_t)(consumed / 8 * 5) + tail;
+}
+
+size_t base32_encode(const uint8_t* in, size_t length, char* out, bool pad) {
+  char* p = out;
+  for (; length >= 5; in += 5, length -= 5) {
+    uint64_t group = (uint64_t)in[0] << 32 | (uint64_t)in[1] << 24 | (uint64_t)in[2] << 16 | (uint64_t)in[3] << 8 | in[4];
+    for (int shift = 35; shift >= 0; shift -= 5) {
+      *p++ = base32_alphabet[(group >> shift) & 31];
+    }
+  }
+  if (length) {
+    uint64_t group = 0;
+    for (size_t i = 0; i < length; ++i) {
+      group |= (uint64_t)in[i] << (32 - i * 8);
+    }
+    size_t characters = (length * 8 + 4) / 5;
+    for (size_t i = 0; i < characters; ++i) {
+      *p++ = base32_alphabet[(group >> (35 - i * 5)) & 31];
+    }
+    if (pad) {
+      for (size_t i = characters; i < 8; ++i) {
+        *p++ = '=';
+      }
+    }
+  }
+  return p - out;
+}
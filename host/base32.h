@@ -0,0 +1,53 @@
+// RFC 4648 base32, as typed into the configuration page.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BASE32_H__
+#define BASE32_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Upper bound on the bytes base32_decode writes for length characters of input.
+#define BASE32_DECODED_LENGTH(length) (((length) * 5) / 8)
+
+// Characters base32_encode writes for length bytes, with or without padding.
+#define BASE32_ENCODED_LENGTH(length) (((length) * 8 + 4) / 5)
+#define BASE32_PADDED_LENGTH(length) ((((length) + 4) / 5) * 8)
+
+typedef enum Base32Implementation {
+  Base32Scalar,
+  Base32SSSE3,
+  Base32AVX2,
+  Base32NEON,
+  Base32ImplementationCount
+} Base32Implementation;
+
+// Decodes length characters into out, returning the decoded length or -1 (leaving out partly written) if the input isn't base32.
+// Like the configuration page: case-insensitive, spaces skipped, and 0, 1 and 8 read as O, L and B.
+// Trailing '=' padding is accepted, but not a character count no encoder could have produced.
+ssize_t base32_decode(const char* in, size_t length, uint8_t* out);
+
+// Writes the uppercase encoding of length bytes, without a terminator. Returns the characters written.
+size_t base32_encode(const uint8_t* in, size_t length, char* out, bool pad);
+
+// The implementation base32_decode uses - the fastest this CPU supports, unless changed with base32_use().
+Base32Implementation base32_implementation(void);
+const char* base32_implementation_name(Base32Implementation implementation);
+
+// Switches base32_decode to another implementation; false if this CPU (or build) can't run it. Not thread-safe.
+bool base32_use(Base32Implementation implementation);
+
+#endif
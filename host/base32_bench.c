@@ -0,0 +1,141 @@
+// base32_bench: decode and encode throughput of each base32 implementation this CPU runs, checked against
+// the scalar decoder.
+//
+//   base32_bench [-s megabytes] [-n rounds] [-k secret length]
+//
+// Bulk figures are GB/s of base32 text; the secret figures decode one short secret per call, as provisioning does.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "base32.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: base32_bench [-s megabytes] [-n rounds] [-k secret length]\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  size_t megabytes = 64;
+  int rounds = 5;
+  size_t secret_length = 32;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:n:k:h")) != -1) {
+    switch (opt) {
+      case 's':
+        megabytes = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        rounds = atoi(optarg);
+        break;
+      case 'k':
+        secret_length = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (!megabytes || rounds < 1 || !secret_length || secret_length % 8 == 1 || secret_length % 8 == 3 || secret_length % 8 == 6) usage();
+
+  size_t text_length = (megabytes << 20) & ~(size_t)7;
+  size_t raw_length = BASE32_DECODED_LENGTH(text_length);
+  char* text = malloc(text_length);
+  uint8_t* raw = malloc(raw_length);
+  uint8_t* reference = malloc(raw_length);
+  char* encoded = malloc(text_length);
+  if (!text || !raw || !reference || !encoded) {
+    fprintf(stderr, "base32_bench: out of memory\n");
+    return 2;
+  }
+  for (size_t i = 0; i < raw_length; ++i) {
+    reference[i] = rng_next();
+  }
+  base32_encode(reference, raw_length, text, false);
+
+  Base32Implementation best = base32_implementation();
+  int status = 0;
+  printf("%-8s %12s %14s %12s\n", "impl", "bulk GB/s", "secrets/s", "secret GB/s");
+  for (int impl = 0; impl < Base32ImplementationCount; ++impl) {
+    if (!base32_use(impl)) continue;
+
+    memset(raw, 0, raw_length);
+    ssize_t decoded = base32_decode(text, text_length, raw);
+    if (decoded != (ssize_t)raw_length || memcmp(raw, reference, raw_length)) {
+      fprintf(stderr, "base32_bench: %s decoded differently from the input\n", base32_implementation_name(impl));
+      status = 1;
+      continue;
+    }
+
+    double bulk_best = 0;
+    for (int round = 0; round < rounds; ++round) {
+      double started = now_seconds();
+      base32_decode(text, text_length, raw);
+      double elapsed = now_seconds() - started;
+      if (!bulk_best || elapsed < bulk_best) bulk_best = elapsed;
+    }
+
+    size_t secrets = text_length / secret_length;
+    double secret_best = 0;
+    for (int round = 0; round < rounds; ++round) {
+      double started = now_seconds();
+      uint8_t* out = raw;
+      for (size_t i = 0; i < secrets; ++i) {
+        out += base32_decode(text + i * secret_length, secret_length, out);
+      }
+      double elapsed = now_seconds() - started;
+      if (!secret_best || elapsed < secret_best) secret_best = elapsed;
+    }
+
+    printf("%-8s %12.2f %14.0f %12.2f\n", base32_implementation_name(impl),
+      text_length / bulk_best / 1e9, secrets / secret_best, secrets * secret_length / secret_best / 1e9);
+  }
+  base32_use(best);
+
+  double encode_best = 0;
+  for (int round = 0; round < rounds; ++round) {
+    double started = now_seconds();
+    base32_encode(reference, raw_length, encoded, false);
+    double elapsed = now_seconds() - started;
+    if (!encode_best || elapsed < encode_best) encode_best = elapsed;
+  }
+  if (memcmp(encoded, text, text_length)) {
+    fprintf(stderr, "base32_bench: encoding isn't stable\n");
+    status = 1;
+  }
+  printf("encode   %12.2f\n", text_length / encode_best / 1e9);
+
+  free(text);
+  free(raw);
+  free(reference);
+  free(encoded);
+  return status;
+}
@@ -0,0 +1,69 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base32_simd.h"
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+
+#include <arm_neon.h>
+#include <string.h>
+
+// Same steps as the SSSE3 decoder; NEON has unsigned compares, so each range is one subtract and compare.
+size_t base32_decode_blocks_neon(const char* in, size_t length, uint8_t* out) {
+  static const uint8_t shuffle_bytes[16] = {BASE32_SIMD_SHUFFLE, 255, 255, 255, 255, 255, 255};
+  const uint8x16_t shuffle = vld1q_u8(shuffle_bytes);
+
+  size_t pos = 0;
+  for (; length - pos >= 16; pos += 16, out += 10) {
+    uint8x16_t c = vld1q_u8((const uint8_t*)in + pos);
+    uint8x16_t folded = vorrq_u8(c, vdupq_n_u8(0x20));
+    uint8x16_t letter = vcleq_u8(vsubq_u8(folded, vdupq_n_u8('a')), vdupq_n_u8(25));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(c, vdupq_n_u8('2')), vdupq_n_u8(5));
+    uint8x16_t zero = vceqq_u8(c, vdupq_n_u8('0'));
+    uint8x16_t one = vceqq_u8(c, vdupq_n_u8('1'));
+    uint8x16_t eight = vceqq_u8(c, vdupq_n_u8('8'));
+    uint8x16_t ok = vorrq_u8(vorrq_u8(letter, digit), vorrq_u8(zero, vorrq_u8(one, eight)));
+    if (vminvq_u8(ok) != 0xFF) break;
+
+    uint8x16_t values = vandq_u8(letter, vsubq_u8(folded, vdupq_n_u8('a')));
+    values = vorrq_u8(values, vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('2' - 26))));
+    values = vorrq_u8(values, vandq_u8(zero, vdupq_n_u8(14)));
+    values = vorrq_u8(values, vandq_u8(one, vdupq_n_u8(11)));
+    values = vorrq_u8(values, vandq_u8(eight, vdupq_n_u8(1)));
+
+    // Little-endian lanes hold the earlier value in their low half: combine as low << bits | high.
+    uint16x8_t w = vreinterpretq_u16_u8(values);
+    w = vorrq_u16(vandq_u16(vshlq_n_u16(w, 5), vdupq_n_u16(0x3E0)), vshrq_n_u16(w, 8));
+    uint32x4_t x = vreinterpretq_u32_u16(w);
+    x = vorrq_u32(vandq_u32(vshlq_n_u32(x, 10), vdupq_n_u32(0xFFC00)), vshrq_n_u32(x, 16));
+    uint64x2_t y = vreinterpretq_u64_u32(x);
+    y = vorrq_u64(vandq_u64(vshlq_n_u64(y, 20), vdupq_n_u64(0xFFFFF00000ULL)), vshrq_n_u64(y, 32));
+    uint8x16_t packed = vqtbl1q_u8(vreinterpretq_u8_u64(y), shuffle);
+
+    if (length - pos >= 16 + 10) {
+      vst1q_u8(out, packed);
+    } else {
+      uint8_t last[16];
+      vst1q_u8(last, packed);
+      memcpy(out, last, 10);
+    }
+  }
+  return pos;
+}
+
+#else
+
+size_t base32_decode_blocks_neon(const char* in, size_t length, uint8_t* out) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+// Block decoders behind base32_decode(). Each consumes whole blocks of 8 characters from the start of the
+// input, stopping at the first block with anything but the 32 alphabet characters (or their aliases) in it,
+// and returns how many characters it took. The rest is left to the scalar decoder.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BASE32_SIMD_H__
+#define BASE32_SIMD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 40 bits per 8 characters, read from each 64-bit lane's low five bytes most significant first.
+#define BASE32_SIMD_SHUFFLE 4, 3, 2, 1, 0, 12, 11, 10, 9, 8
+
+size_t base32_decode_blocks_ssse3(const char* in, size_t length, uint8_t* out);
+size_t base32_decode_blocks_avx2(const char* in, size_t length, uint8_t* out);
+size_t base32_decode_blocks_neon(const char* in, size_t length, uint8_t* out);
+
+#endif
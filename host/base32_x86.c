@@ -0,0 +1,126 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base32_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <string.h>
+
+// Maps 16 characters to their 5-bit values; *valid is set to whether all of them were in the alphabet.
+// Letters are folded to lowercase first, which leaves the digits alone. Signed compares also rule out bytes >= 0x80.
+__attribute__((target("ssse3")))
+static inline __m128i values_ssse3(__m128i c, int* valid) {
+  __m128i folded = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('2' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('7' + 1)));
+  __m128i zero = _mm_cmpeq_epi8(c, _mm_set1_epi8('0'));
+  __m128i one = _mm_cmpeq_epi8(c, _mm_set1_epi8('1'));
+  __m128i eight = _mm_cmpeq_epi8(c, _mm_set1_epi8('8'));
+
+  __m128i values = _mm_and_si128(letter, _mm_sub_epi8(folded, _mm_set1_epi8('a')));
+  values = _mm_or_si128(values, _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('2' - 26))));
+  values = _mm_or_si128(values, _mm_and_si128(zero, _mm_set1_epi8(14)));
+  values = _mm_or_si128(values, _mm_and_si128(one, _mm_set1_epi8(11)));
+  values = _mm_or_si128(values, _mm_and_si128(eight, _mm_set1_epi8(1)));
+
+  __m128i ok = _mm_or_si128(_mm_or_si128(letter, digit), _mm_or_si128(zero, _mm_or_si128(one, eight)));
+  *valid = _mm_movemask_epi8(ok) == 0xFFFF;
+  return values;
+}
+
+// Packs 5-bit values into 10 bytes at the start of the register: pairs to 10 bits, to 20, then to 40 per 64-bit lane.
+__attribute__((target("ssse3")))
+static inline __m128i pack_ssse3(__m128i values) {
+  __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi16(0x0120)); // v0 * 32 + v1
+  merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00010400)); // w0 * 1024 + w1
+  merged = _mm_or_si128(_mm_srli_epi64(_mm_slli_epi64(merged, 32), 12), _mm_srli_epi64(merged, 32)); // x0 << 20 | x1
+  return _mm_shuffle_epi8(merged, _mm_setr_epi8(BASE32_SIMD_SHUFFLE, -1, -1, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3")))
+size_t base32_decode_blocks_ssse3(const char* in, size_t length, uint8_t* out) {
+  size_t pos = 0;
+  for (; length - pos >= 16; pos += 16, out += 10) {
+    int valid;
+    __m128i values = values_ssse3(_mm_loadu_si128((const __m128i*)(in + pos)), &valid);
+    if (!valid) break;
+    __m128i packed = pack_ssse3(values);
+    // A full store runs 6 bytes past this block's output - only safe while at least that much more is coming.
+    if (length - pos >= 16 + 10) {
+      _mm_storeu_si128((__m128i*)out, packed);
+    } else {
+      uint8_t last[16];
+      _mm_storeu_si128((__m128i*)last, packed);
+      memcpy(out, last, 10);
+    }
+  }
+  return pos;
+}
+
+__attribute__((target("avx2")))
+size_t base32_decode_blocks_avx2(const char* in, size_t length, uint8_t* out) {
+  const __m256i letter_lo = _mm256_set1_epi8('a' - 1);
+  const __m256i letter_hi = _mm256_set1_epi8('z' + 1);
+  const __m256i digit_lo = _mm256_set1_epi8('2' - 1);
+  const __m256i digit_hi = _mm256_set1_epi8('7' + 1);
+  const __m256i shuffle = _mm256_setr_epi8(BASE32_SIMD_SHUFFLE, -1, -1, -1, -1, -1, -1, BASE32_SIMD_SHUFFLE, -1, -1, -1, -1, -1, -1);
+
+  size_t pos = 0;
+  for (; length - pos >= 32; pos += 32, out += 20) {
+    __m256i c = _mm256_loadu_si256((const __m256i*)(in + pos));
+    __m256i folded = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(folded, letter_lo), _mm256_cmpgt_epi8(letter_hi, folded));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, digit_lo), _mm256_cmpgt_epi8(digit_hi, c));
+    __m256i zero = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('0'));
+    __m256i one = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('1'));
+    __m256i eight = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('8'));
+    __m256i ok = _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_or_si256(zero, _mm256_or_si256(one, eight)));
+    if (_mm256_movemask_epi8(ok) != -1) break;
+
+    __m256i values = _mm256_and_si256(letter, _mm256_sub_epi8(folded, _mm256_set1_epi8('a')));
+    values = _mm256_or_si256(values, _mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('2' - 26))));
+    values = _mm256_or_si256(values, _mm256_and_si256(zero, _mm256_set1_epi8(14)));
+    values = _mm256_or_si256(values, _mm256_and_si256(one, _mm256_set1_epi8(11)));
+    values = _mm256_or_si256(values, _mm256_and_si256(eight, _mm256_set1_epi8(1)));
+
+    __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0120));
+    merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00010400));
+    merged = _mm256_or_si256(_mm256_srli_epi64(_mm256_slli_epi64(merged, 32), 12), _mm256_srli_epi64(merged, 32));
+    merged = _mm256_shuffle_epi8(merged, shuffle); // 10 bytes at the start of each 128-bit lane
+
+    if (length - pos >= 32 + 10) {
+      _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(merged));
+      _mm_storeu_si128((__m128i*)(out + 10), _mm256_extracti128_si256(merged, 1));
+    } else {
+      uint8_t last[32];
+      _mm256_storeu_si256((__m256i*)last, merged);
+      memcpy(out, last, 10);
+      memcpy(out + 10, last + 16, 10);
+    }
+  }
+  // Finish off a trailing 16 characters, as a 26 or 32 character secret would have.
+  return pos + base32_decode_blocks_ssse3(in + pos, length - pos, out);
+}
+
+#else
+
+size_t base32_decode_blocks_ssse3(const char* in, size_t length, uint8_t* out) {
+  return 0;
+}
+
+size_t base32_decode_blocks_avx2(const char* in, size_t length, uint8_t* out) {
+  return 0;
+}
+
+#endif
@@ -0,0 +1,64 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "buffered_writer.h"
+
+bool buffered_writer_open(BufferedWriter* writer, int fd, size_t capacity) {
+  memset(writer, 0, sizeof(BufferedWriter));
+  writer->fd = fd;
+  writer->capacity = capacity ? capacity : BUFFERED_WRITER_DEFAULT_CAPACITY;
+  writer->buffer = malloc(writer->capacity);
+  return writer->buffer != NULL;
+}
+
+bool buffered_writer_close(BufferedWriter* writer) {
+  buffered_writer_flush(writer);
+  free(writer->buffer);
+  writer->buffer = NULL;
+  return !writer->failed;
+}
+
+void buffered_writer_flush(BufferedWriter* writer) {
+  size_t done = 0;
+  while (done < writer->length && !writer->failed) {
+    ssize_t got = write(writer->fd, writer->buffer + done, writer->length - done);
+    if (got < 0 && errno == EINTR) continue;
+    if (got <= 0) {
+      writer->failed = true;
+      break;
+    }
+    done += got;
+  }
+  writer->written += done;
+  writer->length = 0;
+}
+
+void buffered_writer_append(BufferedWriter* writer, const void* data, size_t length) {
+  const char* p = data;
+  while (length) {
+    if (writer->length == writer->capacity) {
+      buffered_writer_flush(writer);
+    }
+    size_t chunk = writer->capacity - writer->length;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(writer->buffer + writer->length, p, chunk);
+    writer->length += chunk;
+    p += chunk;
+    length -= chunk;
+  }
+}
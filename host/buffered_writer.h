@@ -0,0 +1,55 @@
+// Collects output in one large buffer and writes it out a buffer at a time.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUFFERED_WRITER_H__
+#define BUFFERED_WRITER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFERED_WRITER_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct BufferedWriter {
+  int fd;
+  char* buffer;
+  size_t capacity;
+  size_t length;
+  uint64_t written; // Bytes handed to write() so far
+  bool failed; // A write() failed - everything since has been dropped
+} BufferedWriter;
+
+bool buffered_writer_open(BufferedWriter* writer, int fd, size_t capacity);
+
+// Flushes, then frees the buffer. Returns false if any write failed.
+bool buffered_writer_close(BufferedWriter* writer);
+
+void buffered_writer_flush(BufferedWriter* writer);
+
+// Room for at least length more bytes at the returned pointer, flushing first if need be. The caller
+// fills it and then calls buffered_writer_commit(). length must not exceed the capacity.
+static inline char* buffered_writer_reserve(BufferedWriter* writer, size_t length) {
+  if (writer->length + length > writer->capacity) {
+    buffered_writer_flush(writer);
+  }
+  return writer->buffer + writer->length;
+}
+
+static inline void buffered_writer_commit(BufferedWriter* writer, const char* end) {
+  writer->length = end - writer->buffer;
+}
+
+void buffered_writer_append(BufferedWriter* writer, const void* data, size_t length);
+
+#endif
@@ -0,0 +1,40 @@
+// Assertions for the host tests run by `make check`: each failure is reported and counted, and the test
+// carries on so one run shows everything that's broken.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CHECK_H__
+#define CHECK_H__
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      check_failures++; \
+    } \
+  } while (0)
+
+// Returned from main(): 0 if every check passed.
+static inline int check_result(const char* name) {
+  if (check_failures) {
+    fprintf(stderr, "%s: %d checks failed\n", name, check_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif
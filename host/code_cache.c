@@ -0,0 +1,87 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "code_cache.h"
+
+bool code_cache_init(CodeCache* cache, size_t entries) {
+  size_t buckets = 1;
+  while (buckets * CODE_CACHE_WAYS < entries) {
+    buckets *= 2;
+  }
+  // Sequence 0 with epoch 0 never matches - callers' epochs start from 1, as snapshot generations do.
+  cache->buckets = aligned_alloc(sizeof(CodeCacheBucket), buckets * sizeof(CodeCacheBucket));
+  if (!cache->buckets) return false;
+  memset(cache->buckets, 0, buckets * sizeof(CodeCacheBucket));
+  cache->mask = buckets - 1;
+  return true;
+}
+
+void code_cache_free(CodeCache* cache) {
+  free(cache->buckets);
+  cache->buckets = NULL;
+}
+
+static CodeCacheBucket* bucket_for(const CodeCache* cache, uint32_t id, uint64_t step) {
+  uint64_t key = ((uint64_t)id << 32 ^ step) * 0x9E3779B97F4A7C15ULL;
+  return &cache->buckets[(key >> 32) & cache->mask];
+}
+
+bool code_cache_lookup(const CodeCache* cache, uint64_t epoch, uint32_t id, uint64_t step, uint32_t* hash) {
+  if (!epoch) return false;
+  CodeCacheBucket* bucket = bucket_for(cache, id, step);
+  for (int way = 0; way < CODE_CACHE_WAYS; ++way) {
+    CodeCacheEntry* entry = &bucket->entries[way];
+    uint64_t sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    if (sequence & 1) continue;
+    bool match = atomic_load_explicit(&entry->id, memory_order_relaxed) == id &&
+                 atomic_load_explicit(&entry->step, memory_order_relaxed) == step &&
+                 atomic_load_explicit(&entry->epoch, memory_order_relaxed) == epoch;
+    uint32_t value = atomic_load_explicit(&entry->hash, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (match && atomic_load_explicit(&entry->sequence, memory_order_relaxed) == sequence) {
+      *hash = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+void code_cache_store(CodeCache* cache, uint64_t epoch, uint32_t id, uint64_t step, uint32_t hash) {
+  if (!epoch) return;
+  CodeCacheBucket* bucket = bucket_for(cache, id, step);
+  // Replace an entry from an older epoch, else the one for the older step - the steps in a bucket are
+  // usually a verification window's worth for different tokens, so that's the one least likely asked for again.
+  CodeCacheEntry* victim = &bucket->entries[0];
+  for (int way = 0; way < CODE_CACHE_WAYS; ++way) {
+    CodeCacheEntry* entry = &bucket->entries[way];
+    if (atomic_load_explicit(&entry->epoch, memory_order_relaxed) != epoch) {
+      victim = entry;
+      break;
+    }
+    if (atomic_load_explicit(&entry->step, memory_order_relaxed) < atomic_load_explicit(&victim->step, memory_order_relaxed)) {
+      victim = entry;
+    }
+  }
+  uint64_t sequence = atomic_load_explicit(&victim->sequence, memory_order_relaxed);
+  if ((sequence & 1) || !atomic_compare_exchange_strong_explicit(&victim->sequence, &sequence, sequence + 1,
+                                                                  memory_order_acquire, memory_order_relaxed)) {
+    return; // Another thread is writing it; this result just goes uncached.
+  }
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&victim->id, id, memory_order_relaxed);
+  atomic_store_explicit(&victim->step, step, memory_order_relaxed);
+  atomic_store_explicit(&victim->epoch, epoch, memory_order_relaxed);
+  atomic_store_explicit(&victim->hash, hash, memory_order_relaxed);
+  atomic_store_explicit(&victim->sequence, sequence + 2, memory_order_release);
+}
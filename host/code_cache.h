@@ -0,0 +1,60 @@
+// A fixed-size cache of truncated hashes keyed by (token ID, step), so retried and repeated checks within
+// a step cost a lookup rather than an HMAC.
+//
+// Buckets are one cache line of two entries. Each entry carries a sequence count, odd while it's being
+// written: readers never wait, and treat an entry that changed under them as a miss, while a writer that
+// finds an entry already being written just doesn't cache. Entries are stamped with the caller's epoch -
+// the token snapshot's generation, say - so a reload invalidates everything at once without touching the
+// table. Old steps never match again and are the first to be replaced.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CODE_CACHE_H__
+#define CODE_CACHE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODE_CACHE_WAYS 2
+
+typedef struct CodeCacheEntry {
+  _Atomic uint64_t sequence;
+  _Atomic uint64_t step;
+  _Atomic uint64_t epoch;
+  _Atomic uint32_t id;
+  _Atomic uint32_t hash;
+} CodeCacheEntry;
+
+typedef struct CodeCacheBucket {
+  CodeCacheEntry entries[CODE_CACHE_WAYS];
+} __attribute__((aligned(64))) CodeCacheBucket;
+
+_Static_assert(sizeof(CodeCacheBucket) == 64, "A bucket should fill one cache line");
+
+typedef struct CodeCache {
+  CodeCacheBucket* buckets;
+  size_t mask;
+} CodeCache;
+
+// Holds at least entries results, rounded up to a power of two.
+bool code_cache_init(CodeCache* cache, size_t entries);
+void code_cache_free(CodeCache* cache);
+
+// Looks up the 31-bit hash stored for this token and step in this epoch.
+bool code_cache_lookup(const CodeCache* cache, uint64_t epoch, uint32_t id, uint64_t step, uint32_t* hash);
+
+void code_cache_store(CodeCache* cache, uint64_t epoch, uint32_t id, uint64_t step, uint32_t hash);
+
+#endif
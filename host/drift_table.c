@@ -0,0 +1,129 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "drift_table.h"
+
+// Slot layout: tag in the top 24 bits (never 0, so an empty slot is all zeroes), samples in the next 8,
+// and the mean offset in the low 16 as a signed count of 1/256 steps.
+#define SLOT_TAG(slot) ((slot) >> 40)
+#define SLOT_SAMPLES(slot) (((slot) >> 32) & 0xFF)
+#define SLOT_MEAN(slot) ((int)(int16_t)(slot))
+#define MAKE_SLOT(tag, samples, mean) ((uint64_t)(tag) << 40 | (uint64_t)(samples) << 32 | (uint16_t)(mean))
+
+#define STEP 256 // Fixed-point units per step
+
+bool drift_table_init(DriftTable* table, size_t tokens) {
+  size_t lines = 1;
+  while (lines * DRIFT_TABLE_SLOTS_PER_LINE < tokens * 2) {
+    lines *= 2;
+  }
+  table->lines = aligned_alloc(sizeof(DriftTableLine), lines * sizeof(DriftTableLine));
+  if (!table->lines) return false;
+  memset(table->lines, 0, lines * sizeof(DriftTableLine));
+  table->mask = lines - 1;
+  return true;
+}
+
+void drift_table_free(DriftTable* table) {
+  free(table->lines);
+  table->lines = NULL;
+}
+
+static DriftTableLine* line_for(const DriftTable* table, uint32_t id, uint32_t* tag) {
+  uint64_t hash = id * 0x9E3779B97F4A7C15ULL;
+  *tag = (hash >> 40) | 1;
+  return &table->lines[hash & table->mask];
+}
+
+static int round_div(int x, int divisor) {
+  return x >= 0 ? (x + divisor / 2) / divisor : -((-x + divisor / 2) / divisor);
+}
+
+static int default_plan(int window, int* offsets) {
+  int count = 0;
+  for (int i = 0; i <= window * 2; ++i) {
+    offsets[count++] = (i & 1) ? -(i + 1) / 2 : i / 2;
+  }
+  return count;
+}
+
+int drift_table_plan(const DriftTable* table, uint32_t id, int window, int* offsets) {
+  uint32_t tag;
+  DriftTableLine* line = line_for(table, id, &tag);
+  uint64_t slot = 0;
+  for (int i = 0; i < DRIFT_TABLE_SLOTS_PER_LINE; ++i) {
+    uint64_t candidate = atomic_load_explicit(&line->slots[i], memory_order_relaxed);
+    if (SLOT_TAG(candidate) == tag) {
+      slot = candidate;
+      break;
+    }
+  }
+  if (SLOT_SAMPLES(slot) < DRIFT_TABLE_MIN_SAMPLES) return default_plan(window, offsets);
+
+  int mean = SLOT_MEAN(slot);
+
+  // Nearest the mean first, and of two as near, the one nearer now.
+  int count = 0;
+  for (int offset = -window; offset <= window; ++offset) {
+    int distance = abs(offset * STEP - mean);
+    int i = count++;
+    while (i > 0) {
+      int before = abs(offsets[i - 1] * STEP - mean);
+      if (before < distance || (before == distance && abs(offsets[i - 1]) <= abs(offset))) break;
+      offsets[i] = offsets[i - 1];
+      i--;
+    }
+    offsets[i] = offset;
+  }
+  return count;
+}
+
+void drift_table_record(DriftTable* table, uint32_t id, int offset) {
+  uint32_t tag;
+  DriftTableLine* line = line_for(table, id, &tag);
+  int sample = offset * STEP;
+  for (;;) {
+    _Atomic uint64_t* own = NULL;
+    _Atomic uint64_t* victim = NULL;
+    uint64_t own_slot = 0, victim_slot = 0;
+    for (int i = 0; i < DRIFT_TABLE_SLOTS_PER_LINE; ++i) {
+      uint64_t slot = atomic_load_explicit(&line->slots[i], memory_order_relaxed);
+      if (SLOT_TAG(slot) == tag) {
+        own = &line->slots[i];
+        own_slot = slot;
+        break;
+      }
+      if (!victim || SLOT_SAMPLES(slot) < SLOT_SAMPLES(victim_slot)) {
+        victim = &line->slots[i];
+        victim_slot = slot;
+      }
+    }
+
+    uint64_t desired;
+    if (own) {
+      unsigned samples = SLOT_SAMPLES(own_slot);
+      int weight = samples + 1 < DRIFT_TABLE_WEIGHT ? samples + 1 : DRIFT_TABLE_WEIGHT;
+      int mean = SLOT_MEAN(own_slot);
+      mean += round_div(sample - mean, weight);
+      desired = MAKE_SLOT(tag, samples < 0xFF ? samples + 1 : samples, mean);
+      // A settled token matching where it always does changes nothing, so it doesn't write.
+      if (desired == own_slot) return;
+    } else {
+      own = victim;
+      own_slot = victim_slot;
+      desired = MAKE_SLOT(tag, 1, sample);
+    }
+    if (atomic_compare_exchange_weak_explicit(own, &own_slot, desired, memory_order_relaxed, memory_order_relaxed)) return;
+  }
+}
@@ -0,0 +1,54 @@
+// Per-token estimates of clock drift, so verification can try the steps a token's codes usually come
+// from first. Every step of the window is still tried before a code is turned down, so a clock that's
+// corrected - and jumps away from its estimate - is found further down the order rather than locked out.
+//
+// Each successful check feeds the offset it matched at into an exponentially weighted mean (a simple
+// average over the first DRIFT_TABLE_WEIGHT, so new tokens settle quickly), kept in 1/256ths of a step and
+// packed with a tag from the ID and a sample count into one 64-bit word that's updated by compare-and-swap. As in the attempt limiter, a token's word lives in one of the eight
+// slots of the cache line its ID hashes to; a new token takes the slot with the fewest samples.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DRIFT_TABLE_H__
+#define DRIFT_TABLE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DRIFT_TABLE_SLOTS_PER_LINE 8
+#define DRIFT_TABLE_WEIGHT 8 // The newest sample counts for 1/8 once there are this many
+#define DRIFT_TABLE_MIN_SAMPLES 4 // Successes before a token's steps are tried in its own order
+
+typedef struct DriftTableLine {
+  _Atomic uint64_t slots[DRIFT_TABLE_SLOTS_PER_LINE];
+} __attribute__((aligned(64))) DriftTableLine;
+
+typedef struct DriftTable {
+  DriftTableLine* lines;
+  size_t mask;
+} DriftTable;
+
+// Sized for about tokens tokens.
+bool drift_table_init(DriftTable* table, size_t tokens);
+void drift_table_free(DriftTable* table);
+
+// Fills offsets with every step of the window, 2 * window + 1 of them, in the order to try them for token
+// id: nearest its estimated drift first, or nearest to now for a token without a settled estimate.
+int drift_table_plan(const DriftTable* table, uint32_t id, int window, int* offsets);
+
+// Adds the offset a successful check for token id matched at.
+void drift_table_record(DriftTable* table, uint32_t id, int offset);
+
+#endif
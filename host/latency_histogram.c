@@ -0,0 +1,57 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "latency_histogram.h"
+
+void latency_histogram_init(LatencyHistogram* histogram) {
+  memset(histogram, 0, sizeof(LatencyHistogram));
+  histogram->min = UINT64_MAX;
+}
+
+void latency_histogram_merge(LatencyHistogram* into, const LatencyHistogram* from) {
+  for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+    into->counts[i] += from->counts[i];
+  }
+  into->total += from->total;
+  into->sum += from->sum;
+  if (from->min < into->min) {
+    into->min = from->min;
+  }
+  if (from->max > into->max) {
+    into->max = from->max;
+  }
+}
+
+static uint64_t bucket_top(unsigned bucket) {
+  if (bucket < 2 * LATENCY_SUB_BUCKETS) return bucket;
+  unsigned shift = bucket / LATENCY_SUB_BUCKETS - 1;
+  uint64_t sub = LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+uint64_t latency_histogram_quantile(const LatencyHistogram* histogram, double quantile) {
+  if (!histogram->total) return 0;
+  uint64_t rank = (uint64_t)(quantile * histogram->total + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+    seen += histogram->counts[i];
+    if (seen >= rank) {
+      uint64_t top = bucket_top(i);
+      return top < histogram->max ? top : histogram->max;
+    }
+  }
+  return histogram->max;
+}
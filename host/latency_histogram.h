@@ -0,0 +1,61 @@
+// Log-linear latency histogram in the style of HdrHistogram: exact below 64ns, then 32 buckets per
+// power of two, so any percentile it reports is within about 3% of the true value.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LATENCY_HISTOGRAM_H__
+#define LATENCY_HISTOGRAM_H__
+
+#include <stdint.h>
+
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_SHIFT 35 // Values past 2^41ns - about 36 minutes - land in the last bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_SHIFT + 2) * LATENCY_SUB_BUCKETS)
+
+typedef struct LatencyHistogram {
+  uint64_t counts[LATENCY_BUCKETS];
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  uint64_t sum;
+} LatencyHistogram;
+
+void latency_histogram_init(LatencyHistogram* histogram);
+
+static inline unsigned latency_bucket(uint64_t value) {
+  if (value < 2 * LATENCY_SUB_BUCKETS) return value;
+  unsigned shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BUCKET_BITS;
+  if (shift > LATENCY_MAX_SHIFT) return LATENCY_BUCKETS - 1;
+  return (shift + 1) * LATENCY_SUB_BUCKETS + ((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+static inline void latency_histogram_record(LatencyHistogram* histogram, uint64_t value) {
+  histogram->counts[latency_bucket(value)]++;
+  histogram->total++;
+  histogram->sum += value;
+  if (value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+void latency_histogram_merge(LatencyHistogram* into, const LatencyHistogram* from);
+
+// The value at or below which a fraction quantile (0 to 1) of recordings fall, rounded up to its bucket's
+// top - never below the true figure. 0 if nothing has been recorded.
+uint64_t latency_histogram_quantile(const LatencyHistogram* histogram, double quantile);
+
+#endif
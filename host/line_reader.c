@@ -0,0 +1,76 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "line_reader.h"
+
+bool line_reader_open(LineReader* reader, int fd, size_t capacity) {
+  memset(reader, 0, sizeof(LineReader));
+  reader->fd = fd;
+  reader->capacity = capacity ? capacity : LINE_READER_DEFAULT_CAPACITY;
+  reader->buffer = malloc(reader->capacity);
+  return reader->buffer != NULL;
+}
+
+void line_reader_close(LineReader* reader) {
+  free(reader->buffer);
+  reader->buffer = NULL;
+}
+
+// Moves what's left to the front of the buffer and tops it up. Returns false if nothing more could be read.
+static bool line_reader_fill(LineReader* reader) {
+  if (reader->eof) return false;
+  if (reader->start) {
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+  }
+  while (reader->end < reader->capacity) {
+    ssize_t got = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+    if (got > 0) {
+      reader->end += got;
+      return true;
+    }
+    if (got < 0 && errno == EINTR) continue;
+    reader->failed = got < 0;
+    reader->eof = true;
+    return false;
+  }
+  return false;
+}
+
+bool line_reader_next(LineReader* reader, const char** line, size_t* length) {
+  size_t scanned = reader->start;
+  char* newline;
+  while (!(newline = memchr(reader->buffer + scanned, '\n', reader->end - scanned))) {
+    size_t pending = reader->end - reader->start;
+    if (!line_reader_fill(reader)) {
+      if (!pending) return false;
+      // The final line has no terminator, or didn't fit.
+      newline = reader->buffer + reader->end;
+      break;
+    }
+    scanned = pending;
+  }
+
+  *line = reader->buffer + reader->start;
+  *length = newline - *line;
+  reader->start = newline < reader->buffer + reader->end ? (size_t)(newline - reader->buffer) + 1 : reader->end;
+  if (*length && (*line)[*length - 1] == '\r') {
+    (*length)--;
+  }
+  reader->line_number++;
+  return true;
+}
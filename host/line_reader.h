@@ -0,0 +1,41 @@
+// Reads a file descriptor a large chunk at a time and hands out its lines in place.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LINE_READER_H__
+#define LINE_READER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LINE_READER_DEFAULT_CAPACITY (1 << 20)
+
+typedef struct LineReader {
+  int fd;
+  char* buffer;
+  size_t capacity;
+  size_t start; // First byte not yet handed out
+  size_t end; // One past the last byte read
+  bool eof;
+  bool failed; // A read() failed - the lines so far are all there will be
+  unsigned long line_number; // Of the line last returned, from 1
+} LineReader;
+
+bool line_reader_open(LineReader* reader, int fd, size_t capacity);
+void line_reader_close(LineReader* reader);
+
+// Points line at the next line, without its terminator (or a trailing '\r'). It stays valid until the next call.
+// A line longer than the buffer comes back cut at the buffer's length, the rest following as the next line.
+bool line_reader_next(LineReader* reader, const char** line, size_t* length);
+
+#endif
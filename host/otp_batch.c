@@ -0,0 +1,79 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "otp_batch.h"
+
+// Stable LSD radix sort on the ID, a byte a pass, skipping bytes every ID shares - usually the top one.
+void otp_batch_sort(OTPBatchItem* items, size_t count, OTPBatchItem* scratch) {
+  OTPBatchItem* from = items;
+  OTPBatchItem* to = scratch;
+  for (int shift = 0; shift < 32; shift += 8) {
+    size_t offsets[256] = {0};
+    for (size_t i = 0; i < count; ++i) {
+      offsets[(from[i].id >> shift) & 0xFF]++;
+    }
+    if (count && offsets[(from[0].id >> shift) & 0xFF] == count) continue;
+    size_t total = 0;
+    for (int bucket = 0; bucket < 256; ++bucket) {
+      size_t bucket_count = offsets[bucket];
+      offsets[bucket] = total;
+      total += bucket_count;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      to[offsets[(from[i].id >> shift) & 0xFF]++] = from[i];
+    }
+    OTPBatchItem* swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != items) {
+    memcpy(items, from, count * sizeof(OTPBatchItem));
+  }
+}
+
+// Branch-free binary searches in lockstep: they all take the same number of rounds, so each round can
+// prefetch every search's next probe and the misses overlap.
+static void lookup_group(const OTPTokenSet* set, OTPBatchItem* items, size_t count) {
+  const OTPToken* base[OTP_BATCH_GROUP];
+  for (size_t j = 0; j < count; ++j) {
+    base[j] = set->tokens;
+  }
+  size_t length = set->count;
+  while (length > 1) {
+    size_t half = length / 2;
+    for (size_t j = 0; j < count; ++j) {
+      base[j] = base[j][half].id < items[j].id ? base[j] + half : base[j];
+    }
+    length -= half;
+    for (size_t j = 0; j < count; ++j) {
+      __builtin_prefetch(&base[j][length / 2]);
+    }
+  }
+  const OTPToken* end = set->tokens + set->count;
+  for (size_t j = 0; j < count; ++j) {
+    const OTPToken* token = base[j] + (base[j]->id < items[j].id);
+    items[j].token = token < end && token->id == items[j].id ? token : NULL;
+  }
+}
+
+void otp_batch_lookup(const OTPTokenSet* set, OTPBatchItem* items, size_t count) {
+  if (!set->count) {
+    for (size_t i = 0; i < count; ++i) {
+      items[i].token = NULL;
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; i += OTP_BATCH_GROUP) {
+    lookup_group(set, &items[i], count - i < OTP_BATCH_GROUP ? count - i : OTP_BATCH_GROUP);
+  }
+}
@@ -0,0 +1,52 @@
+// Looking up a batch of verifications' tokens together, so the cache misses of a large store overlap
+// instead of each one stalling the hashing in turn.
+//
+// A batch is sorted by ID first, which puts repeats together and walks the store in the order it's
+// laid out in. The lookups then run as interleaved binary searches, OTP_BATCH_GROUP at a time: every
+// round prefetches each search's next probe before any of them reads its current one. While the
+// caller hashes one item, it prefetches the token of the item OTP_BATCH_AHEAD further on.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTP_BATCH_H__
+#define OTP_BATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_token.h"
+#include "token_set.h"
+
+#define OTP_BATCH_GROUP 16 // Searches in flight at once
+#define OTP_BATCH_AHEAD 4 // Items between the one being hashed and the one being prefetched
+
+typedef struct OTPBatchItem {
+  uint32_t id;
+  uint32_t index; // The caller's - where the request came in the batch, say
+  const OTPToken* token; // From otp_batch_lookup(); NULL for an ID the set doesn't have
+} OTPBatchItem;
+
+// Sorts items by ID, keeping the order of items with the same one. scratch needs room for count items.
+void otp_batch_sort(OTPBatchItem* items, size_t count, OTPBatchItem* scratch);
+
+// Finds every item's token in a finished set.
+void otp_batch_lookup(const OTPTokenSet* set, OTPBatchItem* items, size_t count);
+
+// Starts loading the token of items[i], if there is one - the whole record, which can straddle two lines.
+static inline void otp_batch_prefetch(const OTPBatchItem* items, size_t count, size_t i) {
+  if (i < count && items[i].token) {
+    __builtin_prefetch(items[i].token);
+    __builtin_prefetch((const char*)items[i].token + sizeof(OTPToken) - 1);
+  }
+}
+
+#endif
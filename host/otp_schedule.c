@@ -0,0 +1,232 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "code_format.h"
+#include "otp_schedule.h"
+
+#define SCHEDULE_CHUNK 4096 // Steps of one token hashed as a unit of work - 16 KiB of codes
+
+typedef struct ScheduleJob {
+  const OTPToken* tokens;
+  size_t count;
+  const OTPScheduleEntry* entries;
+  uint32_t* codes;
+  const uint64_t* chunk_start; // First chunk of each token, and the total at [count]
+  _Atomic uint64_t next_chunk;
+} ScheduleJob;
+
+static size_t schedule_length(size_t count, uint64_t codes) {
+  return sizeof(OTPScheduleHeader) + count * sizeof(OTPScheduleEntry) + codes * sizeof(uint32_t);
+}
+
+// Takes chunks until there are none left; a chunk never spans tokens, so each is one midstate and one
+// run of consecutive counters written straight into the map.
+static void* schedule_worker(void* context) {
+  ScheduleJob* job = context;
+  uint64_t total = job->chunk_start[job->count];
+  for (;;) {
+    uint64_t chunk = atomic_fetch_add_explicit(&job->next_chunk, 1, memory_order_relaxed);
+    if (chunk >= total) break;
+    size_t low = 0, high = job->count;
+    while (high - low > 1) {
+      size_t mid = (low + high) / 2;
+      if (job->chunk_start[mid] <= chunk) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    const OTPToken* token = &job->tokens[low];
+    const OTPScheduleEntry* entry = &job->entries[low];
+    uint64_t offset = (chunk - job->chunk_start[low]) * SCHEDULE_CHUNK;
+    size_t steps = entry->step_count - offset < SCHEDULE_CHUNK ? entry->step_count - offset : SCHEDULE_CHUNK;
+    uint32_t* out = &job->codes[entry->first_code + offset];
+    uint64_t step = entry->first_step + offset;
+    for (size_t i = 0; i < steps; ++i) {
+      out[i] = otp_token_hash(token, step + i);
+    }
+    code_truncate_batch(out, steps, token->digits, out);
+  }
+  return NULL;
+}
+
+bool otp_schedule_write(const char* path, const OTPToken* tokens, size_t count, uint64_t from, uint64_t to, int threads) {
+  if (to < from) {
+    errno = EINVAL;
+    return false;
+  }
+  uint64_t* chunk_start = malloc((count + 1) * sizeof(uint64_t));
+  OTPScheduleEntry* entries = calloc(count ? count : 1, sizeof(OTPScheduleEntry));
+  if (!chunk_start || !entries) {
+    free(chunk_start);
+    free(entries);
+    errno = ENOMEM;
+    return false;
+  }
+  uint64_t code_count = 0;
+  chunk_start[0] = 0;
+  for (size_t t = 0; t < count; ++t) {
+    OTPScheduleEntry* entry = &entries[t];
+    entry->id = tokens[t].id;
+    entry->period = tokens[t].period;
+    entry->digits = tokens[t].digits;
+    entry->first_step = otp_token_step(&tokens[t], from);
+    entry->step_count = otp_token_step(&tokens[t], to) - entry->first_step + 1;
+    entry->first_code = code_count;
+    code_count += entry->step_count;
+    chunk_start[t + 1] = chunk_start[t] + (entry->step_count + SCHEDULE_CHUNK - 1) / SCHEDULE_CHUNK;
+  }
+
+  size_t length = schedule_length(count, code_count);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    free(chunk_start);
+    free(entries);
+    return false;
+  }
+  // Reserving the blocks up front turns a full disk into an error here rather than a SIGBUS mid-write.
+  int error = posix_fallocate(fd, 0, length);
+  void* map = error ? MAP_FAILED : mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    if (!error) {
+      error = errno;
+    }
+    close(fd);
+    unlink(path);
+    free(chunk_start);
+    free(entries);
+    errno = error;
+    return false;
+  }
+
+  OTPScheduleHeader* header = map;
+  header->version = OTP_SCHEDULE_VERSION;
+  header->entry_size = sizeof(OTPScheduleEntry);
+  header->token_count = count;
+  header->code_count = code_count;
+  header->from = from;
+  header->to = to;
+  memcpy((char*)map + sizeof(OTPScheduleHeader), entries, count * sizeof(OTPScheduleEntry));
+
+  ScheduleJob job = {
+    .tokens = tokens,
+    .count = count,
+    .entries = entries,
+    .codes = (uint32_t*)((char*)map + sizeof(OTPScheduleHeader) + count * sizeof(OTPScheduleEntry)),
+    .chunk_start = chunk_start
+  };
+  atomic_init(&job.next_chunk, 0);
+  if (threads < 1) {
+    threads = 1;
+  }
+  pthread_t* workers = calloc(threads, sizeof(pthread_t));
+  int started = 0;
+  while (workers && started < threads - 1 && !pthread_create(&workers[started], NULL, schedule_worker, &job)) {
+    started++;
+  }
+  schedule_worker(&job);
+  for (int i = 0; i < started; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+  free(chunk_start);
+  free(entries);
+
+  bool ok = !msync(map, length, MS_SYNC);
+  if (ok) {
+    memcpy(header->magic, OTP_SCHEDULE_MAGIC, sizeof(header->magic));
+    ok = !msync(map, sizeof(OTPScheduleHeader), MS_SYNC);
+  }
+  error = errno;
+  munmap(map, length);
+  close(fd);
+  if (!ok) {
+    unlink(path);
+    errno = error;
+  }
+  return ok;
+}
+
+bool otp_schedule_open(OTPSchedule* schedule, const char* path) {
+  memset(schedule, 0, sizeof(OTPSchedule));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+  if ((size_t)st.st_size < sizeof(OTPScheduleHeader)) {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const OTPScheduleHeader* header = map;
+  if (memcmp(header->magic, OTP_SCHEDULE_MAGIC, sizeof(header->magic)) || header->version != OTP_SCHEDULE_VERSION ||
+      header->entry_size != sizeof(OTPScheduleEntry) ||
+      header->token_count > ((size_t)st.st_size - sizeof(OTPScheduleHeader)) / sizeof(OTPScheduleEntry) ||
+      header->code_count > (size_t)st.st_size / sizeof(uint32_t) ||
+      schedule_length(header->token_count, header->code_count) != (size_t)st.st_size) {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return false;
+  }
+  schedule->map = map;
+  schedule->map_length = st.st_size;
+  schedule->header = header;
+  schedule->entries = (const OTPScheduleEntry*)((const char*)map + sizeof(OTPScheduleHeader));
+  schedule->codes = (const uint32_t*)(schedule->entries + header->token_count);
+  for (size_t t = 0; t < header->token_count; ++t) {
+    const OTPScheduleEntry* entry = &schedule->entries[t];
+    if (!entry->period || entry->first_code > header->code_count || entry->step_count > header->code_count - entry->first_code) {
+      otp_schedule_close(schedule);
+      errno = EINVAL;
+      return false;
+    }
+  }
+  return true;
+}
+
+void otp_schedule_close(OTPSchedule* schedule) {
+  if (schedule->map) {
+    munmap(schedule->map, schedule->map_length);
+  }
+  memset(schedule, 0, sizeof(OTPSchedule));
+}
+
+const OTPScheduleEntry* otp_schedule_find(const OTPSchedule* schedule, uint32_t id) {
+  size_t low = 0, high = schedule->header->token_count;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    uint32_t mid_id = schedule->entries[mid].id;
+    if (mid_id == id) return &schedule->entries[mid];
+    if (mid_id < id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,79 @@
+// Pre-generated code schedules: every code of a set of tokens over a span of time, in one mappable file.
+//
+// The file is a header, a directory with one entry per token (in ID order), and then every token's truncated
+// codes as 32-bit integers, one per step, so finding the code for a time is one lookup and one index.
+// Nothing in it needs parsing or fixing up before use.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTP_SCHEDULE_H__
+#define OTP_SCHEDULE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_token.h"
+
+#define OTP_SCHEDULE_MAGIC "pTOTPsch"
+#define OTP_SCHEDULE_VERSION 1
+
+typedef struct OTPScheduleHeader {
+  char magic[8]; // Written last, so a file cut short never opens
+  uint32_t version;
+  uint32_t entry_size; // sizeof(OTPScheduleEntry) when written
+  uint64_t token_count;
+  uint64_t code_count;
+  uint64_t from; // The Unix times asked for - each token covers the steps they fall in
+  uint64_t to;
+  uint8_t reserved[16];
+} OTPScheduleHeader;
+
+typedef struct OTPScheduleEntry {
+  uint32_t id;
+  uint16_t period;
+  uint8_t digits;
+  uint8_t reserved;
+  uint64_t first_step;
+  uint64_t step_count;
+  uint64_t first_code; // Index of first_step's code
+} OTPScheduleEntry;
+
+_Static_assert(sizeof(OTPScheduleHeader) == 64, "schedule header layout changed");
+_Static_assert(sizeof(OTPScheduleEntry) == 32, "schedule entry layout changed");
+
+typedef struct OTPSchedule {
+  void* map;
+  size_t map_length;
+  const OTPScheduleHeader* header;
+  const OTPScheduleEntry* entries;
+  const uint32_t* codes;
+} OTPSchedule;
+
+// Writes the schedule of every token for the steps from `from` to `to` to a new file at path, hashing on
+// `threads` threads. Tokens must be sorted by ID, as a finished token set is.
+bool otp_schedule_write(const char* path, const OTPToken* tokens, size_t count, uint64_t from, uint64_t to, int threads);
+
+bool otp_schedule_open(OTPSchedule* schedule, const char* path);
+void otp_schedule_close(OTPSchedule* schedule);
+
+const OTPScheduleEntry* otp_schedule_find(const OTPSchedule* schedule, uint32_t id);
+
+// The code for the step unix_time falls in, or false if the schedule doesn't reach it.
+static inline bool otp_schedule_code(const OTPSchedule* schedule, const OTPScheduleEntry* entry, uint64_t unix_time, uint32_t* code) {
+  uint64_t step = unix_time / entry->period;
+  if (step < entry->first_step || step - entry->first_step >= entry->step_count) return false;
+  *code = schedule->codes[entry->first_code + step - entry->first_step];
+  return true;
+}
+
+#endif
@@ -0,0 +1,130 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <strings.h>
+#include "base32.h"
+#include "code_format.h"
+#include "otp_token.h"
+
+bool otp_token_init(OTPToken* token, uint32_t id, const uint8_t* key, size_t key_length, int digits, OTPAlgorithm algorithm, int period) {
+  if (digits < 0 || digits > CODE_MAX_DIGITS || period < 0 || period > UINT16_MAX || key_length > INT32_MAX) return false;
+  memset(token, 0, sizeof(OTPToken));
+  token->id = id;
+  token->digits = digits ? digits : OTP_DEFAULT_DIGITS;
+  token->period = period ? period : OTP_DEFAULT_PERIOD;
+  token->algorithm = generateAlgorithm(algorithm, key_length);
+  generateMidstateWith(token->algorithm, key, key_length, token->midstate);
+  return true;
+}
+
+uint32_t otp_token_code(const OTPToken* token, uint64_t step) {
+  return code_truncate(otp_token_hash(token, step), token->digits);
+}
+
+bool otp_next_field(const char** cursor, const char* end, const char** field, size_t* length) {
+  const char* p = *cursor;
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p == end) return false;
+  *field = p;
+  while (p < end && *p != ' ' && *p != '\t') p++;
+  *length = p - *field;
+  *cursor = p;
+  return true;
+}
+
+bool otp_parse_uint(const char* field, size_t length, uint64_t max, uint64_t* value) {
+  if (!length || length > 20) return false;
+  uint64_t result = 0;
+  for (size_t i = 0; i < length; ++i) {
+    unsigned digit = (unsigned char)field[i] - '0';
+    if (digit > 9 || result > (max - digit) / 10) return false;
+    result = result * 10 + digit;
+  }
+  *value = result;
+  return true;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+static ssize_t hex_decode(const char* in, size_t length, uint8_t* out) {
+  if (length & 1) return -1;
+  for (size_t i = 0; i < length; i += 2) {
+    int high = hex_value(in[i]);
+    int low = hex_value(in[i + 1]);
+    if (high < 0 || low < 0) return -1;
+    out[i / 2] = high << 4 | low;
+  }
+  return length / 2;
+}
+
+static bool parse_algorithm(const char* field, size_t length, OTPAlgorithm* algorithm) {
+  if (length == 4 && !strncasecmp(field, "auto", 4)) {
+    *algorithm = OTPAlgorithmAuto;
+  } else if (length == 4 && !strncasecmp(field, "sha1", 4)) {
+    *algorithm = OTPAlgorithmSHA1;
+  } else if (length == 6 && !strncasecmp(field, "sha256", 6)) {
+    *algorithm = OTPAlgorithmSHA256;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+OTPTokenParseResult otp_token_parse(const char* line, size_t length, OTPToken* token) {
+  const char* cursor = line;
+  const char* end = line + length;
+  const char* field;
+  size_t field_length;
+  uint64_t value;
+
+  if (!otp_next_field(&cursor, end, &field, &field_length) || field[0] == '#') return OTPTokenBlank;
+  if (!otp_parse_uint(field, field_length, UINT32_MAX, &value)) return OTPTokenInvalid;
+  uint32_t id = value;
+
+  if (!otp_next_field(&cursor, end, &field, &field_length)) return OTPTokenInvalid;
+  uint8_t key[OTP_MAX_KEY_LENGTH];
+  ssize_t key_length;
+  if (field_length > 4 && !strncasecmp(field, "hex:", 4)) {
+    if ((field_length - 4) / 2 > sizeof(key)) return OTPTokenInvalid;
+    key_length = hex_decode(field + 4, field_length - 4, key);
+  } else {
+    if (BASE32_DECODED_LENGTH(field_length) > sizeof(key)) return OTPTokenInvalid;
+    key_length = base32_decode(field, field_length, key);
+  }
+  if (key_length <= 0) return OTPTokenInvalid;
+
+  int digits = 0;
+  int period = 0;
+  OTPAlgorithm algorithm = OTPAlgorithmAuto;
+  if (otp_next_field(&cursor, end, &field, &field_length)) {
+    if (!otp_parse_uint(field, field_length, CODE_MAX_DIGITS, &value) || !value) return OTPTokenInvalid;
+    digits = value;
+    if (otp_next_field(&cursor, end, &field, &field_length)) {
+      if (!parse_algorithm(field, field_length, &algorithm)) return OTPTokenInvalid;
+      if (otp_next_field(&cursor, end, &field, &field_length)) {
+        if (!otp_parse_uint(field, field_length, UINT16_MAX, &value) || !value) return OTPTokenInvalid;
+        period = value;
+      }
+    }
+  }
+  if (otp_next_field(&cursor, end, &field, &field_length)) return OTPTokenInvalid;
+
+  bool ok = otp_token_init(token, id, key, key_length, digits, algorithm, period);
+  memset(key, 0, sizeof(key));
+  return ok ? OTPTokenParsed : OTPTokenInvalid;
+}
@@ -0,0 +1,70 @@
+// Host-side tokens: the key is only ever kept as its HMAC midstate.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTP_TOKEN_H__
+#define OTP_TOKEN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "generate.h"
+#include "hmac.h"
+
+#define OTP_DEFAULT_DIGITS 6
+#define OTP_DEFAULT_PERIOD 30
+#define OTP_MAX_KEY_LENGTH 256 // Bytes of decoded key accepted from text
+
+typedef struct OTPToken {
+  uint32_t id;
+  uint16_t period; // Seconds per step
+  uint8_t digits;
+  uint8_t algorithm; // OTPAlgorithmSHA1 or OTPAlgorithmSHA256, never Auto
+  uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH]; // Only the first HMAC_SHA1_MIDSTATE_LENGTH bytes for SHA1
+} OTPToken;
+
+typedef enum OTPTokenParseResult {
+  OTPTokenParsed,
+  OTPTokenBlank, // Empty, or a '#' comment
+  OTPTokenInvalid
+} OTPTokenParseResult;
+
+// Fills in token from a key. digits and period of 0 take the defaults; OTPAlgorithmAuto picks as generateCode() does.
+bool otp_token_init(OTPToken* token, uint32_t id, const uint8_t* key, size_t key_length, int digits, OTPAlgorithm algorithm, int period);
+
+// Parses "id secret [digits [algorithm [period]]]", whitespace separated. The secret is base32 unless prefixed
+// with "hex:"; algorithm is sha1, sha256 or auto.
+OTPTokenParseResult otp_token_parse(const char* line, size_t length, OTPToken* token);
+
+static inline uint8_t otp_token_midstate_length(const OTPToken* token) {
+  return token->algorithm == OTPAlgorithmSHA256 ? HMAC_SHA256_MIDSTATE_LENGTH : HMAC_SHA1_MIDSTATE_LENGTH;
+}
+
+static inline uint64_t otp_token_step(const OTPToken* token, uint64_t unix_time) {
+  return unix_time / token->period;
+}
+
+// The 31-bit truncated hash for a step, as generateCode() returns.
+static inline uint32_t otp_token_hash(const OTPToken* token, uint64_t step) {
+  return generateCodeFromMidstate(token->midstate, otp_token_midstate_length(token), step);
+}
+
+uint32_t otp_token_code(const OTPToken* token, uint64_t step);
+
+// Splits the next whitespace-separated field off [*cursor, end). Returns false once there are none left.
+bool otp_next_field(const char** cursor, const char* end, const char** field, size_t* length);
+
+// Parses a whole field as an unsigned decimal no greater than max.
+bool otp_parse_uint(const char* field, size_t length, uint64_t max, uint64_t* value);
+
+#endif
@@ -0,0 +1,69 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "code_format.h"
+#include "otp_verify.h"
+
+bool otp_verify_tracked(const OTPToken* token, uint32_t code, uint64_t step, int window, CodeCache* cache, uint64_t epoch,
+                        DriftTable* drift, int* matched_offset) {
+  if (window > OTP_MAX_WINDOW) {
+    window = OTP_MAX_WINDOW;
+  }
+  int offsets[OTP_MAX_WINDOW * 2 + 1];
+  int count;
+  if (drift) {
+    count = drift_table_plan(drift, token->id, window, offsets);
+  } else {
+    count = 0;
+    for (int i = 0; i <= window * 2; ++i) {
+      offsets[count++] = (i & 1) ? -(i + 1) / 2 : i / 2;
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    int offset = offsets[i];
+    if (offset < 0 && (uint64_t)-offset > step) continue;
+    uint32_t hash;
+    if (!cache || !code_cache_lookup(cache, epoch, token->id, step + offset, &hash)) {
+      hash = otp_token_hash(token, step + offset);
+      if (cache) {
+        code_cache_store(cache, epoch, token->id, step + offset, hash);
+      }
+    }
+    if (code_truncate(hash, token->digits) == code) {
+      if (drift) {
+        drift_table_record(drift, token->id, offset);
+      }
+      if (matched_offset) {
+        *matched_offset = offset;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool otp_verify_cached(const OTPToken* token, uint32_t code, uint64_t step, int window, CodeCache* cache, uint64_t epoch,
+                       int* matched_offset) {
+  return otp_verify_tracked(token, code, step, window, cache, epoch, NULL, matched_offset);
+}
+
+bool otp_verify(const OTPToken* token, uint32_t code, uint64_t step, int window, int* matched_offset) {
+  return otp_verify_cached(token, code, step, window, NULL, 0, matched_offset);
+}
+
+bool otp_parse_code(const OTPToken* token, const char* field, size_t length, uint32_t* code) {
+  if (length != token->digits) return false;
+  uint64_t value;
+  if (!otp_parse_uint(field, length, UINT32_MAX, &value)) return false;
+  *code = value;
+  return true;
+}
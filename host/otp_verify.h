@@ -0,0 +1,43 @@
+// Checking a submitted code against the steps around the current one.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTP_VERIFY_H__
+#define OTP_VERIFY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "code_cache.h"
+#include "drift_table.h"
+#include "otp_token.h"
+
+#define OTP_DEFAULT_WINDOW 1 // Steps either side of now that are still accepted
+#define OTP_MAX_WINDOW 16
+
+// Tries step, then step - 1, step + 1, step - 2, ... out to window steps either side.
+// Returns whether code matched one, with the step's offset from the given one in matched_offset.
+bool otp_verify(const OTPToken* token, uint32_t code, uint64_t step, int window, int* matched_offset);
+
+// As otp_verify(), but takes each step's hash from cache if it's there for this epoch, and adds it if not.
+bool otp_verify_cached(const OTPToken* token, uint32_t code, uint64_t step, int window, CodeCache* cache, uint64_t epoch,
+                       int* matched_offset);
+
+// As otp_verify_cached(), but trying the steps in the order drift suggests for this token, and recording the
+// offset of a match there. It accepts exactly the codes otp_verify() does. A NULL drift tries them as above.
+bool otp_verify_tracked(const OTPToken* token, uint32_t code, uint64_t step, int window, CodeCache* cache, uint64_t epoch,
+                        DriftTable* drift, int* matched_offset);
+
+// Parses a code typed for token: all digits, and exactly as many as the token has.
+bool otp_parse_code(const OTPToken* token, const char* field, size_t length, uint32_t* code);
+
+#endif
@@ -0,0 +1,127 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <strings.h>
+#include "code_format.h"
+#include "otp_token.h"
+#include "otpauth.h"
+
+#define OTPAUTH_PREFIX "otpauth://"
+
+static bool slice_is(OTPAuthSlice slice, const char* text) {
+  size_t length = strlen(text);
+  return slice.length == length && !strncasecmp(slice.data, text, length);
+}
+
+static bool slice_uint(OTPAuthSlice slice, uint64_t max, uint64_t* value) {
+  return otp_parse_uint(slice.data, slice.length, max, value);
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+ssize_t otpauth_unescape(OTPAuthSlice slice, char* out) {
+  size_t written = 0;
+  for (size_t i = 0; i < slice.length; ++i) {
+    if (slice.data[i] != '%') {
+      out[written++] = slice.data[i];
+      continue;
+    }
+    if (i + 2 >= slice.length) return -1;
+    int high = hex_digit(slice.data[i + 1]);
+    int low = hex_digit(slice.data[i + 2]);
+    if (high < 0 || low < 0) return -1;
+    out[written++] = high << 4 | low;
+    i += 2;
+  }
+  return written;
+}
+
+OTPAuthResult otpauth_parse(const char* uri, size_t length, OTPAuthURI* parsed) {
+  memset(parsed, 0, sizeof(OTPAuthURI));
+  parsed->algorithm = OTPAlgorithmSHA1;
+  parsed->digits = OTP_DEFAULT_DIGITS;
+  parsed->period = OTP_DEFAULT_PERIOD;
+
+  size_t prefix = strlen(OTPAUTH_PREFIX);
+  if (length < prefix + 5 || strncasecmp(uri, OTPAUTH_PREFIX, prefix) || uri[prefix + 4] != '/') return OTPAuthNotURI;
+  OTPAuthSlice type = {uri + prefix, 4};
+  if (slice_is(type, "hotp")) {
+    parsed->hotp = true;
+  } else if (!slice_is(type, "totp")) {
+    return OTPAuthNotURI;
+  }
+
+  const char* p = uri + prefix + 5;
+  const char* end = uri + length;
+  const char* query = memchr(p, '?', end - p);
+  parsed->label = (OTPAuthSlice){p, (query ? query : end) - p};
+
+  bool has_counter = false;
+  for (p = query ? query + 1 : end; p < end; ) {
+    const char* amp = memchr(p, '&', end - p);
+    const char* param_end = amp ? amp : end;
+    const char* eq = memchr(p, '=', param_end - p);
+    OTPAuthSlice key = {p, (eq ? eq : param_end) - p};
+    OTPAuthSlice value = {eq ? eq + 1 : param_end, eq ? param_end - eq - 1 : 0};
+    p = amp ? amp + 1 : end;
+
+    uint64_t number;
+    if (slice_is(key, "secret")) {
+      parsed->secret = value;
+    } else if (slice_is(key, "issuer")) {
+      parsed->issuer = value;
+    } else if (slice_is(key, "algorithm")) {
+      if (slice_is(value, "SHA1")) {
+        parsed->algorithm = OTPAlgorithmSHA1;
+      } else if (slice_is(value, "SHA256")) {
+        parsed->algorithm = OTPAlgorithmSHA256;
+      } else if (slice_is(value, "SHA512")) {
+        return OTPAuthUnsupportedAlgorithm;
+      } else {
+        return OTPAuthInvalidParameter;
+      }
+    } else if (slice_is(key, "digits")) {
+      if (!slice_uint(value, CODE_MAX_DIGITS, &number) || !number) return OTPAuthInvalidParameter;
+      parsed->digits = number;
+    } else if (slice_is(key, "period")) {
+      if (!slice_uint(value, UINT16_MAX, &number) || !number) return OTPAuthInvalidParameter;
+      parsed->period = number;
+    } else if (slice_is(key, "counter")) {
+      if (!slice_uint(value, UINT64_MAX, &number)) return OTPAuthInvalidParameter;
+      parsed->counter = number;
+      has_counter = true;
+    }
+    // Anything else (image, color, ...) is for display only.
+  }
+
+  if (!parsed->secret.length) return OTPAuthMissingSecret;
+  if (parsed->hotp && !has_counter) return OTPAuthMissingCounter;
+  return OTPAuthParsed;
+}
+
+const char* otpauth_result_string(OTPAuthResult result) {
+  switch (result) {
+    case OTPAuthParsed: return "parsed";
+    case OTPAuthNotURI: return "not an otpauth://totp/ or otpauth://hotp/ URI";
+    case OTPAuthMissingSecret: return "no secret";
+    case OTPAuthMissingCounter: return "HOTP without a counter";
+    case OTPAuthUnsupportedAlgorithm: return "unsupported algorithm";
+    case OTPAuthInvalidParameter: return "invalid parameter";
+  }
+  return "unknown";
+}
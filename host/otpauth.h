@@ -0,0 +1,57 @@
+// Parsing otpauth:// URIs, as in authenticator enrollment QR codes.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTPAUTH_H__
+#define OTPAUTH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "generate.h"
+
+// A span of the URI being parsed - nothing is copied out of it.
+typedef struct OTPAuthSlice {
+  const char* data;
+  size_t length;
+} OTPAuthSlice;
+
+typedef struct OTPAuthURI {
+  bool hotp;
+  OTPAuthSlice label; // Still percent-encoded
+  OTPAuthSlice secret; // Still percent-encoded
+  OTPAuthSlice issuer; // Still percent-encoded; empty if absent
+  OTPAlgorithm algorithm; // SHA1 unless given - otpauth doesn't pick by key length
+  int digits;
+  int period;
+  uint64_t counter;
+} OTPAuthURI;
+
+typedef enum OTPAuthResult {
+  OTPAuthParsed,
+  OTPAuthNotURI, // Doesn't start with otpauth://totp/ or otpauth://hotp/
+  OTPAuthMissingSecret,
+  OTPAuthMissingCounter, // HOTP without a counter
+  OTPAuthUnsupportedAlgorithm, // SHA512, which the watch can't do either
+  OTPAuthInvalidParameter
+} OTPAuthResult;
+
+OTPAuthResult otpauth_parse(const char* uri, size_t length, OTPAuthURI* parsed);
+
+const char* otpauth_result_string(OTPAuthResult result);
+
+// Percent-decodes a slice into out, which needs slice.length bytes. Returns the decoded length, or -1 if malformed.
+ssize_t otpauth_unescape(OTPAuthSlice slice, char* out);
+
+#endif
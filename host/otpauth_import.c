@@ -0,0 +1,217 @@
+// otpauth_import: turns otpauth:// URIs, one per line, into a binary token file in a single pass.
+//
+//   otpauth_import [-o tokens.bin] [-m labels.txt] [-i first id] [uris...]
+//
+// Tokens are numbered from the first ID in input order. The optional label file maps each ID back to
+// its issuer and account, as "id<TAB>issuer<TAB>label" with both still percent-encoded.
+// Files are mapped and parsed in place; standard input is read in chunks.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "base32.h"
+#include "buffered_writer.h"
+#include "line_reader.h"
+#include "otpauth.h"
+#include "token_file.h"
+
+#define MAX_SECRET_CHARACTERS 1024
+#define LABEL_LINE_MAX 32 // The ID and separators around the issuer and label
+
+typedef struct Importer {
+  BufferedWriter tokens;
+  BufferedWriter labels;
+  bool write_labels;
+  uint64_t next_id;
+  unsigned long imported;
+  unsigned long rejected;
+} Importer;
+
+static bool import_uri(Importer* importer, const char* line, size_t length, const char* name, unsigned long line_number) {
+  while (length && (*line == ' ' || *line == '\t')) {
+    line++;
+    length--;
+  }
+  while (length && (line[length - 1] == ' ' || line[length - 1] == '\t' || line[length - 1] == '\r')) {
+    length--;
+  }
+  if (!length || line[0] == '#') return true;
+
+  OTPAuthURI uri;
+  OTPAuthResult result = otpauth_parse(line, length, &uri);
+  const char* problem = result == OTPAuthParsed ? NULL : otpauth_result_string(result);
+
+  char secret[MAX_SECRET_CHARACTERS];
+  uint8_t key[BASE32_DECODED_LENGTH(MAX_SECRET_CHARACTERS)];
+  ssize_t key_length = -1;
+  if (!problem) {
+    ssize_t secret_length = uri.secret.length <= sizeof(secret) ? otpauth_unescape(uri.secret, secret) : -1;
+    key_length = secret_length > 0 ? base32_decode(secret, secret_length, key) : -1;
+    if (key_length <= 0) {
+      problem = "secret isn't base32";
+    } else if (importer->next_id > UINT32_MAX) {
+      problem = "out of token IDs";
+    }
+  }
+
+  TokenFileRecord record;
+  memset(&record, 0, sizeof(record));
+  if (!problem && !otp_token_init(&record.token, importer->next_id, key, key_length, uri.digits, uri.algorithm, uri.period)) {
+    problem = "invalid parameter";
+  }
+  memset(key, 0, sizeof(key));
+  memset(secret, 0, sizeof(secret));
+  if (problem) {
+    fprintf(stderr, "%s:%lu: %s\n", name, line_number, problem);
+    importer->rejected++;
+    return false;
+  }
+
+  record.type = uri.hotp ? TokenFileHOTP : TokenFileTOTP;
+  record.counter = uri.counter;
+  buffered_writer_append(&importer->tokens, &record, sizeof(record));
+  memset(&record, 0, sizeof(record));
+
+  if (importer->write_labels) {
+    char* p = buffered_writer_reserve(&importer->labels, LABEL_LINE_MAX);
+    p += sprintf(p, "%lu\t", (unsigned long)importer->next_id);
+    buffered_writer_commit(&importer->labels, p);
+    buffered_writer_append(&importer->labels, uri.issuer.data, uri.issuer.length);
+    buffered_writer_append(&importer->labels, "\t", 1);
+    buffered_writer_append(&importer->labels, uri.label.data, uri.label.length);
+    buffered_writer_append(&importer->labels, "\n", 1);
+  }
+  importer->next_id++;
+  importer->imported++;
+  return true;
+}
+
+// Parses a whole mapped file in place. Returns false if it couldn't be mapped, so the caller can read it instead.
+static bool import_mapped(Importer* importer, int fd, const char* name, bool* ok) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+  if (!st.st_size) return true;
+  char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) return false;
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  unsigned long line_number = 0;
+  for (const char* p = map; p < map + st.st_size; ) {
+    const char* newline = memchr(p, '\n', map + st.st_size - p);
+    const char* end = newline ? newline : map + st.st_size;
+    *ok &= import_uri(importer, p, end - p, name, ++line_number);
+    p = end + 1;
+  }
+  munmap(map, st.st_size);
+  return true;
+}
+
+static void import_stream(Importer* importer, int fd, const char* name, bool* ok) {
+  LineReader reader;
+  if (!line_reader_open(&reader, fd, 0)) {
+    *ok = false;
+    return;
+  }
+  const char* line;
+  size_t length;
+  while (line_reader_next(&reader, &line, &length)) {
+    *ok &= import_uri(importer, line, length, name, reader.line_number);
+  }
+  if (reader.failed) {
+    fprintf(stderr, "%s: read failed\n", name);
+    *ok = false;
+  }
+  line_reader_close(&reader);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: otpauth_import [-o tokens.bin] [-m labels.txt] [-i first id] [uris...]\n");
+  exit(2);
+}
+
+static int open_output(const char* path) {
+  if (!path || !strcmp(path, "-")) return STDOUT_FILENO;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "otpauth_import: %s: %s\n", path, strerror(errno));
+    exit(2);
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  const char* output_path = NULL;
+  const char* label_path = NULL;
+  uint64_t first_id = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:m:i:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'm':
+        label_path = optarg;
+        break;
+      case 'i':
+        if (!otp_parse_uint(optarg, strlen(optarg), UINT32_MAX, &first_id)) usage();
+        break;
+      default:
+        usage();
+    }
+  }
+  if ((!output_path || !strcmp(output_path, "-")) && isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "otpauth_import: not writing a binary token file to a terminal - use -o\n");
+    return 2;
+  }
+
+  Importer importer = {.next_id = first_id, .write_labels = label_path != NULL};
+  if (!buffered_writer_open(&importer.tokens, open_output(output_path), 0) ||
+      (label_path && !buffered_writer_open(&importer.labels, open_output(label_path), 0))) {
+    fprintf(stderr, "otpauth_import: out of memory\n");
+    return 2;
+  }
+  TokenFileHeader header;
+  token_file_header(&header);
+  buffered_writer_append(&importer.tokens, &header, sizeof(header));
+
+  bool ok = true;
+  for (int i = optind; i == optind || i < argc; ++i) {
+    const char* path = i < argc ? argv[i] : NULL;
+    const char* name = path && strcmp(path, "-") ? path : "<stdin>";
+    int fd = path && strcmp(path, "-") ? open(path, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+      fprintf(stderr, "otpauth_import: %s: %s\n", path, strerror(errno));
+      ok = false;
+      continue;
+    }
+    if (!import_mapped(&importer, fd, name, &ok)) {
+      import_stream(&importer, fd, name, &ok);
+    }
+    if (fd != STDIN_FILENO) close(fd);
+  }
+
+  int status = ok ? 0 : 1;
+  if (!buffered_writer_close(&importer.tokens) || (label_path && !buffered_writer_close(&importer.labels))) {
+    fprintf(stderr, "otpauth_import: write failed\n");
+    status = 2;
+  }
+  fprintf(stderr, "imported %lu tokens, rejected %lu\n", importer.imported, importer.rejected);
+  return status;
+}
@@ -0,0 +1,482 @@
+// ptotp: generates or verifies codes for a stream of tokens, with the same core as the watch.
+//
+//   ptotp [-f tokens] [-t time | -r from:to]    prints "id code", or "id time code" for each step of a range
+//   ptotp -v -f tokens [-t time] [-w window]   reads "id code [time]" lines, prints "id ok offset", "id fail" or "id unknown"
+//   ptotp -v -S name ...                        as above, with the tokens from a shared-memory store (see shm_store_load)
+//   ptotp -v -C socket ...                      as above, asking a ptotpd listening on socket - which can also answer "id locked"
+//
+// -s prints the hashing counters to stderr at the end; with -C they're the daemon's, summed over all its clients.
+//
+// In verify mode a SIGHUP reloads the -f token file; verification carries on against the old tokens until the new ones are in.
+//
+// Token lines are "id secret [digits [algorithm [period]]]" - see otp_token_parse(). A binary token file
+// (see token_file.h) can be given with -f instead.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "buffered_writer.h"
+#include "code_format.h"
+#include "line_reader.h"
+#include "otp_stats.h"
+#include "otp_token.h"
+#include "otp_verify.h"
+#include "shm_store.h"
+#include "token_file.h"
+#include "token_set.h"
+#include "token_reloader.h"
+#include "token_store.h"
+#include "verify_protocol.h"
+
+#define GENERATE_BATCH 256 // Tokens parsed before any are hashed, and steps hashed before any are written
+#define OUTPUT_LINE_MAX 64 // id, time and code with their separators
+#define CLIENT_BATCH 1024 // Requests written to ptotpd before reading their responses
+
+static char* put_uint(char* p, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+static char* put_string(char* p, const char* s) {
+  size_t length = strlen(s);
+  memcpy(p, s, length);
+  return p + length;
+}
+
+typedef struct Options {
+  const char* token_path;
+  const char* store_name;
+  const char* socket_path;
+  bool verify;
+  bool stats;
+  uint64_t from;
+  uint64_t to;
+  bool range;
+  int window;
+} Options;
+
+static void usage(void) {
+  fprintf(stderr,
+    "usage: ptotp [-f tokens] [-t time | -r from:to] [-s]\n"
+    "       ptotp -v (-f tokens | -S name) [-t time] [-w window] [-s] [pairs...]\n"
+    "       ptotp -v -C socket [-t time] [-s] [pairs...]\n");
+  exit(2);
+}
+
+static bool parse_time(const char* text, uint64_t* value) {
+  return otp_parse_uint(text, strlen(text), UINT64_MAX, value);
+}
+
+static void write_codes(BufferedWriter* out, const OTPToken* tokens, size_t count, const Options* options) {
+  uint32_t codes[GENERATE_BATCH];
+  for (size_t t = 0; t < count; ++t) {
+    const OTPToken* token = &tokens[t];
+    uint64_t first = otp_token_step(token, options->from);
+    uint64_t last = otp_token_step(token, options->to);
+    for (uint64_t step = first; step <= last; ) {
+      size_t steps = last - step + 1 < GENERATE_BATCH ? last - step + 1 : GENERATE_BATCH;
+      for (size_t i = 0; i < steps; ++i) {
+        codes[i] = otp_token_hash(token, step + i);
+      }
+      code_truncate_batch(codes, steps, token->digits, codes);
+      for (size_t i = 0; i < steps; ++i) {
+        char* p = buffered_writer_reserve(out, OUTPUT_LINE_MAX);
+        p = put_uint(p, token->id);
+        *p++ = ' ';
+        if (options->range) {
+          p = put_uint(p, (step + i) * token->period);
+          *p++ = ' ';
+        }
+        code_format_batch(&codes[i], 1, token->digits, '\n', p, token->digits + 1);
+        buffered_writer_commit(out, p + token->digits + 1);
+      }
+      step += steps;
+    }
+  }
+}
+
+static int run_generate(LineReader* tokens, const char* name, BufferedWriter* out, const Options* options) {
+  static OTPToken batch[GENERATE_BATCH];
+  size_t count = 0;
+  int status = 0;
+  const char* line;
+  size_t length;
+  while (line_reader_next(tokens, &line, &length)) {
+    OTPTokenParseResult result = otp_token_parse(line, length, &batch[count]);
+    if (result == OTPTokenInvalid) {
+      fprintf(stderr, "%s:%lu: invalid token\n", name, tokens->line_number);
+      status = 1;
+    } else if (result == OTPTokenParsed && ++count == GENERATE_BATCH) {
+      write_codes(out, batch, count, options);
+      count = 0;
+    }
+  }
+  write_codes(out, batch, count, options);
+  memset(batch, 0, sizeof(batch));
+  if (tokens->failed) {
+    fprintf(stderr, "%s: read failed\n", name);
+    status = 2;
+  }
+  return status;
+}
+
+static void run_generate_records(const TokenFile* file, BufferedWriter* out, const Options* options) {
+  static OTPToken batch[GENERATE_BATCH];
+  size_t count = 0;
+  for (size_t i = 0; i < file->count; ++i) {
+    if (file->records[i].type != TokenFileTOTP) continue;
+    batch[count] = file->records[i].token;
+    if (++count == GENERATE_BATCH) {
+      write_codes(out, batch, count, options);
+      count = 0;
+    }
+  }
+  write_codes(out, batch, count, options);
+  memset(batch, 0, sizeof(batch));
+}
+
+// Where verify mode finds its tokens: the snapshots of the file loaded with -f, or the shared-memory store named with -S.
+typedef struct TokenSource {
+  TokenStore* tokens;
+  TokenStoreReader* reader;
+  ShmStore* store;
+} TokenSource;
+
+static bool source_lookup(TokenSource* source, uint32_t id, OTPToken* token) {
+  if (!source->store) {
+    const TokenSnapshot* snapshot = token_store_enter(source->tokens, source->reader);
+    const OTPToken* found = token_set_find(&snapshot->set, id);
+    if (found) {
+      *token = *found;
+    }
+    token_store_exit(source->reader);
+    return found != NULL;
+  }
+  if (shm_store_retired(source->store)) {
+    // The loader outgrew the segment and made a new one under the same name.
+    ShmStore fresh;
+    if (shm_store_open(&fresh, source->store->name)) {
+      shm_store_close(source->store);
+      *source->store = fresh;
+    }
+  }
+  return shm_store_lookup(source->store, id, token);
+}
+
+static char* put_result(char* p, uint32_t id, VerifyStatus status, int offset) {
+  p = put_uint(p, id);
+  if (status == VerifyUnknown) return put_string(p, " unknown\n");
+  if (status == VerifyLocked) return put_string(p, " locked\n");
+  if (status != VerifyOK) return put_string(p, " fail\n");
+  p = put_string(p, offset < 0 ? " ok -" : " ok ");
+  p = put_uint(p, offset < 0 ? -offset : offset);
+  *p++ = '\n';
+  return p;
+}
+
+static int run_verify(TokenSource* source, LineReader* pairs, const char* name, BufferedWriter* out, const Options* options) {
+  int status = 0;
+  const char* line;
+  size_t length;
+  while (line_reader_next(pairs, &line, &length)) {
+    const char* cursor = line;
+    const char* end = line + length;
+    const char* field;
+    size_t field_length;
+    uint64_t id, when = options->from;
+    if (!otp_next_field(&cursor, end, &field, &field_length) || field[0] == '#') continue;
+    if (!otp_parse_uint(field, field_length, UINT32_MAX, &id)) goto invalid;
+    const char* code_field;
+    size_t code_length;
+    if (!otp_next_field(&cursor, end, &code_field, &code_length)) goto invalid;
+    if (otp_next_field(&cursor, end, &field, &field_length) && !otp_parse_uint(field, field_length, UINT64_MAX, &when)) goto invalid;
+
+    OTPToken token;
+    uint32_t code;
+    int offset = 0;
+    VerifyStatus result = VerifyUnknown;
+    if (source_lookup(source, id, &token)) {
+      result = otp_parse_code(&token, code_field, code_length, &code) &&
+               otp_verify(&token, code, otp_token_step(&token, when), options->window, &offset) ? VerifyOK : VerifyFail;
+    }
+    buffered_writer_commit(out, put_result(buffered_writer_reserve(out, OUTPUT_LINE_MAX), id, result, offset));
+    memset(&token, 0, sizeof(token));
+    continue;
+
+invalid:
+    fprintf(stderr, "%s:%lu: invalid line\n", name, pairs->line_number);
+    status = 1;
+  }
+  if (pairs->failed) {
+    fprintf(stderr, "%s: read failed\n", name);
+    status = 2;
+  }
+  return status;
+}
+
+static int connect_daemon(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool transfer(int fd, void* buffer, size_t length, bool sending) {
+  uint8_t* p = buffer;
+  while (length) {
+    ssize_t done = sending ? send(fd, p, length, MSG_NOSIGNAL) : recv(fd, p, length, 0);
+    if (done <= 0) {
+      if (done < 0 && errno == EINTR) continue;
+      return false;
+    }
+    p += done;
+    length -= done;
+  }
+  return true;
+}
+
+// Sends CLIENT_BATCH requests at a time and prints the responses as run_verify() would. The daemon
+// only sees the code's value, so unlike there a code with too few digits isn't turned away up front.
+static int run_client(int fd, LineReader* pairs, const char* name, BufferedWriter* out, const Options* options) {
+  static VerifyRequest requests[CLIENT_BATCH];
+  static VerifyResponse responses[CLIENT_BATCH];
+  int status = 0;
+  size_t count = 0;
+  const char* line;
+  size_t length;
+  bool more = true;
+  while (more) {
+    more = line_reader_next(pairs, &line, &length);
+    if (more) {
+      const char* cursor = line;
+      const char* end = line + length;
+      const char* field;
+      size_t field_length;
+      uint64_t id, code, when = options->from;
+      if (!otp_next_field(&cursor, end, &field, &field_length) || field[0] == '#') continue;
+      if (!otp_parse_uint(field, field_length, UINT32_MAX, &id) ||
+          !otp_next_field(&cursor, end, &field, &field_length) || !otp_parse_uint(field, field_length, UINT32_MAX, &code) ||
+          (otp_next_field(&cursor, end, &field, &field_length) && !otp_parse_uint(field, field_length, UINT64_MAX, &when))) {
+        fprintf(stderr, "%s:%lu: invalid line\n", name, pairs->line_number);
+        status = 1;
+        continue;
+      }
+      requests[count++] = (VerifyRequest){.id = id, .code = code, .time = when};
+      if (count < CLIENT_BATCH) continue;
+    }
+    if (!count) break;
+    if (!transfer(fd, requests, count * sizeof(VerifyRequest), true) || !transfer(fd, responses, count * sizeof(VerifyResponse), false)) {
+      fprintf(stderr, "ptotp: lost the connection to ptotpd\n");
+      return 2;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      const VerifyResponse* response = &responses[i];
+      char* p = buffered_writer_reserve(out, OUTPUT_LINE_MAX);
+      buffered_writer_commit(out, put_result(p, response->id, response->status, response->offset));
+    }
+    count = 0;
+  }
+  if (pairs->failed) {
+    fprintf(stderr, "%s: read failed\n", name);
+    status = 2;
+  }
+  return status;
+}
+
+static int open_input(const char* path) {
+  if (!path || !strcmp(path, "-")) return STDIN_FILENO;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "ptotp: %s: %s\n", path, strerror(errno));
+  }
+  return fd;
+}
+
+static void print_stats(void) {
+  OTPStats totals;
+  otp_stats_snapshot(&totals);
+  fprintf(stderr, "compressions %" PRIu64 "\ncodes_generated %" PRIu64 "\n", totals.compressions, totals.codes_generated);
+}
+
+// Asks for every VerifyStat in one round trip.
+static bool print_daemon_stats(int fd) {
+  static const char* const names[VerifyStatCount] = {"requests", "batches", "compressions", "codes_generated"};
+  VerifyRequest requests[VerifyStatCount];
+  VerifyStatResponse responses[VerifyStatCount];
+  for (uint32_t i = 0; i < VerifyStatCount; ++i) {
+    requests[i] = (VerifyRequest){.id = i, .code = VERIFY_STATS_CODE};
+  }
+  if (!transfer(fd, requests, sizeof(requests), true) || !transfer(fd, responses, sizeof(responses), false)) return false;
+  for (int i = 0; i < VerifyStatCount; ++i) {
+    fprintf(stderr, "%s %" PRIu64 "\n", names[i], responses[i].value);
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Options options = {.window = OTP_DEFAULT_WINDOW};
+  options.from = options.to = time(NULL);
+  int opt;
+  while ((opt = getopt(argc, argv, "f:S:C:t:r:vw:sh")) != -1) {
+    switch (opt) {
+      case 'f':
+        options.token_path = optarg;
+        break;
+      case 'S':
+        options.store_name = optarg;
+        break;
+      case 'C':
+        options.socket_path = optarg;
+        break;
+      case 't':
+        if (!parse_time(optarg, &options.from)) usage();
+        options.to = options.from;
+        break;
+      case 'r': {
+        char* colon = strchr(optarg, ':');
+        if (!colon) usage();
+        *colon = 0;
+        if (!parse_time(optarg, &options.from) || !parse_time(colon + 1, &options.to) || options.to < options.from) usage();
+        options.range = true;
+        break;
+      }
+      case 'v':
+        options.verify = true;
+        break;
+      case 'w':
+        options.window = atoi(optarg);
+        if (options.window < 0 || options.window > OTP_MAX_WINDOW) usage();
+        break;
+      case 's':
+        options.stats = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  int sources = !!options.token_path + !!options.store_name + !!options.socket_path;
+  if (options.verify && (sources != 1 || options.range)) usage();
+  if (!options.verify && (options.store_name || options.socket_path)) usage();
+  if (!options.verify && optind != argc) usage();
+
+  BufferedWriter out;
+  if (!buffered_writer_open(&out, STDOUT_FILENO, 0)) return 2;
+  int status = 0;
+
+  const char* token_name = options.token_path ? options.token_path : "<stdin>";
+
+  TokenFile file;
+  if (!options.verify && options.token_path && token_file_open(&file, options.token_path)) {
+    run_generate_records(&file, &out, &options);
+    token_file_close(&file);
+  } else if (!options.verify) {
+    int token_fd = open_input(options.token_path);
+    if (token_fd < 0) return 2;
+    LineReader tokens;
+    if (!line_reader_open(&tokens, token_fd, 0)) return 2;
+    status = run_generate(&tokens, token_name, &out, &options);
+    line_reader_close(&tokens);
+  } else {
+    static TokenStore token_store;
+    ShmStore store;
+    TokenReloader reloader;
+    bool reloading = false;
+    TokenSource source = {.tokens = &token_store};
+    int daemon_fd = -1;
+    if (options.socket_path) {
+      daemon_fd = connect_daemon(options.socket_path);
+      if (daemon_fd < 0) {
+        fprintf(stderr, "ptotp: %s: %s\n", options.socket_path, strerror(errno));
+        return 2;
+      }
+    } else if (options.store_name) {
+      if (!shm_store_open(&store, options.store_name)) {
+        fprintf(stderr, "ptotp: %s: %s\n", options.store_name, strerror(errno));
+        return 2;
+      }
+      source.store = &store;
+    } else {
+      if (!token_store_init(&token_store) || !token_store_load_path(&token_store, options.token_path)) return 2;
+      source.reader = token_store_register(&token_store);
+      // Standard input can't be read again, so only a named file is reloaded.
+      if (strcmp(options.token_path, "-")) {
+        reloading = token_reloader_start(&reloader, &token_store, options.token_path);
+      }
+    }
+
+    for (int i = optind; i == optind || i < argc; ++i) {
+      const char* path = i < argc ? argv[i] : NULL;
+      int fd = open_input(path);
+      if (fd < 0) {
+        status = 2;
+        continue;
+      }
+      LineReader pairs;
+      if (!line_reader_open(&pairs, fd, 0)) return 2;
+      const char* name = path ? path : "<stdin>";
+      int result = daemon_fd >= 0 ? run_client(daemon_fd, &pairs, name, &out, &options) : run_verify(&source, &pairs, name, &out, &options);
+      status = result > status ? result : status;
+      line_reader_close(&pairs);
+      if (fd != STDIN_FILENO) close(fd);
+    }
+    if (daemon_fd >= 0) {
+      if (options.stats && !print_daemon_stats(daemon_fd)) {
+        fprintf(stderr, "ptotp: lost the connection to ptotpd\n");
+        status = 2;
+      }
+      close(daemon_fd);
+    } else if (source.store) {
+      shm_store_close(source.store);
+    } else {
+      if (reloading) {
+        token_reloader_stop(&reloader);
+      }
+      token_store_unregister(source.reader);
+      token_store_destroy(&token_store);
+    }
+  }
+
+  if (!buffered_writer_close(&out)) {
+    fprintf(stderr, "ptotp: write failed\n");
+    status = 2;
+  }
+  if (options.stats && !options.socket_path) {
+    print_stats();
+  }
+  return status;
+}
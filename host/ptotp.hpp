@@ -0,0 +1,182 @@
+// Header-only C++17 layer over the OTP core, with the hash, digit count and period fixed at compile time.
+//
+//   ptotp::Totp<ptotp::SHA1> totp(key);           // 6 digits, 30 second steps
+//   ptotp::Totp<ptotp::SHA256, 8, 60> wide(key);
+//   if (auto offset = totp.verify(code, time(nullptr))) ...
+//
+// Each instantiation calls its hash's HMAC kernels directly - there's no algorithm switch - and divides by
+// its period and power of ten as constants, which the compiler turns into multiplies. The key is reduced
+// to its HMAC midstate on construction, exactly as otp_token_init() does, so a Totp can be built from an
+// OTPToken's midstate and a token from a Totp's. Link against libptotp.a, with ../src on the include path.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PTOTP_HPP__
+#define PTOTP_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+extern "C" {
+#include "hmac.h"
+}
+
+namespace ptotp {
+
+// Read-only bytes: std::span where the standard library has it, and a stand-in with the same shape before C++20.
+#if defined(__cpp_lib_span)
+using Bytes = std::span<const uint8_t>;
+#else
+class Bytes {
+ public:
+  constexpr Bytes() = default;
+  constexpr Bytes(const uint8_t* data, std::size_t size) : data_(data), size_(size) {}
+  template <typename Container,
+            typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<const Container&>().data()), const uint8_t*>>>
+  constexpr Bytes(const Container& container) : data_(container.data()), size_(container.size()) {}
+  template <std::size_t N>
+  constexpr Bytes(const uint8_t (&array)[N]) : data_(array), size_(N) {}
+
+  constexpr const uint8_t* data() const { return data_; }
+  constexpr std::size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+#endif
+
+// Hash traits: sizes, and the HMAC kernels in hmac.h that start from and resume a midstate.
+struct SHA1 {
+  static constexpr std::size_t block_size = 64;
+  static constexpr std::size_t digest_size = 20;
+  static constexpr std::size_t midstate_size = HMAC_SHA1_MIDSTATE_LENGTH;
+
+  static void midstate(Bytes key, uint8_t* midstate) {
+    hmac_sha1_midstate(key.data(), static_cast<int>(key.size()), midstate);
+  }
+  static void mac(const uint8_t* midstate, const uint8_t* message, std::size_t length, uint8_t* digest) {
+    hmac_sha1_from_midstate(midstate, message, static_cast<int>(length), digest, static_cast<int>(digest_size));
+  }
+};
+
+struct SHA256 {
+  static constexpr std::size_t block_size = 64;
+  static constexpr std::size_t digest_size = 32;
+  static constexpr std::size_t midstate_size = HMAC_SHA256_MIDSTATE_LENGTH;
+
+  static void midstate(Bytes key, uint8_t* midstate) {
+    hmac_sha256_midstate(key.data(), static_cast<int>(key.size()), midstate);
+  }
+  static void mac(const uint8_t* midstate, const uint8_t* message, std::size_t length, uint8_t* digest) {
+    hmac_sha256_from_midstate(midstate, message, static_cast<unsigned>(length), digest, static_cast<int>(digest_size));
+  }
+};
+
+constexpr uint64_t pow10(unsigned digits) {
+  uint64_t value = 1;
+  while (digits--) {
+    value *= 10;
+  }
+  return value;
+}
+
+template <typename Hash, unsigned Digits = 6, unsigned Period = 30>
+class Totp {
+ public:
+  static_assert(Digits >= 1 && Digits <= 10, "a 31-bit truncated hash has at most 10 digits");
+  static_assert(Period >= 1, "steps must be at least a second");
+
+  using Midstate = std::array<uint8_t, Hash::midstate_size>;
+  using Code = std::array<char, Digits>; // Zero-padded, not terminated
+  static constexpr unsigned digits = Digits;
+  static constexpr unsigned period = Period;
+  static constexpr uint64_t modulus = pow10(Digits);
+
+  explicit Totp(Bytes key) { Hash::midstate(key, midstate_.data()); }
+
+  static Totp from_midstate(Bytes midstate) {
+    Totp totp;
+    for (std::size_t i = 0; i < Hash::midstate_size && i < midstate.size(); ++i) {
+      totp.midstate_[i] = midstate.data()[i];
+    }
+    return totp;
+  }
+
+  Totp(const Totp&) = default;
+  Totp& operator=(const Totp&) = default;
+
+  ~Totp() {
+    volatile uint8_t* p = midstate_.data();
+    for (std::size_t i = 0; i < midstate_.size(); ++i) {
+      p[i] = 0;
+    }
+  }
+
+  static constexpr uint64_t step(uint64_t unix_time) { return unix_time / Period; }
+
+  // The 31-bit truncated hash for a step, as generateCode() returns.
+  uint32_t hash(uint64_t step) const {
+    uint8_t challenge[8];
+    for (int i = 7; i >= 0; --i) {
+      challenge[i] = static_cast<uint8_t>(step);
+      step >>= 8;
+    }
+    uint8_t digest[Hash::digest_size];
+    Hash::mac(midstate_.data(), challenge, sizeof(challenge), digest);
+    const uint8_t* p = digest + (digest[Hash::digest_size - 1] & 0xF);
+    return (uint32_t(p[0] & 0x7F) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+  }
+
+  uint32_t code(uint64_t step) const { return static_cast<uint32_t>(hash(step) % modulus); }
+
+  uint32_t code_at(uint64_t unix_time) const { return code(step(unix_time)); }
+
+  // Tries the step for unix_time, then one before, one after, two before... out to window either side, as
+  // otp_verify() does. Returns the matching step's offset, if any.
+  std::optional<int> verify(uint32_t code, uint64_t unix_time, int window = 1) const {
+    uint64_t now = step(unix_time);
+    for (int i = 0; i <= window * 2; ++i) {
+      int offset = (i & 1) ? -(i + 1) / 2 : i / 2;
+      if (offset < 0 && static_cast<uint64_t>(-offset) > now) continue;
+      if (this->code(now + offset) == code) return offset;
+    }
+    return std::nullopt;
+  }
+
+  static constexpr Code format(uint32_t code) {
+    Code text{};
+    for (unsigned i = Digits; i-- > 0;) {
+      text[i] = static_cast<char>('0' + code % 10);
+      code /= 10;
+    }
+    return text;
+  }
+
+  const Midstate& midstate() const { return midstate_; }
+
+ private:
+  Totp() = default;
+
+  Midstate midstate_{};
+};
+
+} // namespace ptotp
+
+#endif
@@ -0,0 +1,502 @@
+// ptotp_load: replays a synthetic login storm against the verifier and reports throughput and latency.
+//
+//   ptotp_load [-n tokens] [-a sha256 percent] [-k min:max key bytes] [-d 8-digit percent] [-z zipf exponent]
+//              [-g good percent] [-S skew seconds] [-D drift seconds] [-w window] [-e] [-c cache entries] [-L failures:seconds] [-r requests]
+//              [-j threads] [-B batch] [-H] [-T seconds] [-s seed] [-A audit directory]
+//
+// The population is built from random keys, and the stream of logins drawn before timing starts: token by a
+// Zipf law over a shuffled ranking, the code right for a client clock off by up to -S seconds either way or
+// else random. With -D each token's clock also runs a steady amount off, up to that many seconds either way. Each thread replays the stream from its own starting point, timing every verification.
+// With -c the threads share a code cache of that many entries, and with -L an attempt limiter that turns
+// tokens away unhashed once they've failed that many times, each within seconds of the last. -e estimates
+// each token's drift from its successes, so later checks try its likeliest steps first. -B verifies the
+// stream in batches of that many, looked up and prefetched together as ptotpd does (see otp_batch.h), each
+// login's latency then being its whole batch's; -H puts the tokens on huge pages. With -A
+// every verification is also recorded in an audit log there, each thread through its own ring.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "attempt_limiter.h"
+#include "audit_log.h"
+#include "code_cache.h"
+#include "drift_table.h"
+#include "latency_histogram.h"
+#include "otp_batch.h"
+#include "otp_stats.h"
+#include "otp_verify.h"
+#include "token_set.h"
+#include "verify_protocol.h"
+
+#define MAX_THREADS 64
+#define DEADLINE_CHECK_INTERVAL 1024 // Verifications between looks at the clock
+#define MAX_BATCH DEADLINE_CHECK_INTERVAL
+
+typedef struct Options {
+  size_t tokens;
+  int sha256_percent;
+  size_t key_min;
+  size_t key_max;
+  int eight_digit_percent;
+  double zipf_exponent;
+  int good_percent;
+  int skew_seconds;
+  int drift_seconds;
+  int window;
+  bool estimate_drift;
+  size_t cache_entries;
+  unsigned max_failures;
+  unsigned lockout_seconds;
+  const char* audit_directory;
+  size_t requests;
+  int threads;
+  size_t batch;
+  bool huge_pages;
+  double seconds;
+  uint64_t seed;
+} Options;
+
+typedef struct LoginRequest {
+  uint32_t id;
+  uint32_t code;
+  uint64_t time;
+} LoginRequest;
+
+typedef struct Worker {
+  pthread_t thread;
+  const OTPTokenSet* set;
+  const LoginRequest* requests;
+  const Options* options;
+  CodeCache* cache;
+  AttemptLimiter* limiter;
+  DriftTable* drift;
+  AuditLog* audit;
+  size_t start;
+  uint64_t deadline;
+  uint64_t verified;
+  uint64_t accepted;
+  uint64_t locked;
+  LatencyHistogram latency;
+  OTPBatchItem items[MAX_BATCH];
+  OTPBatchItem scratch[MAX_BATCH];
+} Worker;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint64_t rng_below(uint64_t bound) {
+  return rng_next() % bound;
+}
+
+static double rng_unit(void) {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void usage(void) {
+  fprintf(stderr,
+    "usage: ptotp_load [-n tokens] [-a sha256 percent] [-k min:max key bytes] [-d 8-digit percent] [-z zipf exponent]\n"
+    "                  [-g good percent] [-S skew seconds] [-D drift seconds] [-w window] [-e] [-c cache entries] [-L failures:seconds] [-r requests]\n"
+    "                  [-j threads] [-B batch] [-H] [-T seconds] [-s seed] [-A audit directory]\n");
+  exit(2);
+}
+
+static bool build_population(OTPTokenSet* set, const Options* options) {
+  uint8_t key[255];
+  for (size_t i = 0; i < options->tokens; ++i) {
+    OTPToken* token = token_set_append(set);
+    if (!token) return false;
+    size_t key_length = options->key_min + rng_below(options->key_max - options->key_min + 1);
+    for (size_t b = 0; b < key_length; ++b) {
+      key[b] = rng_next();
+    }
+    OTPAlgorithm algorithm = (int)rng_below(100) < options->sha256_percent ? OTPAlgorithmSHA256 : OTPAlgorithmSHA1;
+    int digits = (int)rng_below(100) < options->eight_digit_percent ? 8 : 6;
+    otp_token_init(token, i, key, key_length, digits, algorithm, OTP_DEFAULT_PERIOD);
+  }
+  memset(key, 0, sizeof(key));
+  return token_set_finish(set, NULL);
+}
+
+// Cumulative Zipf weights over ranks 1..count, scaled to 1.
+static double* zipf_table(size_t count, double exponent) {
+  double* cdf = malloc(count * sizeof(double));
+  if (!cdf) return NULL;
+  double total = 0;
+  for (size_t rank = 0; rank < count; ++rank) {
+    total += pow(rank + 1, -exponent);
+    cdf[rank] = total;
+  }
+  for (size_t rank = 0; rank < count; ++rank) {
+    cdf[rank] /= total;
+  }
+  return cdf;
+}
+
+static size_t zipf_draw(const double* cdf, size_t count) {
+  double u = rng_unit();
+  size_t low = 0, high = count - 1;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (cdf[mid] < u) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static bool build_requests(LoginRequest* requests, const OTPTokenSet* set, const Options* options) {
+  double* cdf = zipf_table(set->count, options->zipf_exponent);
+  uint32_t* ranking = malloc(set->count * sizeof(uint32_t));
+  int32_t* drift = calloc(set->count, sizeof(int32_t));
+  if (!cdf || !ranking || !drift) {
+    free(cdf);
+    free(ranking);
+    free(drift);
+    return false;
+  }
+  if (options->drift_seconds) {
+    for (size_t i = 0; i < set->count; ++i) {
+      drift[i] = (int32_t)rng_below(options->drift_seconds * 2 + 1) - options->drift_seconds;
+    }
+  }
+  // Shuffled so the popular tokens are spread through the store rather than packed at the front.
+  for (size_t i = 0; i < set->count; ++i) {
+    ranking[i] = i;
+  }
+  for (size_t i = set->count - 1; i > 0; --i) {
+    size_t j = rng_below(i + 1);
+    uint32_t swap = ranking[i];
+    ranking[i] = ranking[j];
+    ranking[j] = swap;
+  }
+  uint64_t base = time(NULL);
+  for (size_t i = 0; i < options->requests; ++i) {
+    size_t index = ranking[zipf_draw(cdf, set->count)];
+    const OTPToken* token = &set->tokens[index];
+    LoginRequest* request = &requests[i];
+    request->id = token->id;
+    request->time = base + rng_below(3600);
+    if ((int)rng_below(100) < options->good_percent) {
+      // Two uniform draws make a triangular skew - most clients close to right, a few near the limit.
+      int64_t skew = options->skew_seconds ? (int64_t)rng_below(options->skew_seconds + 1) - (int64_t)rng_below(options->skew_seconds + 1) : 0;
+      request->code = otp_token_code(token, otp_token_step(token, request->time + drift[index] + skew));
+    } else {
+      request->code = rng_below(token->digits == 8 ? 100000000 : 1000000);
+    }
+  }
+  free(cdf);
+  free(ranking);
+  free(drift);
+  return true;
+}
+
+// One login against its token, as ptotpd would answer it.
+static void verify_one(Worker* worker, AuditRing* ring, const LoginRequest* request, const OTPToken* token, uint64_t now) {
+  int offset;
+  bool ok = false;
+  VerifyStatus result = VerifyLocked;
+  if (worker->limiter && !attempt_limiter_allow(worker->limiter, token->id, now)) {
+    worker->locked++;
+  } else {
+    // The population never changes, so one epoch covers the whole run.
+    ok = otp_verify_tracked(token, request->code, otp_token_step(token, request->time), worker->options->window, worker->cache, 1,
+                            worker->drift, &offset);
+    if (worker->limiter) {
+      attempt_limiter_record(worker->limiter, token->id, now, ok);
+    }
+    result = ok ? VerifyOK : VerifyFail;
+  }
+  if (ring) {
+    audit_log_append(ring, token->id, otp_token_step(token, request->time), ok ? offset : 0, result);
+  }
+  worker->accepted += ok;
+}
+
+static void verify_batch(Worker* worker, AuditRing* ring, size_t* next, size_t count, uint64_t now) {
+  const Options* options = worker->options;
+  uint64_t started = now_ns();
+  for (size_t i = 0; i < count; ++i) {
+    worker->items[i] = (OTPBatchItem){.id = worker->requests[*next].id, .index = *next};
+    if (++*next == options->requests) {
+      *next = 0;
+    }
+  }
+  otp_batch_sort(worker->items, count, worker->scratch);
+  otp_batch_lookup(worker->set, worker->items, count);
+  for (size_t i = 0; i < count; ++i) {
+    otp_batch_prefetch(worker->items, count, i + OTP_BATCH_AHEAD);
+    verify_one(worker, ring, &worker->requests[worker->items[i].index], worker->items[i].token, now);
+  }
+  uint64_t elapsed = now_ns() - started;
+  for (size_t i = 0; i < count; ++i) {
+    latency_histogram_record(&worker->latency, elapsed);
+  }
+}
+
+static void* run_worker(void* context) {
+  Worker* worker = context;
+  const Options* options = worker->options;
+  size_t next = worker->start;
+  latency_histogram_init(&worker->latency);
+  AuditRing* ring = worker->audit ? audit_log_register(worker->audit) : NULL;
+  for (;;) {
+    uint64_t now = time(NULL);
+    if (options->batch > 1) {
+      for (size_t done = 0; done < DEADLINE_CHECK_INTERVAL; done += options->batch) {
+        verify_batch(worker, ring, &next, DEADLINE_CHECK_INTERVAL - done < options->batch ? DEADLINE_CHECK_INTERVAL - done : options->batch, now);
+      }
+    } else {
+      for (int i = 0; i < DEADLINE_CHECK_INTERVAL; ++i) {
+        const LoginRequest* request = &worker->requests[next];
+        if (++next == options->requests) {
+          next = 0;
+        }
+        uint64_t started = now_ns();
+        verify_one(worker, ring, request, token_set_find(worker->set, request->id), now);
+        latency_histogram_record(&worker->latency, now_ns() - started);
+      }
+    }
+    worker->verified += DEADLINE_CHECK_INTERVAL;
+    if (now_ns() >= worker->deadline) break;
+  }
+  return NULL;
+}
+
+static bool parse_range(char* text, size_t* low, size_t* high) {
+  char* colon = strchr(text, ':');
+  if (!colon) return false;
+  *colon = 0;
+  *low = strtoul(text, NULL, 10);
+  *high = strtoul(colon + 1, NULL, 10);
+  return *low >= 1 && *low <= *high && *high <= 255;
+}
+
+int main(int argc, char** argv) {
+  Options options = {
+    .tokens = 100000,
+    .sha256_percent = 20,
+    .key_min = 10,
+    .key_max = 64,
+    .eight_digit_percent = 10,
+    .zipf_exponent = 1.0,
+    .good_percent = 90,
+    .skew_seconds = 20,
+    .window = OTP_DEFAULT_WINDOW,
+    .requests = 1 << 20,
+    .threads = 1,
+    .seconds = 5,
+    .seed = 0x9E3779B97F4A7C15ULL,
+  };
+  int opt;
+  while ((opt = getopt(argc, argv, "n:a:k:d:z:g:S:D:w:ec:L:r:j:B:HT:s:A:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        options.tokens = strtoul(optarg, NULL, 10);
+        break;
+      case 'a':
+        options.sha256_percent = atoi(optarg);
+        break;
+      case 'k':
+        if (!parse_range(optarg, &options.key_min, &options.key_max)) usage();
+        break;
+      case 'd':
+        options.eight_digit_percent = atoi(optarg);
+        break;
+      case 'z':
+        options.zipf_exponent = atof(optarg);
+        break;
+      case 'g':
+        options.good_percent = atoi(optarg);
+        break;
+      case 'S':
+        options.skew_seconds = atoi(optarg);
+        break;
+      case 'D':
+        options.drift_seconds = atoi(optarg);
+        break;
+      case 'w':
+        options.window = atoi(optarg);
+        break;
+      case 'e':
+        options.estimate_drift = true;
+        break;
+      case 'c':
+        options.cache_entries = strtoul(optarg, NULL, 10);
+        break;
+      case 'L': {
+        char* colon = strchr(optarg, ':');
+        if (!colon) usage();
+        options.max_failures = strtoul(optarg, NULL, 10);
+        options.lockout_seconds = strtoul(colon + 1, NULL, 10);
+        break;
+      }
+      case 'r':
+        options.requests = strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        options.threads = atoi(optarg);
+        break;
+      case 'B':
+        options.batch = strtoul(optarg, NULL, 10);
+        break;
+      case 'H':
+        options.huge_pages = true;
+        break;
+      case 'T':
+        options.seconds = atof(optarg);
+        break;
+      case 'A':
+        options.audit_directory = optarg;
+        break;
+      case 's':
+        options.seed = strtoull(optarg, NULL, 0) | 1;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind != argc || !options.tokens || options.tokens > UINT32_MAX || !options.requests || options.skew_seconds < 0 || options.drift_seconds < 0 ||
+      options.window < 0 || options.window > OTP_MAX_WINDOW || options.threads < 1 || options.threads > MAX_THREADS || options.batch > MAX_BATCH ||
+      options.seconds <= 0 || options.zipf_exponent < 0) {
+    usage();
+  }
+  rng_state = options.seed;
+
+  OTPTokenSet set;
+  token_set_init(&set);
+  LoginRequest* requests = malloc(options.requests * sizeof(LoginRequest));
+  if (!requests || !build_population(&set, &options) || !build_requests(requests, &set, &options)) {
+    fprintf(stderr, "ptotp_load: out of memory\n");
+    return 2;
+  }
+  if (options.huge_pages && !token_set_use_huge_pages(&set)) {
+    fprintf(stderr, "ptotp_load: could not map huge pages\n");
+    return 2;
+  }
+
+  CodeCache cache;
+  if (options.cache_entries && !code_cache_init(&cache, options.cache_entries)) {
+    fprintf(stderr, "ptotp_load: out of memory\n");
+    return 2;
+  }
+
+  AttemptLimiter limiter;
+  if (options.max_failures && !attempt_limiter_init(&limiter, set.count, options.max_failures, options.lockout_seconds, time(NULL))) {
+    fprintf(stderr, "ptotp_load: out of memory\n");
+    return 2;
+  }
+
+  DriftTable drift;
+  if (options.estimate_drift && !drift_table_init(&drift, set.count)) {
+    fprintf(stderr, "ptotp_load: out of memory\n");
+    return 2;
+  }
+
+  AuditLog audit;
+  if (options.audit_directory && !audit_log_open(&audit, options.audit_directory, 0, 0)) return 2;
+
+  static Worker workers[MAX_THREADS];
+  // Only the hashing done while the workers run - not the set-up's - counts against the verifications.
+  OTPStats before, after;
+  otp_stats_snapshot(&before);
+  uint64_t started = now_ns();
+  uint64_t deadline = started + (uint64_t)(options.seconds * 1e9);
+  for (int i = 0; i < options.threads; ++i) {
+    workers[i] = (Worker){
+      .set = &set,
+      .requests = requests,
+      .options = &options,
+      .cache = options.cache_entries ? &cache : NULL,
+      .limiter = options.max_failures ? &limiter : NULL,
+      .drift = options.estimate_drift ? &drift : NULL,
+      .audit = options.audit_directory ? &audit : NULL,
+      .start = options.requests / options.threads * i,
+      .deadline = deadline,
+    };
+    if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i])) {
+      fprintf(stderr, "ptotp_load: could not start thread %d\n", i);
+      return 2;
+    }
+  }
+  static LatencyHistogram latency;
+  latency_histogram_init(&latency);
+  uint64_t verified = 0, accepted = 0, locked = 0;
+  for (int i = 0; i < options.threads; ++i) {
+    pthread_join(workers[i].thread, NULL);
+    latency_histogram_merge(&latency, &workers[i].latency);
+    verified += workers[i].verified;
+    accepted += workers[i].accepted;
+    locked += workers[i].locked;
+  }
+  double elapsed = (now_ns() - started) / 1e9;
+  otp_stats_snapshot(&after);
+  uint64_t hashes = after.codes_generated - before.codes_generated;
+  uint64_t audit_waits = 0;
+  if (options.audit_directory) {
+    audit_waits = atomic_load(&audit.waits);
+    if (!audit_log_close(&audit)) {
+      fprintf(stderr, "ptotp_load: %s: some audit records could not be written\n", options.audit_directory);
+    }
+  }
+
+  printf("tokens %zu (%d%% sha256, keys %zu-%zu bytes, %d%% 8 digits)\n", set.count, options.sha256_percent,
+         options.key_min, options.key_max, options.eight_digit_percent);
+  printf("stream %zu logins, zipf %.2f, %d%% good, skew up to %ds, drift up to %ds, window %d%s, cache %zu entries\n",
+         options.requests, options.zipf_exponent, options.good_percent, options.skew_seconds, options.drift_seconds, options.window,
+         options.estimate_drift ? " (estimated drift)" : "", options.cache_entries);
+  printf("verified %" PRIu64 " in %.2fs on %d threads, batches of %zu%s: %.0f/s\n", verified, elapsed, options.threads,
+         options.batch > 1 ? options.batch : 1, options.huge_pages ? " on huge pages" : "", verified / elapsed);
+  printf("accepted %.1f%%, locked out %.1f%%, %.2f hashes per verification\n", 100.0 * accepted / verified, 100.0 * locked / verified,
+         (double)hashes / verified);
+  if (options.audit_directory) {
+    printf("audited to %s, %" PRIu64 " waits for a full ring\n", options.audit_directory, audit_waits);
+  }
+  printf("latency ns: min %" PRIu64 " p50 %" PRIu64 " p90 %" PRIu64 " p99 %" PRIu64 " p999 %" PRIu64 " max %" PRIu64 " mean %.0f\n",
+         latency.min, latency_histogram_quantile(&latency, 0.5), latency_histogram_quantile(&latency, 0.9),
+         latency_histogram_quantile(&latency, 0.99), latency_histogram_quantile(&latency, 0.999), latency.max,
+         (double)latency.sum / latency.total);
+
+  if (options.cache_entries) {
+    code_cache_free(&cache);
+  }
+  if (options.max_failures) {
+    attempt_limiter_free(&limiter);
+  }
+  if (options.estimate_drift) {
+    drift_table_free(&drift);
+  }
+  free(requests);
+  token_set_free(&set);
+  return 0;
+}
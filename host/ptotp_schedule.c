@@ -0,0 +1,199 @@
+// ptotp_schedule: pre-generates code sheets for tokens on devices without clocks.
+//
+//   ptotp_schedule -f tokens -r from:to [-j threads] -o schedule   writes every code of the range (see otp_schedule.h)
+//   ptotp_schedule -p schedule [-i id] [-t time]                   prints it as "id time code" lines, as ptotp -r does,
+//                                                                  or just "id code" at one time
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "buffered_writer.h"
+#include "code_format.h"
+#include "otp_schedule.h"
+#include "token_set.h"
+
+#define OUTPUT_LINE_MAX 64 // id, time and code with their separators
+
+static void usage(void) {
+  fprintf(stderr,
+    "usage: ptotp_schedule -f tokens -r from:to [-j threads] -o schedule\n"
+    "       ptotp_schedule -p schedule [-i id] [-t time]\n");
+  exit(2);
+}
+
+static char* put_uint(char* p, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+static bool parse_uint(const char* text, uint64_t max, uint64_t* value) {
+  return otp_parse_uint(text, strlen(text), max, value);
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run_write(const char* token_path, const char* path, uint64_t from, uint64_t to, int threads) {
+  OTPTokenSet set;
+  token_set_init(&set);
+  size_t duplicates;
+  if (!token_set_load_path(&set, token_path) || !token_set_finish(&set, &duplicates)) {
+    fprintf(stderr, "ptotp_schedule: %s: could not load tokens\n", token_path);
+    token_set_free(&set);
+    return 1;
+  }
+  if (duplicates) {
+    fprintf(stderr, "ptotp_schedule: %s: %zu duplicate IDs, keeping the last of each\n", token_path, duplicates);
+  }
+  double started = now_seconds();
+  bool ok = otp_schedule_write(path, set.tokens, set.count, from, to, threads);
+  double elapsed = now_seconds() - started;
+  size_t count = set.count;
+  token_set_free(&set);
+  if (!ok) {
+    fprintf(stderr, "ptotp_schedule: %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  OTPSchedule schedule;
+  if (otp_schedule_open(&schedule, path)) {
+    uint64_t codes = schedule.header->code_count;
+    fprintf(stderr, "ptotp_schedule: %llu codes for %zu tokens in %.2fs on %d threads: %.0f/s\n",
+            (unsigned long long)codes, count, elapsed, threads, elapsed > 0 ? codes / elapsed : 0);
+    otp_schedule_close(&schedule);
+  }
+  return 0;
+}
+
+static void print_entry(BufferedWriter* out, const OTPSchedule* schedule, const OTPScheduleEntry* entry, bool at_time, uint64_t time) {
+  uint64_t first = 0, last = entry->step_count;
+  if (at_time) {
+    uint64_t step = time / entry->period;
+    if (step < entry->first_step || step - entry->first_step >= entry->step_count) return;
+    first = step - entry->first_step;
+    last = first + 1;
+  }
+  const uint32_t* codes = &schedule->codes[entry->first_code];
+  for (uint64_t i = first; i < last; ++i) {
+    char* p = buffered_writer_reserve(out, OUTPUT_LINE_MAX);
+    p = put_uint(p, entry->id);
+    *p++ = ' ';
+    if (!at_time) {
+      p = put_uint(p, (entry->first_step + i) * entry->period);
+      *p++ = ' ';
+    }
+    code_format_batch(&codes[i], 1, entry->digits, '\n', p, entry->digits + 1);
+    buffered_writer_commit(out, p + entry->digits + 1);
+  }
+}
+
+static int run_print(const char* path, bool one_id, uint32_t id, bool at_time, uint64_t time) {
+  OTPSchedule schedule;
+  if (!otp_schedule_open(&schedule, path)) {
+    fprintf(stderr, "ptotp_schedule: %s: %s\n", path, errno == EINVAL ? "not a schedule" : strerror(errno));
+    return 1;
+  }
+  BufferedWriter out;
+  if (!buffered_writer_open(&out, STDOUT_FILENO, BUFFERED_WRITER_DEFAULT_CAPACITY)) {
+    otp_schedule_close(&schedule);
+    return 2;
+  }
+  int status = 0;
+  if (one_id) {
+    const OTPScheduleEntry* entry = otp_schedule_find(&schedule, id);
+    if (entry) {
+      print_entry(&out, &schedule, entry, at_time, time);
+    } else {
+      fprintf(stderr, "ptotp_schedule: %s: no token %u\n", path, id);
+      status = 1;
+    }
+  } else {
+    for (size_t t = 0; t < schedule.header->token_count; ++t) {
+      print_entry(&out, &schedule, &schedule.entries[t], at_time, time);
+    }
+  }
+  if (!buffered_writer_close(&out)) {
+    fprintf(stderr, "ptotp_schedule: write failed\n");
+    status = 2;
+  }
+  otp_schedule_close(&schedule);
+  return status;
+}
+
+int main(int argc, char** argv) {
+  const char* token_path = NULL;
+  const char* output_path = NULL;
+  const char* print_path = NULL;
+  uint64_t from = 0, to = 0, id = 0, time = 0;
+  bool range = false, one_id = false, at_time = false;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t threads = cpus > 0 ? cpus : 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:j:o:p:i:t:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        token_path = optarg;
+        break;
+      case 'r': {
+        char* colon = strchr(optarg, ':');
+        if (!colon) usage();
+        *colon = 0;
+        if (!parse_uint(optarg, UINT64_MAX, &from) || !parse_uint(colon + 1, UINT64_MAX, &to) || to < from) usage();
+        range = true;
+        break;
+      }
+      case 'j':
+        if (!parse_uint(optarg, 1024, &threads) || !threads) usage();
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'p':
+        print_path = optarg;
+        break;
+      case 'i':
+        if (!parse_uint(optarg, UINT32_MAX, &id)) usage();
+        one_id = true;
+        break;
+      case 't':
+        if (!parse_uint(optarg, UINT64_MAX, &time)) usage();
+        at_time = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind != argc) usage();
+  if (print_path) {
+    if (token_path || output_path || range) usage();
+    return run_print(print_path, one_id, id, at_time, time);
+  }
+  if (!token_path || !output_path || !range || one_id || at_time) usage();
+  return run_write(token_path, output_path, from, to, threads);
+}
@@ -0,0 +1,517 @@
+// ptotpd: verifies codes for local clients over a Unix socket, gathering their requests into micro-batches.
+//
+//   ptotpd -f tokens [-l socket] [-w window] [-b batch] [-D microseconds] [-c cache entries] [-L failures:seconds]
+//               [-e] [-H] [-a audit directory]
+//
+// Requests and responses are the records in verify_protocol.h. Requests are used in place in each
+// connection's receive buffer and queued into one batch across every connection. The batch is verified
+// once it holds -b requests or its oldest has waited -D microseconds (0 verifies whatever each poll
+// brought in), under one snapshot of the tokens, in ID order with the tokens looked up and prefetched ahead
+// of the hashing (see otp_batch.h); -H puts the tokens on huge pages. Each connection then gets all its
+// responses, in the order it sent the requests, in one write.
+// Hashes are kept in a code cache (-c entries, 0 for none) so retries within a step don't hash again; a
+// reload moves to a new snapshot generation, which leaves everything cached before it behind. A token that
+// fails -L failures times in a row, each within seconds of the last, is answered VerifyLocked without hashing
+// until seconds after its last failure (5:300 by default, 0 for no limit). The limiter keeps to the daemon's
+// clock, whatever time the requests give. -e keeps an estimate of each token's clock drift from the offsets
+// its codes match at, and tries its likeliest steps first; every step of the window is still tried
+// before a code is refused. With -a every answer is recorded in an audit log there (see
+// audit_log.h and audit_read). Clients can ask for the daemon's counters with stats requests (see
+// verify_protocol.h); the hashing counts are summed over every thread.
+// SIGHUP reloads the tokens without holding up verification; SIGTERM or SIGINT removes the socket and exits.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define _GNU_SOURCE // accept4
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "attempt_limiter.h"
+#include "audit_log.h"
+#include "code_cache.h"
+#include "drift_table.h"
+#include "otp_batch.h"
+#include "otp_stats.h"
+#include "otp_verify.h"
+#include "token_reloader.h"
+#include "token_store.h"
+#include "verify_protocol.h"
+
+#define CONNECTION_BUFFER (64 * 1024) // Bytes of requests a connection can have read but not yet answered
+#define CONNECTION_RESPONSES (CONNECTION_BUFFER / sizeof(VerifyRequest))
+#define MAX_BATCH CONNECTION_RESPONSES
+#define MAX_DEADLINE_US 10000000 // -D beyond 10 seconds is surely a mistake
+#define MAX_CACHE_ENTRIES (1 << 30)
+#define MAX_EVENTS 64
+
+typedef struct Connection {
+  int fd;
+  uint32_t events; // What epoll is watching for
+  uint8_t* in; // Whole requests from the front, with any partial one after them
+  size_t in_length;
+  size_t queued; // Bytes of in already handed to the batch
+  VerifyResponse* out;
+  size_t out_count;
+  size_t out_sent; // Bytes
+  bool eof;
+  bool failed;
+  bool in_batch;
+  bool reading; // queue_requests() is still walking in, so it mustn't be closed under it
+  struct Connection* next_in_batch;
+} Connection;
+
+typedef struct BatchEntry {
+  Connection* connection;
+  const VerifyRequest* request;
+  VerifyResponse* response; // Taken in arrival order, so each connection's stay in order whatever order they're filled in
+} BatchEntry;
+
+typedef struct Daemon {
+  int epoll_fd;
+  int listen_fd;
+  int timer_fd;
+  int signal_fd;
+  TokenStore tokens;
+  TokenStoreReader* reader;
+  int window;
+  CodeCache cache;
+  bool caching;
+  AttemptLimiter limiter;
+  bool limiting;
+  DriftTable drift;
+  bool estimating;
+  AuditLog audit;
+  AuditRing* audit_ring; // NULL when not auditing
+  size_t batch_limit;
+  long deadline_ns;
+  BatchEntry batch[MAX_BATCH];
+  OTPBatchItem items[MAX_BATCH];
+  OTPBatchItem scratch[MAX_BATCH];
+  size_t batch_count;
+  Connection* batch_connections;
+  uint64_t requests;
+  uint64_t batches;
+} Daemon;
+
+// epoll hands these back to tell the daemon's own descriptors from connections.
+static char listen_marker, timer_marker, signal_marker;
+
+static void usage(void) {
+  fprintf(stderr, "usage: ptotpd -f tokens [-l socket] [-w window] [-b batch] [-D microseconds] [-c cache entries] [-L failures:seconds]\n"
+                  "              [-e] [-H] [-a audit directory]\n");
+  exit(2);
+}
+
+// A whole-string decimal option no greater than max, or usage().
+static uint64_t option_uint(const char* text, uint64_t max) {
+  uint64_t value;
+  if (!otp_parse_uint(text, strlen(text), max, &value)) usage();
+  return value;
+}
+
+static bool watch(Daemon* daemon, int fd, uint32_t events, void* data) {
+  struct epoll_event event = {.events = events, .data.ptr = data};
+  return !epoll_ctl(daemon->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void close_connection(Daemon* daemon, Connection* connection) {
+  epoll_ctl(daemon->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+  close(connection->fd);
+  free(connection->in);
+  free(connection->out);
+  free(connection);
+}
+
+// Reads while nothing is waiting to go out and there's room, writes while something is, and closes
+// once the client has finished and been answered - unless the batch still points into its buffer.
+static void update_connection(Daemon* daemon, Connection* connection) {
+  if (connection->in_batch || connection->reading) return;
+  bool sending = connection->out_count != 0;
+  if (connection->failed || (connection->eof && !sending)) {
+    close_connection(daemon, connection);
+    return;
+  }
+  uint32_t events = sending ? EPOLLOUT : connection->eof || connection->in_length == CONNECTION_BUFFER ? 0 : EPOLLIN;
+  if (events != connection->events) {
+    struct epoll_event event = {.events = events, .data.ptr = connection};
+    epoll_ctl(daemon->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+  }
+}
+
+static void send_responses(Connection* connection) {
+  size_t total = connection->out_count * sizeof(VerifyResponse);
+  while (connection->out_sent < total) {
+    ssize_t sent = send(connection->fd, (uint8_t*)connection->out + connection->out_sent, total - connection->out_sent, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN) {
+        connection->failed = true;
+      }
+      return;
+    }
+    connection->out_sent += sent;
+  }
+  connection->out_count = 0;
+  connection->out_sent = 0;
+}
+
+static uint64_t daemon_stat(const Daemon* daemon, uint32_t stat, const OTPStats* totals) {
+  switch (stat) {
+    case VerifyStatRequests: return daemon->requests;
+    case VerifyStatBatches: return daemon->batches;
+    case VerifyStatCompressions: return totals->compressions;
+    case VerifyStatCodesGenerated: return totals->codes_generated;
+    default: return UINT64_MAX;
+  }
+}
+
+static void flush_batch(Daemon* daemon) {
+  if (!daemon->batch_count) return;
+  uint64_t now = time(NULL);
+  size_t count = 0;
+  OTPStats totals;
+  bool have_totals = false;
+  for (size_t i = 0; i < daemon->batch_count; ++i) {
+    BatchEntry* entry = &daemon->batch[i];
+    if (entry->connection->failed) continue;
+    entry->response = &entry->connection->out[entry->connection->out_count++];
+    if (entry->request->code == VERIFY_STATS_CODE) {
+      if (!have_totals) {
+        otp_stats_snapshot(&totals);
+        have_totals = true;
+      }
+      VerifyStatResponse response = {daemon_stat(daemon, entry->request->id, &totals)};
+      memcpy(entry->response, &response, sizeof(response));
+      continue;
+    }
+    daemon->items[count++] = (OTPBatchItem){.id = entry->request->id, .index = i};
+  }
+  // The work goes in ID order, with the tokens found and prefetched ahead of the hashing.
+  otp_batch_sort(daemon->items, count, daemon->scratch);
+  const TokenSnapshot* snapshot = token_store_enter(&daemon->tokens, daemon->reader);
+  otp_batch_lookup(&snapshot->set, daemon->items, count);
+  for (size_t i = 0; i < count; ++i) {
+    otp_batch_prefetch(daemon->items, count, i + OTP_BATCH_AHEAD);
+    const BatchEntry* entry = &daemon->batch[daemon->items[i].index];
+    const VerifyRequest* request = entry->request;
+    VerifyResponse* response = entry->response;
+    memset(response, 0, sizeof(VerifyResponse));
+    response->id = request->id;
+    const OTPToken* token = daemon->items[i].token;
+    uint64_t when = request->time ? request->time : now;
+    // An unknown token has no period of its own, so its audit record gets the step at the default one.
+    uint64_t step = token ? otp_token_step(token, when) : when / OTP_DEFAULT_PERIOD;
+    int offset;
+    if (!token) {
+      response->status = VerifyUnknown;
+    } else if (daemon->limiting && !attempt_limiter_allow(&daemon->limiter, request->id, now)) {
+      response->status = VerifyLocked;
+    } else {
+      bool ok = otp_verify_tracked(token, request->code, step, daemon->window, daemon->caching ? &daemon->cache : NULL, snapshot->generation,
+                                   daemon->estimating ? &daemon->drift : NULL, &offset);
+      if (daemon->limiting) {
+        attempt_limiter_record(&daemon->limiter, request->id, now, ok);
+      }
+      response->status = ok ? VerifyOK : VerifyFail;
+      response->offset = ok ? offset : 0;
+    }
+    if (daemon->audit_ring) {
+      audit_log_append(daemon->audit_ring, request->id, step, response->offset, response->status);
+    }
+  }
+  token_store_exit(daemon->reader);
+  daemon->requests += count;
+  daemon->batches += count != 0;
+  daemon->batch_count = 0;
+  if (daemon->deadline_ns) {
+    struct itimerspec disarm = {0};
+    timerfd_settime(daemon->timer_fd, 0, &disarm, NULL);
+  }
+
+  Connection* connection = daemon->batch_connections;
+  daemon->batch_connections = NULL;
+  while (connection) {
+    Connection* next = connection->next_in_batch;
+    memmove(connection->in, connection->in + connection->queued, connection->in_length - connection->queued);
+    connection->in_length -= connection->queued;
+    connection->queued = 0;
+    connection->in_batch = false;
+    if (!connection->failed) {
+      send_responses(connection);
+    }
+    update_connection(daemon, connection);
+    connection = next;
+  }
+}
+
+static void queue_requests(Daemon* daemon, Connection* connection) {
+  while (connection->in_length - connection->queued >= sizeof(VerifyRequest)) {
+    if (!daemon->batch_count && daemon->deadline_ns) {
+      struct itimerspec deadline = {.it_value = {.tv_sec = daemon->deadline_ns / 1000000000, .tv_nsec = daemon->deadline_ns % 1000000000}};
+      timerfd_settime(daemon->timer_fd, 0, &deadline, NULL);
+    }
+    // The buffer is only ever compacted by whole requests, so each one starts suitably aligned.
+    daemon->batch[daemon->batch_count++] = (BatchEntry){connection, (const VerifyRequest*)(connection->in + connection->queued), NULL};
+    connection->queued += sizeof(VerifyRequest);
+    if (!connection->in_batch) {
+      connection->in_batch = true;
+      connection->next_in_batch = daemon->batch_connections;
+      daemon->batch_connections = connection;
+    }
+    if (daemon->batch_count == daemon->batch_limit) {
+      flush_batch(daemon);
+    }
+  }
+}
+
+static void read_requests(Daemon* daemon, Connection* connection) {
+  ssize_t received = recv(connection->fd, connection->in + connection->in_length, CONNECTION_BUFFER - connection->in_length, 0);
+  if (received > 0) {
+    connection->in_length += received;
+    connection->reading = true;
+    queue_requests(daemon, connection);
+    connection->reading = false;
+  } else if (received == 0) {
+    connection->eof = true;
+  } else if (errno != EAGAIN && errno != EINTR) {
+    connection->failed = true;
+  }
+}
+
+static void accept_connections(Daemon* daemon) {
+  for (;;) {
+    int fd = accept4(daemon->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    Connection* connection = calloc(1, sizeof(Connection));
+    if (connection) {
+      connection->fd = fd;
+      connection->events = EPOLLIN;
+      connection->in = aligned_alloc(64, CONNECTION_BUFFER);
+      connection->out = malloc(CONNECTION_RESPONSES * sizeof(VerifyResponse));
+    }
+    if (!connection || !connection->in || !connection->out || !watch(daemon, fd, EPOLLIN, connection)) {
+      if (connection) {
+        free(connection->in);
+        free(connection->out);
+        free(connection);
+      }
+      close(fd);
+    }
+  }
+}
+
+static int listen_on(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  // A socket file nobody answers on is left over from a daemon that died; one that answers is in use.
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe >= 0 && !connect(probe, (struct sockaddr*)&address, sizeof(address))) {
+    close(probe);
+    close(fd);
+    errno = EADDRINUSE;
+    return -1;
+  }
+  if (probe >= 0) {
+    close(probe);
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) || listen(fd, SOMAXCONN)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  const char* token_path = NULL;
+  const char* socket_path = VERIFY_DEFAULT_SOCKET;
+  static Daemon daemon;
+  daemon.window = OTP_DEFAULT_WINDOW;
+  daemon.batch_limit = 256;
+  daemon.deadline_ns = 200000;
+  size_t cache_entries = 1 << 16;
+  unsigned max_failures = 5, lockout_seconds = 300;
+  const char* audit_directory = NULL;
+  bool huge_pages = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:l:w:b:D:c:L:eHa:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        token_path = optarg;
+        break;
+      case 'l':
+        socket_path = optarg;
+        break;
+      case 'w':
+        daemon.window = option_uint(optarg, OTP_MAX_WINDOW);
+        break;
+      case 'b':
+        daemon.batch_limit = option_uint(optarg, MAX_BATCH);
+        if (!daemon.batch_limit) usage();
+        break;
+      case 'D':
+        daemon.deadline_ns = option_uint(optarg, MAX_DEADLINE_US) * 1000;
+        break;
+      case 'c':
+        cache_entries = option_uint(optarg, MAX_CACHE_ENTRIES); // 0 turns the cache off
+        break;
+      case 'e':
+        daemon.estimating = true;
+        break;
+      case 'H':
+        huge_pages = true;
+        break;
+      case 'a':
+        audit_directory = optarg;
+        break;
+      case 'L': {
+        char* colon = strchr(optarg, ':');
+        if (colon) {
+          *colon = 0;
+        }
+        max_failures = option_uint(optarg, ATTEMPT_LIMITER_MAX_FAILURES);
+        if (max_failures && (!colon || !(lockout_seconds = option_uint(colon + 1, UINT32_MAX)))) usage();
+        break;
+      }
+      default:
+        usage();
+    }
+  }
+  if (!token_path || !strcmp(token_path, "-") || optind != argc) usage();
+
+  // Blocked before the reloader starts, so it inherits the mask and these only ever arrive through the signalfd.
+  sigset_t stop_signals;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGTERM);
+  sigaddset(&stop_signals, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+  daemon.caching = cache_entries != 0;
+  if (daemon.caching && !code_cache_init(&daemon.cache, cache_entries)) {
+    fprintf(stderr, "ptotpd: out of memory\n");
+    return 2;
+  }
+  if (!token_store_init(&daemon.tokens)) return 2;
+  daemon.tokens.huge_pages = huge_pages;
+  if (!token_store_load_path(&daemon.tokens, token_path)) return 2;
+  daemon.reader = token_store_register(&daemon.tokens);
+  if (!daemon.reader) {
+    fprintf(stderr, "ptotpd: no reader slot for the token store\n");
+    return 2;
+  }
+  // Room for about 65536 tokens failing at once, past which the oldest failures start being forgotten.
+  daemon.limiting = max_failures != 0;
+  if (daemon.limiting && !attempt_limiter_init(&daemon.limiter, 1 << 16, max_failures, lockout_seconds, time(NULL))) {
+    fprintf(stderr, "ptotpd: out of memory\n");
+    return 2;
+  }
+  // Sized for the tokens there are now; past that, the ones with the fewest successes are forgotten first.
+  size_t token_count = atomic_load(&daemon.tokens.current)->set.count;
+  if (daemon.estimating && !drift_table_init(&daemon.drift, token_count > 1 << 16 ? token_count : 1 << 16)) {
+    fprintf(stderr, "ptotpd: out of memory\n");
+    return 2;
+  }
+  TokenReloader reloader;
+  if (!token_reloader_start(&reloader, &daemon.tokens, token_path)) {
+    fprintf(stderr, "ptotpd: could not start the reloader\n");
+    return 2;
+  }
+  // After the reloader has blocked SIGHUP, so the writer thread inherits that too.
+  if (audit_directory && (!audit_log_open(&daemon.audit, audit_directory, 0, 0) || !(daemon.audit_ring = audit_log_register(&daemon.audit)))) {
+    fprintf(stderr, "ptotpd: %s: could not open the audit log\n", audit_directory);
+    return 2;
+  }
+
+  daemon.listen_fd = listen_on(socket_path);
+  if (daemon.listen_fd < 0) {
+    fprintf(stderr, "ptotpd: %s: %s\n", socket_path, strerror(errno));
+    return 2;
+  }
+  daemon.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  daemon.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  daemon.signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (daemon.epoll_fd < 0 || daemon.timer_fd < 0 || daemon.signal_fd < 0 ||
+      !watch(&daemon, daemon.listen_fd, EPOLLIN, &listen_marker) ||
+      !watch(&daemon, daemon.timer_fd, EPOLLIN, &timer_marker) ||
+      !watch(&daemon, daemon.signal_fd, EPOLLIN, &signal_marker)) {
+    fprintf(stderr, "ptotpd: %s\n", strerror(errno));
+    unlink(socket_path);
+    return 2;
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  bool running = true;
+  while (running) {
+    int ready = epoll_wait(daemon.epoll_fd, events, MAX_EVENTS, -1);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "ptotpd: %s\n", strerror(errno));
+      break;
+    }
+    for (int i = 0; i < ready; ++i) {
+      void* data = events[i].data.ptr;
+      if (data == &listen_marker) {
+        accept_connections(&daemon);
+      } else if (data == &timer_marker) {
+        uint64_t expirations;
+        if (read(daemon.timer_fd, &expirations, sizeof(expirations)) > 0) {
+          flush_batch(&daemon);
+        }
+      } else if (data == &signal_marker) {
+        running = false;
+      } else {
+        Connection* connection = data;
+        if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+          connection->failed = true;
+        } else if (connection->out_count) {
+          send_responses(connection);
+        } else {
+          read_requests(&daemon, connection);
+        }
+        update_connection(&daemon, connection);
+      }
+    }
+    if (!daemon.deadline_ns) {
+      flush_batch(&daemon);
+    }
+  }
+
+  flush_batch(&daemon);
+  unlink(socket_path);
+  int status = 0;
+  if (daemon.audit_ring && !audit_log_close(&daemon.audit)) {
+    fprintf(stderr, "ptotpd: %s: some audit records could not be written\n", audit_directory);
+    status = 1;
+  }
+  token_reloader_stop(&reloader);
+  fprintf(stderr, "ptotpd: %lu requests in %lu batches\n", (unsigned long)daemon.requests, (unsigned long)daemon.batches);
+  return status;
+}
@@ -0,0 +1,199 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shm_store.h"
+
+#define SHM_STORE_ALIGN 4096
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static size_t slot_size(size_t capacity) {
+  return align_up(sizeof(ShmStoreSlot) + capacity * sizeof(OTPToken), SHM_STORE_ALIGN);
+}
+
+static ShmStoreSlot* slot_at(const ShmStore* store, uint32_t index) {
+  return (ShmStoreSlot*)((char*)store->map + store->header->slot_offset[index & 1]);
+}
+
+static bool header_valid(const ShmStoreHeader* header, size_t length) {
+  if (length < sizeof(ShmStoreHeader) || memcmp(header->magic, SHM_STORE_MAGIC, 8) ||
+      header->version != SHM_STORE_VERSION || header->token_size != sizeof(OTPToken)) {
+    return false;
+  }
+  size_t slot = slot_size(header->capacity);
+  for (int i = 0; i < 2; ++i) {
+    if (header->slot_offset[i] > length || length - header->slot_offset[i] < slot) return false;
+  }
+  return true;
+}
+
+static bool map_segment(ShmStore* store, int fd, bool writable) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) return false;
+  void* map = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) return false;
+  store->fd = fd;
+  store->map = map;
+  store->map_length = st.st_size;
+  store->header = map;
+  store->writable = writable;
+  return true;
+}
+
+static void unmap_segment(ShmStore* store) {
+  if (store->map) {
+    munmap(store->map, store->map_length);
+  }
+  if (store->fd >= 0) {
+    close(store->fd);
+  }
+  store->map = NULL;
+  store->header = NULL;
+  store->fd = -1;
+}
+
+// Puts a fresh, empty segment under name, held by this loader. Anyone still mapping the old one keeps it until they close it.
+static bool create_segment(ShmStore* store, const char* name, size_t capacity) {
+  size_t length = SHM_STORE_ALIGN + 2 * slot_size(capacity);
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return false;
+  if (flock(fd, LOCK_EX | LOCK_NB) < 0 || ftruncate(fd, length) < 0 || !map_segment(store, fd, true)) {
+    close(fd);
+    return false;
+  }
+  ShmStoreHeader* header = store->header;
+  memcpy(header->magic, SHM_STORE_MAGIC, 8);
+  header->version = SHM_STORE_VERSION;
+  header->token_size = sizeof(OTPToken);
+  header->capacity = capacity;
+  header->slot_offset[0] = SHM_STORE_ALIGN;
+  header->slot_offset[1] = SHM_STORE_ALIGN + slot_size(capacity);
+  return true;
+}
+
+bool shm_store_create(ShmStore* store, const char* name, size_t capacity) {
+  memset(store, 0, sizeof(ShmStore));
+  store->fd = -1;
+  snprintf(store->name, sizeof(store->name), "%s", name);
+
+  int fd = shm_open(name, O_RDWR, 0600);
+  if (fd >= 0) {
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+      close(fd);
+      return false;
+    }
+    if (map_segment(store, fd, true)) {
+      if (header_valid(store->header, store->map_length) && store->header->capacity >= capacity) return true;
+      // Too small, or not ours: readers still mapping it are told to reopen, and it makes way for a new one.
+      if (header_valid(store->header, store->map_length)) {
+        atomic_store_explicit(&store->header->retired, 1, memory_order_release);
+      }
+      unmap_segment(store);
+    } else {
+      close(fd);
+    }
+  } else if (errno != ENOENT) {
+    return false;
+  }
+  return create_segment(store, name, capacity);
+}
+
+bool shm_store_open(ShmStore* store, const char* name) {
+  memset(store, 0, sizeof(ShmStore));
+  store->fd = -1;
+  snprintf(store->name, sizeof(store->name), "%s", name);
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return false;
+  if (!map_segment(store, fd, false)) {
+    close(fd);
+    return false;
+  }
+  if (!header_valid(store->header, store->map_length)) {
+    unmap_segment(store);
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+void shm_store_close(ShmStore* store) {
+  unmap_segment(store);
+}
+
+bool shm_store_unlink(const char* name) {
+  return shm_unlink(name) == 0;
+}
+
+bool shm_store_publish(ShmStore* store, const OTPToken* tokens, size_t count) {
+  ShmStoreHeader* header = store->header;
+  if (!store->writable || count > header->capacity) return false;
+
+  uint32_t target = atomic_load_explicit(&header->active, memory_order_relaxed) ^ 1;
+  ShmStoreSlot* slot = slot_at(store, target);
+  // Forced odd rather than counted up from, so a loader that died mid-publish can't leave the parity inverted.
+  uint64_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed) | 1;
+  atomic_store_explicit(&slot->sequence, sequence, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  memcpy(slot->tokens, tokens, count * sizeof(OTPToken));
+  slot->count = count;
+  slot->generation = atomic_load_explicit(&header->generation, memory_order_relaxed) + 1;
+
+  atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+  atomic_store_explicit(&header->active, target, memory_order_release);
+  atomic_store_explicit(&header->generation, slot->generation, memory_order_release);
+  return true;
+}
+
+bool shm_store_lookup(const ShmStore* store, uint32_t id, OTPToken* token) {
+  const ShmStoreHeader* header = store->header;
+  for (;;) {
+    const ShmStoreSlot* slot = slot_at(store, atomic_load_explicit(&header->active, memory_order_acquire));
+    uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (before & 1) continue;
+
+    // The reads below may race the loader; the sequence check afterwards throws away anything torn,
+    // and the count is clamped so a torn one can't send the search outside the slot.
+    size_t count = slot->count;
+    if (count > header->capacity) {
+      count = header->capacity;
+    }
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      if (slot->tokens[mid].id < id) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    bool found = low < count && slot->tokens[low].id == id;
+    if (found) {
+      memcpy(token, &slot->tokens[low], sizeof(OTPToken));
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before) return found;
+  }
+}
@@ -0,0 +1,89 @@
+// Tokens in POSIX shared memory, published by one loader process and read in place by any number of verifiers.
+//
+// The segment holds two slots. The loader fills whichever one isn't active and then flips to it, so
+// readers of the active slot never wait. Each slot carries a sequence count, odd while it's being
+// written. A reader copies the one token it needs and then checks that count didn't move, retrying if
+// it did. That only happens when a reader started on a slot just before the loader began reusing it.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SHM_STORE_H__
+#define SHM_STORE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_token.h"
+
+#define SHM_STORE_DEFAULT_NAME "/ptotp-tokens"
+#define SHM_STORE_MAGIC "pTOTPshm"
+#define SHM_STORE_VERSION 1
+
+typedef struct ShmStoreSlot {
+  _Atomic uint64_t sequence; // Odd while the loader is writing this slot
+  uint64_t count;
+  uint64_t generation; // Of the publish that filled it
+  uint8_t reserved[40];
+  OTPToken tokens[]; // Sorted by ID
+} ShmStoreSlot;
+
+typedef struct ShmStoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t token_size;
+  uint64_t capacity; // Tokens per slot
+  uint64_t slot_offset[2];
+  _Atomic uint32_t active; // Slot readers should use
+  _Atomic uint32_t retired; // Set once the loader has replaced this segment with a larger one
+  _Atomic uint64_t generation; // Count of publishes
+} ShmStoreHeader;
+
+typedef struct ShmStore {
+  char name[64];
+  int fd;
+  void* map;
+  size_t map_length;
+  ShmStoreHeader* header;
+  bool writable;
+} ShmStore;
+
+// Opens the named segment for publishing, creating it - or replacing it, if it can't hold capacity
+// tokens - as need be. Only one loader may hold it at a time; returns false if another does.
+bool shm_store_create(ShmStore* store, const char* name, size_t capacity);
+
+// Maps the named segment read-only.
+bool shm_store_open(ShmStore* store, const char* name);
+
+void shm_store_close(ShmStore* store);
+
+// Removes the name; mappings stay valid until closed.
+bool shm_store_unlink(const char* name);
+
+// Copies tokens, which must be sorted by ID, into the inactive slot and makes it the active one.
+// Returns false if there are more than the segment holds.
+bool shm_store_publish(ShmStore* store, const OTPToken* tokens, size_t count);
+
+// Copies out the token with this ID from the active slot. Lock-free; never blocks the loader.
+bool shm_store_lookup(const ShmStore* store, uint32_t id, OTPToken* token);
+
+static inline uint64_t shm_store_generation(const ShmStore* store) {
+  return atomic_load_explicit(&store->header->generation, memory_order_acquire);
+}
+
+// Whether the loader has moved on to a new segment, which shm_store_open() would pick up.
+static inline bool shm_store_retired(const ShmStore* store) {
+  return atomic_load_explicit(&store->header->retired, memory_order_relaxed);
+}
+
+#endif
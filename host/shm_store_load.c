@@ -0,0 +1,144 @@
+// shm_store_load: publishes a token file into the shared-memory store that verifiers read from.
+//
+//   shm_store_load [-n name] [-c capacity] [-d] tokens   publish (and with -d, stay and republish on SIGHUP)
+//   shm_store_load [-n name] -u                          remove the store
+//
+// tokens is a binary token file or a text one, as ptotp takes.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "shm_store.h"
+#include "token_set.h"
+
+static volatile sig_atomic_t reload_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_signal(int signal) {
+  if (signal == SIGHUP) {
+    reload_requested = 1;
+  } else {
+    stop_requested = 1;
+  }
+}
+
+static void usage(void) {
+  fprintf(stderr,
+    "usage: shm_store_load [-n name] [-c capacity] [-d] tokens\n"
+    "       shm_store_load [-n name] -u\n");
+  exit(2);
+}
+
+// Loads and publishes the token file, growing the segment if it's outgrown it.
+static bool publish(ShmStore* store, const char* name, size_t capacity, const char* path) {
+  OTPTokenSet set;
+  token_set_init(&set);
+  size_t duplicates;
+  if (!token_set_load_path(&set, path) || !token_set_finish(&set, &duplicates)) {
+    fprintf(stderr, "shm_store_load: %s: could not load tokens\n", path);
+    token_set_free(&set);
+    return false;
+  }
+  if (duplicates) {
+    fprintf(stderr, "shm_store_load: %s: %zu duplicate IDs, keeping the last of each\n", path, duplicates);
+  }
+
+  if (!store->map || set.count > store->header->capacity) {
+    if (store->map) {
+      shm_store_close(store);
+    }
+    size_t wanted = set.count > capacity ? set.count + set.count / 4 : capacity;
+    if (!shm_store_create(store, name, wanted)) {
+      fprintf(stderr, "shm_store_load: %s: %s\n", name, errno == EWOULDBLOCK ? "another loader holds it" : strerror(errno));
+      token_set_free(&set);
+      return false;
+    }
+  }
+  bool ok = shm_store_publish(store, set.tokens, set.count);
+  if (ok) {
+    fprintf(stderr, "shm_store_load: published %zu tokens as generation %llu\n", set.count, (unsigned long long)shm_store_generation(store));
+  }
+  token_set_free(&set);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const char* name = SHM_STORE_DEFAULT_NAME;
+  size_t capacity = 0;
+  bool daemon = false;
+  bool unlink_store = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:duh")) != -1) {
+    switch (opt) {
+      case 'n':
+        name = optarg;
+        break;
+      case 'c':
+        capacity = strtoull(optarg, NULL, 10);
+        break;
+      case 'd':
+        daemon = true;
+        break;
+      case 'u':
+        unlink_store = true;
+        break;
+      default:
+        usage();
+    }
+  }
+  if (name[0] != '/' || strlen(name) >= sizeof(((ShmStore*)0)->name)) usage();
+  if (unlink_store) {
+    if (optind != argc) usage();
+    if (!shm_store_unlink(name)) {
+      fprintf(stderr, "shm_store_load: %s: %s\n", name, strerror(errno));
+      return 1;
+    }
+    return 0;
+  }
+  if (optind + 1 != argc) usage();
+  const char* path = argv[optind];
+
+  ShmStore store = {.fd = -1};
+  if (!publish(&store, name, capacity, path)) return 1;
+  if (!daemon) {
+    shm_store_close(&store);
+    return 0;
+  }
+
+  // Signals stay blocked except inside sigsuspend(), so one can't slip in between the checks and the wait.
+  sigset_t blocked, waiting;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGHUP);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  sigprocmask(SIG_BLOCK, &blocked, &waiting);
+  struct sigaction action = {.sa_handler = handle_signal};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGHUP, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  while (!stop_requested) {
+    sigsuspend(&waiting);
+    if (reload_requested) {
+      reload_requested = 0;
+      publish(&store, name, capacity, path);
+    }
+  }
+  shm_store_close(&store);
+  return 0;
+}
@@ -0,0 +1,131 @@
+// Tests for attempt_limiter: lockout after the limit, expiry, and what does and doesn't count towards it.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "attempt_limiter.h"
+#include "check.h"
+
+#define MAX_FAILURES 3
+#define LOCKOUT 60
+#define START 1700000000
+
+static void fail(AttemptLimiter* limiter, uint32_t id, uint64_t now, int times) {
+  for (int i = 0; i < times; ++i) {
+    attempt_limiter_record(limiter, id, now, false);
+  }
+}
+
+static void test_lockout(void) {
+  AttemptLimiter limiter;
+  CHECK(attempt_limiter_init(&limiter, 1000, MAX_FAILURES, LOCKOUT, START));
+  uint64_t now = START + 10;
+  CHECK(attempt_limiter_allow(&limiter, 1, now));
+
+  fail(&limiter, 1, now, MAX_FAILURES - 1);
+  CHECK(attempt_limiter_allow(&limiter, 1, now));
+  fail(&limiter, 1, now, 1);
+  CHECK(!attempt_limiter_allow(&limiter, 1, now));
+  CHECK(!attempt_limiter_allow(&limiter, 1, now + LOCKOUT - 1));
+  CHECK(attempt_limiter_allow(&limiter, 2, now));
+
+  // The lockout runs from the last failure, and once it lapses the count starts again from nothing.
+  CHECK(attempt_limiter_allow(&limiter, 1, now + LOCKOUT));
+  now += LOCKOUT;
+  fail(&limiter, 1, now, MAX_FAILURES - 1);
+  CHECK(attempt_limiter_allow(&limiter, 1, now));
+  fail(&limiter, 1, now + 30, 1);
+  CHECK(!attempt_limiter_allow(&limiter, 1, now + 30 + LOCKOUT - 1));
+  CHECK(attempt_limiter_allow(&limiter, 1, now + 30 + LOCKOUT));
+  attempt_limiter_free(&limiter);
+}
+
+static void test_counting(void) {
+  AttemptLimiter limiter;
+  CHECK(attempt_limiter_init(&limiter, 1000, MAX_FAILURES, LOCKOUT, START));
+
+  // A success wipes out the failures before it.
+  fail(&limiter, 3, START, MAX_FAILURES - 1);
+  attempt_limiter_record(&limiter, 3, START, true);
+  fail(&limiter, 3, START, MAX_FAILURES - 1);
+  CHECK(attempt_limiter_allow(&limiter, 3, START));
+
+  // Failures a lockout or more apart never add up.
+  for (int i = 0; i < MAX_FAILURES * 2; ++i) {
+    fail(&limiter, 4, START + i * LOCKOUT, 1);
+    CHECK(attempt_limiter_allow(&limiter, 4, START + i * LOCKOUT));
+  }
+
+  // Nor do other tokens' failures.
+  for (uint32_t id = 100; id < 200; ++id) {
+    fail(&limiter, id, START, MAX_FAILURES - 1);
+  }
+  for (uint32_t id = 100; id < 200; ++id) {
+    CHECK(attempt_limiter_allow(&limiter, id, START));
+  }
+  attempt_limiter_free(&limiter);
+
+  // With no lockout configured, nothing is ever locked.
+  CHECK(attempt_limiter_init(&limiter, 1000, MAX_FAILURES, 0, START));
+  fail(&limiter, 5, START, MAX_FAILURES * 2);
+  CHECK(attempt_limiter_allow(&limiter, 5, START));
+  attempt_limiter_free(&limiter);
+}
+
+static void test_full_line(void) {
+  // One line: a locked token keeps its slot however many others fail after it.
+  AttemptLimiter limiter;
+  CHECK(attempt_limiter_init(&limiter, 1, MAX_FAILURES, LOCKOUT, START));
+  CHECK(limiter.mask == 0);
+  fail(&limiter, 1, START, MAX_FAILURES);
+  CHECK(!attempt_limiter_allow(&limiter, 1, START + 1));
+  for (uint32_t id = 2; id < 2 + ATTEMPT_LIMITER_SLOTS_PER_LINE; ++id) {
+    fail(&limiter, id, START + id, 1);
+  }
+  CHECK(!attempt_limiter_allow(&limiter, 1, START + 20));
+  CHECK(attempt_limiter_allow(&limiter, 2, START + 20));
+  attempt_limiter_free(&limiter);
+}
+
+static void test_round_robin(void) {
+  // Guesses spread over more tokens than a line holds: the ones without a slot share the line's overflow
+  // count, so every one of them is locked after about as many guesses as a single token would get.
+  AttemptLimiter limiter;
+  CHECK(attempt_limiter_init(&limiter, 1, MAX_FAILURES, LOCKOUT, START));
+  const uint32_t ids = ATTEMPT_LIMITER_SLOTS_PER_LINE + 1;
+  unsigned allowed = 0;
+  for (uint64_t now = START; now < START + LOCKOUT - 1; ++now) {
+    for (uint32_t id = 1; id <= ids; ++id) {
+      if (attempt_limiter_allow(&limiter, id, now)) {
+        allowed++;
+        attempt_limiter_record(&limiter, id, now, false);
+      }
+    }
+  }
+  CHECK(allowed <= (ATTEMPT_LIMITER_TOKEN_SLOTS + 1) * MAX_FAILURES);
+  for (uint32_t id = 1; id <= ids; ++id) {
+    CHECK(!attempt_limiter_allow(&limiter, id, START + LOCKOUT - 1));
+  }
+  // Each lockout still lapses lockout seconds after the last failure counted against it.
+  for (uint32_t id = 1; id <= ids; ++id) {
+    CHECK(attempt_limiter_allow(&limiter, id, START + 2 * LOCKOUT));
+  }
+  attempt_limiter_free(&limiter);
+}
+
+int main(void) {
+  test_lockout();
+  test_counting();
+  test_full_line();
+  test_round_robin();
+  return check_result("test_attempt_limiter");
+}
@@ -0,0 +1,137 @@
+// Tests for audit_log: records from several threads all reach disk, each thread's in order, across
+// segment rotations, and a reopened log carries on numbering after the last segment.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "audit_log.h"
+#include "check.h"
+
+#define THREADS 4
+#define RECORDS_PER_THREAD 100000 // More than a ring holds, so appends have to wait on the writer too
+#define SEGMENT_BYTES (256 << 10)
+
+typedef struct Appender {
+  pthread_t thread;
+  AuditLog* log;
+  uint32_t id;
+} Appender;
+
+static void* append_records(void* context) {
+  Appender* appender = context;
+  AuditRing* ring = audit_log_register(appender->log);
+  CHECK(ring != NULL);
+  if (!ring) return NULL;
+  for (uint64_t i = 0; i < RECORDS_PER_THREAD; ++i) {
+    audit_log_append(ring, appender->id, 1000 + i, i % 3 - 1, i % 4);
+  }
+  return NULL;
+}
+
+typedef struct Segments {
+  uint64_t first;
+  uint64_t last;
+  size_t count;
+  size_t short_count; // Segments holding less than SEGMENT_BYTES of records
+} Segments;
+
+// Reads every segment in directory, in number order, checking each thread's records come back complete
+// and in order; next[id] is the next step expected from thread id.
+static Segments read_segments(const char* directory, uint64_t* next) {
+  Segments segments = {UINT64_MAX, 0, 0, 0};
+  for (uint64_t number = 0; number < 10000; ++number) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/audit-%010llu.log", directory, (unsigned long long)number);
+    FILE* file = fopen(path, "rb");
+    if (!file) continue;
+    AuditSegmentHeader header;
+    CHECK(fread(&header, sizeof(header), 1, file) == 1);
+    CHECK(!memcmp(header.magic, AUDIT_LOG_MAGIC, sizeof(header.magic)));
+    CHECK(header.version == AUDIT_LOG_VERSION && header.record_size == sizeof(AuditRecord));
+    CHECK(header.segment == number);
+    AuditRecord record;
+    size_t bytes = 0;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+      CHECK(record.id < THREADS);
+      if (record.id >= THREADS) break;
+      uint64_t i = next[record.id] - 1000;
+      CHECK(record.step == next[record.id] + record.offset);
+      CHECK(record.offset == (int)(i % 3) - 1 && record.result == i % 4);
+      next[record.id]++;
+      bytes += sizeof(record);
+    }
+    fclose(file);
+    segments.short_count += bytes < SEGMENT_BYTES;
+    if (number < segments.first) {
+      segments.first = number;
+    }
+    segments.last = number;
+    segments.count++;
+  }
+  return segments;
+}
+
+int main(void) {
+  char directory[] = "/tmp/ptotp-audit-XXXXXX";
+  CHECK(mkdtemp(directory) != NULL);
+
+  AuditLog log;
+  CHECK(audit_log_open(&log, directory, SEGMENT_BYTES, 1));
+  Appender appenders[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    appenders[i] = (Appender){.log = &log, .id = i};
+    CHECK(!pthread_create(&appenders[i].thread, NULL, append_records, &appenders[i]));
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(appenders[i].thread, NULL);
+  }
+  CHECK(audit_log_close(&log));
+
+  uint64_t next[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    next[i] = 1000;
+  }
+  Segments segments = read_segments(directory, next);
+  for (int i = 0; i < THREADS; ++i) {
+    CHECK(next[i] == 1000 + RECORDS_PER_THREAD);
+  }
+  // A segment is only cut once a commit takes it past the limit, so only the last can be short; how far
+  // past depends on how much the rings held, so that bounds the count from above only.
+  size_t bytes = THREADS * RECORDS_PER_THREAD * sizeof(AuditRecord);
+  CHECK(segments.count > 1 && segments.count <= bytes / SEGMENT_BYTES + 1);
+  CHECK(segments.short_count <= 1);
+  CHECK(segments.last - segments.first + 1 == segments.count);
+
+  // Reopening starts the next segment rather than appending to or overwriting the last.
+  CHECK(audit_log_open(&log, directory, SEGMENT_BYTES, 1));
+  CHECK(log.segment == segments.last + 1);
+  AuditRing* ring = audit_log_register(&log);
+  CHECK(ring != NULL);
+  if (ring) {
+    uint64_t i = next[0] - 1000;
+    audit_log_append(ring, 0, next[0], i % 3 - 1, i % 4);
+  }
+  CHECK(audit_log_close(&log));
+  Segments reopened = read_segments(directory, (uint64_t[THREADS]){1000, 1000, 1000, 1000});
+  CHECK(reopened.last == segments.last + 1 && reopened.count == segments.count + 1);
+
+  char command[128];
+  snprintf(command, sizeof(command), "rm -rf %s", directory);
+  CHECK(!system(command));
+  return check_result("test_audit_log");
+}
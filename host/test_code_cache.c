@@ -0,0 +1,101 @@
+// Tests for code_cache: hits and misses by token, step and epoch, and that readers racing writers never
+// see one entry's key with another's hash.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <stdio.h>
+#include "check.h"
+#include "code_cache.h"
+
+#define RACE_ROUNDS 2000000
+#define RACE_IDS 64 // Few enough that the writer and reader keep meeting in the same buckets
+
+static uint32_t hash_of(uint64_t epoch, uint32_t id, uint64_t step) {
+  return (uint32_t)((epoch * 0x9E3779B97F4A7C15ULL ^ (uint64_t)id << 20 ^ step) * 0xBF58476D1CE4E5B9ULL >> 33);
+}
+
+static void test_lookup(void) {
+  CodeCache cache;
+  CHECK(code_cache_init(&cache, 1024));
+  uint32_t hash = 0;
+  CHECK(!code_cache_lookup(&cache, 1, 7, 100, &hash));
+
+  code_cache_store(&cache, 1, 7, 100, 12345);
+  CHECK(code_cache_lookup(&cache, 1, 7, 100, &hash) && hash == 12345);
+  CHECK(!code_cache_lookup(&cache, 1, 7, 101, &hash));
+  CHECK(!code_cache_lookup(&cache, 1, 8, 100, &hash));
+
+  // A reload's new epoch misses everything cached before it, and its own entries replace the old.
+  CHECK(!code_cache_lookup(&cache, 2, 7, 100, &hash));
+  code_cache_store(&cache, 2, 7, 100, 54321);
+  CHECK(code_cache_lookup(&cache, 2, 7, 100, &hash) && hash == 54321);
+
+  // Epoch 0 is reserved for a zeroed table, so it's never stored or found.
+  code_cache_store(&cache, 0, 9, 100, 1);
+  CHECK(!code_cache_lookup(&cache, 0, 9, 100, &hash));
+  CHECK(!code_cache_lookup(&cache, 0, 0, 0, &hash));
+
+  // Filling a one-bucket cache evicts the oldest step first.
+  code_cache_free(&cache);
+  CHECK(code_cache_init(&cache, CODE_CACHE_WAYS));
+  for (uint64_t step = 100; step < 100 + CODE_CACHE_WAYS; ++step) {
+    code_cache_store(&cache, 1, 7, step, hash_of(1, 7, step));
+  }
+  code_cache_store(&cache, 1, 7, 200, hash_of(1, 7, 200));
+  CHECK(!code_cache_lookup(&cache, 1, 7, 100, &hash));
+  CHECK(code_cache_lookup(&cache, 1, 7, 200, &hash) && hash == hash_of(1, 7, 200));
+  CHECK(code_cache_lookup(&cache, 1, 7, 101, &hash) && hash == hash_of(1, 7, 101));
+  code_cache_free(&cache);
+}
+
+static void* store_codes(void* context) {
+  CodeCache* cache = context;
+  for (uint64_t i = 0; i < RACE_ROUNDS; ++i) {
+    uint64_t epoch = 1 + i / (RACE_ROUNDS / 8);
+    uint32_t id = i % RACE_IDS;
+    uint64_t step = i / RACE_IDS % 4;
+    code_cache_store(cache, epoch, id, step, hash_of(epoch, id, step));
+  }
+  return NULL;
+}
+
+static void test_race(void) {
+  CodeCache cache;
+  CHECK(code_cache_init(&cache, 16));
+  pthread_t writer;
+  CHECK(!pthread_create(&writer, NULL, store_codes, &cache));
+  size_t hits = 0, torn = 0;
+  for (uint64_t i = 0; i < RACE_ROUNDS; ++i) {
+    uint64_t epoch = 1 + i % 8;
+    uint32_t id = i % RACE_IDS;
+    uint64_t step = i / RACE_IDS % 4;
+    uint32_t hash;
+    if (code_cache_lookup(&cache, epoch, id, step, &hash)) {
+      hits++;
+      torn += hash != hash_of(epoch, id, step);
+    }
+  }
+  pthread_join(writer, NULL);
+  CHECK(torn == 0);
+  if (torn) {
+    fprintf(stderr, "test_code_cache: %zu of %zu hits had another entry's hash\n", torn, hits);
+  }
+  code_cache_free(&cache);
+}
+
+int main(void) {
+  test_lookup();
+  test_race();
+  return check_result("test_code_cache");
+}
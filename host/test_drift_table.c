@@ -0,0 +1,92 @@
+// Tests for drift_table and otp_verify_tracked(): the order steps are tried in, and that a token whose
+// clock is corrected is still accepted.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "check.h"
+#include "drift_table.h"
+#include "otp_stats.h"
+#include "otp_verify.h"
+
+#define WINDOW 5
+#define NOW_STEP 1000000
+
+static void test_plan_order(void) {
+  DriftTable table;
+  CHECK(drift_table_init(&table, 16));
+  int offsets[WINDOW * 2 + 1];
+
+  // Unknown tokens go outwards from now.
+  static const int fresh[] = {0, -1, 1, -2, 2, -3, 3, -4, 4, -5, 5};
+  CHECK(drift_table_plan(&table, 7, WINDOW, offsets) == WINDOW * 2 + 1);
+  CHECK(!memcmp(offsets, fresh, sizeof(fresh)));
+
+  for (int i = 0; i < 8; ++i) {
+    drift_table_record(&table, 7, -3);
+  }
+  static const int settled[] = {-3, -2, -4, -1, -5, 0, 1, 2, 3, 4, 5};
+  CHECK(drift_table_plan(&table, 7, WINDOW, offsets) == WINDOW * 2 + 1);
+  CHECK(!memcmp(offsets, settled, sizeof(settled)));
+
+  // Other tokens are untouched.
+  drift_table_plan(&table, 8, WINDOW, offsets);
+  CHECK(!memcmp(offsets, fresh, sizeof(fresh)));
+
+  // A plan never reaches past the window it's asked for.
+  CHECK(drift_table_plan(&table, 7, 1, offsets) == 3);
+  CHECK(offsets[0] == -1 && offsets[1] == 0 && offsets[2] == 1);
+  drift_table_free(&table);
+}
+
+static void test_corrected_clock(void) {
+  OTPToken token;
+  uint8_t key[20] = "12345678901234567890";
+  CHECK(otp_token_init(&token, 42, key, sizeof(key), 6, OTPAlgorithmSHA1, 30));
+  DriftTable table;
+  CHECK(drift_table_init(&table, 16));
+  int offset;
+  for (int i = 0; i < 8; ++i) {
+    CHECK(otp_verify_tracked(&token, otp_token_code(&token, NOW_STEP + i - 3), NOW_STEP + i, WINDOW, NULL, 0, &table, &offset));
+    CHECK(offset == -3);
+  }
+  OTPStats before, after;
+  otp_stats_snapshot(&before);
+  CHECK(otp_verify_tracked(&token, otp_token_code(&token, NOW_STEP + 100 - 3), NOW_STEP + 100, WINDOW, NULL, 0, &table, &offset));
+  otp_stats_snapshot(&after);
+  CHECK(after.codes_generated - before.codes_generated == 2); // The code's own hash and the check's, which came first
+
+  // The phone syncs its clock: its codes are now for the current step, the last the plan's mean puts first.
+  for (int i = 0; i < 20; ++i) {
+    uint64_t step = NOW_STEP + 200 + i;
+    CHECK(otp_verify_tracked(&token, otp_token_code(&token, step), step, WINDOW, NULL, 0, &table, &offset));
+    CHECK(offset == 0);
+  }
+  int offsets[WINDOW * 2 + 1];
+  drift_table_plan(&table, 42, WINDOW, offsets);
+  CHECK(offsets[0] == 0);
+
+  // Whatever the estimate, exactly the codes otp_verify() takes are taken.
+  for (int shift = -WINDOW - 1; shift <= WINDOW + 1; ++shift) {
+    uint64_t step = NOW_STEP + 300;
+    uint32_t code = otp_token_code(&token, step + shift);
+    CHECK(otp_verify_tracked(&token, code, step, WINDOW, NULL, 0, &table, NULL) == otp_verify(&token, code, step, WINDOW, NULL));
+  }
+  drift_table_free(&table);
+}
+
+int main(void) {
+  test_plan_order();
+  test_corrected_clock();
+  return check_result("test_drift_table");
+}
@@ -0,0 +1,109 @@
+// Tests for otp_batch: sorting keeps repeats in arrival order, and batch lookups of present and missing
+// IDs agree with token_set_find() for sets and batches of every awkward size.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "check.h"
+#include "otp_batch.h"
+
+#define MAX_BATCH 300
+
+static uint64_t random_state = 0x853C49E6748FEA9BULL;
+
+static uint32_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return (uint32_t)random_state;
+}
+
+// IDs spread over all four bytes, so the sort can't skip any of them.
+static uint32_t id_of(size_t i) {
+  return (uint32_t)(i * 2 * 0x01010101u + 2);
+}
+
+static void make_set(OTPTokenSet* set, size_t count) {
+  token_set_init(set);
+  uint8_t key[20] = {0};
+  for (size_t i = 0; i < count; ++i) {
+    OTPToken* token = token_set_append(set);
+    CHECK(token != NULL);
+    if (!token) return;
+    otp_token_init(token, id_of(count - 1 - i), key, sizeof(key), 0, OTPAlgorithmSHA1, 0);
+  }
+  CHECK(token_set_finish(set, NULL));
+}
+
+// A batch of IDs from the set and just beside them, plus the extremes, with repeats.
+static void make_batch(OTPBatchItem* items, size_t count, size_t set_count) {
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t id;
+    switch (next_random() % 6) {
+      case 0: id = 0; break;
+      case 1: id = UINT32_MAX; break;
+      case 2: id = i ? items[next_random() % i].id : 1; break;
+      default: id = id_of(set_count ? next_random() % set_count : 0) + next_random() % 3 - 1; break;
+    }
+    items[i] = (OTPBatchItem){.id = id, .index = i};
+  }
+}
+
+static void check_batch(const OTPTokenSet* set, size_t count) {
+  OTPBatchItem items[MAX_BATCH], scratch[MAX_BATCH];
+  make_batch(items, count, set->count);
+  otp_batch_sort(items, count, scratch);
+  for (size_t i = 1; i < count; ++i) {
+    CHECK(items[i - 1].id < items[i].id || (items[i - 1].id == items[i].id && items[i - 1].index < items[i].index));
+  }
+  otp_batch_lookup(set, items, count);
+  for (size_t i = 0; i < count; ++i) {
+    CHECK(items[i].token == token_set_find(set, items[i].id));
+  }
+}
+
+static void test_lookup(void) {
+  static const size_t set_counts[] = {0, 1, 2, 3, 15, 16, 17, 1000, 4099};
+  static const size_t batch_counts[] = {0, 1, OTP_BATCH_GROUP - 1, OTP_BATCH_GROUP, OTP_BATCH_GROUP + 1, MAX_BATCH};
+  for (size_t s = 0; s < sizeof(set_counts) / sizeof(set_counts[0]); ++s) {
+    OTPTokenSet set;
+    make_set(&set, set_counts[s]);
+    for (size_t b = 0; b < sizeof(batch_counts) / sizeof(batch_counts[0]); ++b) {
+      check_batch(&set, batch_counts[b]);
+    }
+    // The same answers once the tokens have moved onto huge pages.
+    CHECK(token_set_use_huge_pages(&set));
+    check_batch(&set, MAX_BATCH);
+    token_set_free(&set);
+  }
+}
+
+static void test_present_and_missing(void) {
+  OTPTokenSet set;
+  make_set(&set, 100);
+  OTPBatchItem items[4] = {{.id = id_of(99)}, {.id = id_of(0) - 1}, {.id = id_of(0)}, {.id = id_of(50) + 1}};
+  OTPBatchItem scratch[4];
+  otp_batch_sort(items, 4, scratch);
+  otp_batch_lookup(&set, items, 4);
+  CHECK(items[0].id == id_of(0) - 1 && items[0].token == NULL);
+  CHECK(items[1].id == id_of(0) && items[1].token && items[1].token->id == id_of(0));
+  CHECK(items[2].id == id_of(50) + 1 && items[2].token == NULL);
+  CHECK(items[3].id == id_of(99) && items[3].token && items[3].token->id == id_of(99));
+  token_set_free(&set);
+}
+
+int main(void) {
+  test_present_and_missing();
+  test_lookup();
+  return check_result("test_otp_batch");
+}
@@ -0,0 +1,103 @@
+// Tests for the host side of otp_stats: snapshots sum every thread's counts, keep those of threads that have
+// exited, never go backwards while threads are counting, and don't wrap at 32 bits.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "check.h"
+#include "otp_stats.h"
+#include "otp_token.h"
+
+#define THREADS 4
+#define ROUNDS 200000
+
+static void* count(void* context) {
+  (void)context;
+  for (int i = 0; i < ROUNDS; ++i) {
+    OTP_STATS_INC(codes_generated);
+  }
+  return NULL;
+}
+
+static void run_threads(void) {
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; ++i) {
+    CHECK(!pthread_create(&threads[i], NULL, count, NULL));
+  }
+  for (int i = 0; i < THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static void test_totals(void) {
+  OTPStats before, after;
+  otp_stats_snapshot(&before);
+  run_threads();
+  otp_stats_snapshot(&after);
+  CHECK(after.codes_generated - before.codes_generated == (uint64_t)THREADS * ROUNDS);
+
+  // Threads started after those exited take over their blocks, and carry on from what they'd counted.
+  run_threads();
+  otp_stats_snapshot(&after);
+  CHECK(after.codes_generated - before.codes_generated == 2ull * THREADS * ROUNDS);
+
+  // Real hashing counts on whichever thread does it.
+  uint8_t key[20] = {0};
+  OTPToken token;
+  CHECK(otp_token_init(&token, 1, key, sizeof(key), 6, OTPAlgorithmSHA1, 30));
+  otp_stats_snapshot(&before);
+  otp_token_code(&token, 1);
+  otp_stats_snapshot(&after);
+  CHECK(after.codes_generated - before.codes_generated == 1);
+  CHECK(after.compressions > before.compressions);
+}
+
+static void* watch_totals(void* context) {
+  _Atomic bool* stopping = context;
+  uint64_t last = 0;
+  bool done;
+  do {
+    done = atomic_load(stopping);
+    OTPStats totals;
+    otp_stats_snapshot(&totals);
+    CHECK(totals.codes_generated >= last);
+    last = totals.codes_generated;
+  } while (!done);
+  return NULL;
+}
+
+static void test_racing_snapshots(void) {
+  _Atomic bool stopping = false;
+  pthread_t watcher;
+  CHECK(!pthread_create(&watcher, NULL, watch_totals, &stopping));
+  run_threads();
+  atomic_store(&stopping, true);
+  pthread_join(watcher, NULL);
+}
+
+static void test_wide(void) {
+  OTPStats before, after;
+  otp_stats_snapshot(&before);
+  OTP_STATS_ADD(persist_bytes, UINT32_MAX);
+  OTP_STATS_ADD(persist_bytes, UINT32_MAX);
+  otp_stats_snapshot(&after);
+  CHECK(after.persist_bytes - before.persist_bytes == 2ull * UINT32_MAX);
+}
+
+int main(void) {
+  test_totals();
+  test_racing_snapshots();
+  test_wide();
+  return check_result("test_otp_stats");
+}
@@ -0,0 +1,98 @@
+// Tests for shm_store: publish and lookup, and publishing again after a loader died part way through.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "shm_store.h"
+
+#define TOKENS 100
+
+static OTPToken tokens[TOKENS];
+
+static void make_tokens(uint32_t first_id) {
+  for (int i = 0; i < TOKENS; ++i) {
+    uint8_t key[20];
+    memset(key, i, sizeof(key));
+    otp_token_init(&tokens[i], first_id + i * 2, key, sizeof(key), 0, OTPAlgorithmSHA1, 0);
+  }
+}
+
+static ShmStoreSlot* inactive_slot(ShmStore* store) {
+  uint32_t inactive = atomic_load(&store->header->active) ^ 1;
+  return (ShmStoreSlot*)((char*)store->map + store->header->slot_offset[inactive]);
+}
+
+static void test_publish(const char* name) {
+  ShmStore loader;
+  CHECK(shm_store_create(&loader, name, TOKENS));
+  make_tokens(10);
+  CHECK(shm_store_publish(&loader, tokens, TOKENS));
+
+  ShmStore reader;
+  CHECK(shm_store_open(&reader, name));
+  OTPToken found;
+  CHECK(shm_store_lookup(&reader, 10, &found) && !memcmp(&found, &tokens[0], sizeof(OTPToken)));
+  CHECK(shm_store_lookup(&reader, 10 + (TOKENS - 1) * 2, &found));
+  CHECK(!shm_store_lookup(&reader, 11, &found));
+  CHECK(shm_store_generation(&reader) == 1);
+
+  // A second loader is turned away while the first holds the segment.
+  ShmStore second;
+  CHECK(!shm_store_create(&second, name, TOKENS));
+
+  make_tokens(1000);
+  CHECK(shm_store_publish(&loader, tokens, TOKENS));
+  CHECK(!shm_store_lookup(&reader, 10, &found));
+  CHECK(shm_store_lookup(&reader, 1000, &found));
+  CHECK(!shm_store_publish(&loader, tokens, TOKENS + 1));
+  shm_store_close(&reader);
+  shm_store_close(&loader);
+}
+
+static void test_publish_after_crash(const char* name) {
+  ShmStore loader;
+  CHECK(shm_store_create(&loader, name, TOKENS));
+  // As a loader killed between marking the inactive slot and finishing its copy leaves it.
+  ShmStoreSlot* slot = inactive_slot(&loader);
+  atomic_store(&slot->sequence, atomic_load(&slot->sequence) + 1);
+  CHECK(atomic_load(&slot->sequence) & 1);
+  shm_store_close(&loader);
+
+  CHECK(shm_store_create(&loader, name, TOKENS));
+  make_tokens(5000);
+  CHECK(shm_store_publish(&loader, tokens, TOKENS));
+  ShmStore reader;
+  CHECK(shm_store_open(&reader, name));
+  const ShmStoreSlot* active = (const ShmStoreSlot*)((char*)reader.map + reader.header->slot_offset[atomic_load(&reader.header->active)]);
+  CHECK(!(atomic_load(&active->sequence) & 1));
+  // A lookup that spins on an odd sequence never returns; the alarm turns that into a failure.
+  alarm(5);
+  OTPToken found;
+  CHECK(shm_store_lookup(&reader, 5000, &found));
+  alarm(0);
+  shm_store_close(&reader);
+  shm_store_close(&loader);
+}
+
+int main(void) {
+  char name[64];
+  snprintf(name, sizeof(name), "/ptotp-test-%d", (int)getpid());
+  test_publish(name);
+  test_publish_after_crash(name);
+  shm_store_unlink(name);
+  return check_result("test_shm_store");
+}
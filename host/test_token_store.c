@@ -0,0 +1,203 @@
+// Tests for token_store and token_reloader: updates add, replace and remove tokens, and readers racing a
+// SIGHUP reloader only ever see whole snapshots, each no older than the last.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "check.h"
+#include "token_reloader.h"
+
+#define TOKENS 64 // In each version of the token file
+#define RELOADS 50
+#define READERS 2
+
+static void add_token(OTPTokenSet* set, uint32_t id, int digits) {
+  uint8_t key[20];
+  memset(key, id, sizeof(key));
+  OTPToken* token = token_set_append(set);
+  CHECK(token != NULL);
+  if (token) {
+    otp_token_init(token, id, key, sizeof(key), digits, OTPAlgorithmSHA1, 0);
+  }
+}
+
+static void test_update(void) {
+  TokenStore store;
+  CHECK(token_store_init(&store));
+  TokenStoreReader* reader = token_store_register(&store);
+  CHECK(reader != NULL);
+  if (!reader) return;
+  const TokenSnapshot* snapshot = token_store_enter(&store, reader);
+  CHECK(snapshot->set.count == 0);
+  token_store_exit(reader);
+
+  OTPTokenSet set;
+  token_set_init(&set);
+  for (uint32_t id = 1; id <= 10; ++id) {
+    add_token(&set, id, 6);
+  }
+  CHECK(token_set_finish(&set, NULL) && token_store_publish(&store, &set));
+
+  // Added in place of an existing token, added new, and removed - including an ID that isn't there.
+  OTPTokenSet added;
+  token_set_init(&added);
+  add_token(&added, 5, 8);
+  add_token(&added, 20, 6);
+  CHECK(token_set_finish(&added, NULL));
+  const uint32_t removed[] = {2, 3, 15};
+  CHECK(token_store_update(&store, added.tokens, added.count, removed, 3));
+  token_set_free(&added);
+
+  snapshot = token_store_enter(&store, reader);
+  const OTPTokenSet* current = &snapshot->set;
+  CHECK(current->count == 9);
+  CHECK(!token_set_find(current, 2) && !token_set_find(current, 3) && !token_set_find(current, 15));
+  CHECK(token_set_find(current, 1) && token_set_find(current, 1)->digits == 6);
+  CHECK(token_set_find(current, 5) && token_set_find(current, 5)->digits == 8);
+  CHECK(token_set_find(current, 20) != NULL);
+  for (size_t i = 1; i < current->count; ++i) {
+    CHECK(current->tokens[i - 1].id < current->tokens[i].id);
+  }
+  uint64_t generation = snapshot->generation;
+  token_store_exit(reader);
+
+  // The snapshot a reader is in outlives publishes until it leaves, then goes on the next reclaim.
+  snapshot = token_store_enter(&store, reader);
+  const uint32_t first[] = {1};
+  CHECK(token_store_update(&store, NULL, 0, first, 1));
+  CHECK(token_store_reclaim(&store) >= 1);
+  CHECK(snapshot->generation == generation && token_set_find(&snapshot->set, 1) && snapshot->set.count == 9);
+  token_store_exit(reader);
+  CHECK(token_store_reclaim(&store) == 0);
+  snapshot = token_store_enter(&store, reader);
+  CHECK(snapshot->generation == generation + 1 && !token_set_find(&snapshot->set, 1) && snapshot->set.count == 8);
+  token_store_exit(reader);
+
+  token_store_unregister(reader);
+  token_store_destroy(&store);
+}
+
+typedef struct Reader {
+  pthread_t thread;
+  TokenStore* store;
+  _Atomic bool* stopping;
+  size_t snapshots; // Seen with the tokens of some version of the file
+} Reader;
+
+// Version v of the file holds IDs v * TOKENS onwards, every one with a period of 10 + v, so any mix of
+// two versions shows.
+static uint32_t snapshot_version(const OTPTokenSet* set) {
+  if (set->count != TOKENS) return 0;
+  uint32_t version = set->tokens[0].id / TOKENS;
+  for (uint32_t i = 0; i < TOKENS; ++i) {
+    if (set->tokens[i].id != version * TOKENS + i || set->tokens[i].period != 10 + version) return UINT32_MAX;
+  }
+  const OTPToken* middle = token_set_find(set, version * TOKENS + TOKENS / 2);
+  return middle && middle->period == 10 + version ? version : UINT32_MAX;
+}
+
+static void* read_tokens(void* context) {
+  Reader* state = context;
+  TokenStoreReader* reader = token_store_register(state->store);
+  CHECK(reader != NULL);
+  if (!reader) return NULL;
+  uint32_t last = 0;
+  while (!atomic_load(state->stopping)) {
+    const TokenSnapshot* snapshot = token_store_enter(state->store, reader);
+    uint32_t version = snapshot_version(&snapshot->set);
+    token_store_exit(reader);
+    CHECK(version != UINT32_MAX && version >= last);
+    if (version == UINT32_MAX) break;
+    state->snapshots += version > 0;
+    last = version;
+    sched_yield();
+  }
+  token_store_unregister(reader);
+  return NULL;
+}
+
+static void write_version(const char* path, uint32_t version) {
+  char temporary[256];
+  snprintf(temporary, sizeof(temporary), "%s.new", path);
+  FILE* file = fopen(temporary, "w");
+  CHECK(file != NULL);
+  if (!file) return;
+  for (uint32_t i = 0; i < TOKENS; ++i) {
+    fprintf(file, "%u JBSWY3DPEHPK3PXP 6 sha1 %u\n", version * TOKENS + i, 10 + version);
+  }
+  CHECK(!fclose(file));
+  // Renamed into place, as a deployment would, so a reload never reads half a file.
+  CHECK(!rename(temporary, path));
+}
+
+static void test_reload(void) {
+  char path[] = "/tmp/ptotp-tokens-XXXXXX";
+  int fd = mkstemp(path);
+  CHECK(fd >= 0);
+  close(fd);
+
+  TokenStore store;
+  TokenReloader reloader;
+  _Atomic bool stopping = false;
+  CHECK(token_store_init(&store));
+  // Started first, so every thread after it has SIGHUP blocked and the reloader's thread takes them all.
+  CHECK(token_reloader_start(&reloader, &store, path));
+  Reader readers[READERS];
+  for (int i = 0; i < READERS; ++i) {
+    readers[i] = (Reader){.store = &store, .stopping = &stopping};
+    CHECK(!pthread_create(&readers[i].thread, NULL, read_tokens, &readers[i]));
+  }
+
+  TokenStoreReader* reader = token_store_register(&store);
+  CHECK(reader != NULL);
+  alarm(30); // A reload that never lands shows up as a failure rather than a hang.
+  for (uint32_t version = 1; version <= RELOADS && reader; ++version) {
+    write_version(path, version);
+    CHECK(!kill(getpid(), SIGHUP));
+    uint32_t seen;
+    do {
+      sched_yield();
+      seen = snapshot_version(&token_store_enter(&store, reader)->set);
+      token_store_exit(reader);
+    } while (seen != version && seen != UINT32_MAX);
+    CHECK(seen == version);
+  }
+  alarm(0);
+  if (reader) {
+    token_store_unregister(reader);
+  }
+
+  atomic_store(&stopping, true);
+  size_t snapshots = 0;
+  for (int i = 0; i < READERS; ++i) {
+    pthread_join(readers[i].thread, NULL);
+    snapshots += readers[i].snapshots;
+  }
+  token_reloader_stop(&reloader);
+  CHECK(snapshots > 0);
+  // Every retired snapshot can go once the readers have left.
+  CHECK(token_store_reclaim(&store) == 0);
+  token_store_destroy(&store);
+  unlink(path);
+}
+
+int main(void) {
+  test_update();
+  test_reload();
+  return check_result("test_token_store");
+}
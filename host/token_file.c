@@ -0,0 +1,71 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "token_file.h"
+
+void token_file_header(TokenFileHeader* header) {
+  memset(header, 0, sizeof(TokenFileHeader));
+  memcpy(header->magic, TOKEN_FILE_MAGIC, sizeof(header->magic));
+  header->version = TOKEN_FILE_VERSION;
+  header->record_size = sizeof(TokenFileRecord);
+}
+
+bool token_file_detect(const void* data, size_t length) {
+  return length >= sizeof(TokenFileHeader) && !memcmp(data, TOKEN_FILE_MAGIC, 8);
+}
+
+bool token_file_open(TokenFile* file, const char* path) {
+  memset(file, 0, sizeof(TokenFile));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+  if ((size_t)st.st_size < sizeof(TokenFileHeader)) {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  const TokenFileHeader* header = map;
+  size_t body = st.st_size - sizeof(TokenFileHeader);
+  if (!token_file_detect(map, st.st_size) || header->version != TOKEN_FILE_VERSION ||
+      header->record_size != sizeof(TokenFileRecord) || body % sizeof(TokenFileRecord)) {
+    munmap(map, st.st_size);
+    errno = EINVAL;
+    return false;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  file->map = map;
+  file->map_length = st.st_size;
+  file->records = (const TokenFileRecord*)((const char*)map + sizeof(TokenFileHeader));
+  file->count = body / sizeof(TokenFileRecord);
+  return true;
+}
+
+void token_file_close(TokenFile* file) {
+  if (file->map) {
+    munmap(file->map, file->map_length);
+  }
+  memset(file, 0, sizeof(TokenFile));
+}
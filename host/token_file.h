@@ -0,0 +1,65 @@
+// The binary token file: a header, then fixed-size records, meant to be mapped and used in place.
+// Integers are little-endian, as on every host this is built for. The record count follows from the
+// file size, so a writer can stream records without seeking back.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_FILE_H__
+#define TOKEN_FILE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "otp_token.h"
+
+#define TOKEN_FILE_MAGIC "pTOTPtok"
+#define TOKEN_FILE_VERSION 1
+
+typedef struct TokenFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size; // sizeof(TokenFileRecord) when written
+} TokenFileHeader;
+
+typedef enum TokenFileType {
+  TokenFileTOTP = 0,
+  TokenFileHOTP = 1
+} TokenFileType;
+
+typedef struct TokenFileRecord {
+  OTPToken token; // First, so a record can be used as a token directly
+  uint64_t counter; // Next counter, for HOTP
+  uint8_t type; // TokenFileType
+  uint8_t reserved[7];
+} TokenFileRecord;
+
+_Static_assert(sizeof(TokenFileHeader) == 16, "token file header layout changed");
+_Static_assert(sizeof(TokenFileRecord) == 88, "token file record layout changed");
+
+typedef struct TokenFile {
+  void* map;
+  size_t map_length;
+  const TokenFileRecord* records;
+  size_t count;
+} TokenFile;
+
+void token_file_header(TokenFileHeader* header);
+
+// Whether a file starts with the token file magic - so tools can take either this or text tokens.
+bool token_file_detect(const void* data, size_t length);
+
+// Maps a token file read-only. Returns false, with errno set, if it can't be opened or isn't a token file.
+bool token_file_open(TokenFile* file, const char* path);
+void token_file_close(TokenFile* file);
+
+#endif
@@ -0,0 +1,57 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+#include "token_reloader.h"
+
+bool token_store_load_path(TokenStore* store, const char* path) {
+  const char* name = path && strcmp(path, "-") ? path : "<stdin>";
+  OTPTokenSet set;
+  size_t duplicates;
+  token_set_init(&set);
+  if (!token_set_load_path(&set, path) || !token_set_finish(&set, &duplicates) || !token_store_publish(store, &set)) {
+    fprintf(stderr, "%s: could not load tokens\n", name);
+    token_set_free(&set);
+    return false;
+  }
+  if (duplicates) {
+    fprintf(stderr, "%s: %zu duplicate IDs, keeping the last of each\n", name, duplicates);
+  }
+  return true;
+}
+
+static void* reload_tokens(void* context) {
+  TokenReloader* reloader = context;
+  for (;;) {
+    int received;
+    if (sigwait(&reloader->signals, &received)) continue;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    token_store_load_path(reloader->store, reloader->path);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  }
+  return NULL;
+}
+
+bool token_reloader_start(TokenReloader* reloader, TokenStore* store, const char* path) {
+  reloader->store = store;
+  reloader->path = path;
+  sigemptyset(&reloader->signals);
+  sigaddset(&reloader->signals, SIGHUP);
+  return !pthread_sigmask(SIG_BLOCK, &reloader->signals, NULL) &&
+         !pthread_create(&reloader->thread, NULL, reload_tokens, reloader);
+}
+
+void token_reloader_stop(TokenReloader* reloader) {
+  pthread_cancel(reloader->thread);
+  pthread_join(reloader->thread, NULL);
+}
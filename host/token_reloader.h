@@ -0,0 +1,40 @@
+// Keeps a TokenStore in step with a token file, reloading it in the background on SIGHUP.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_RELOADER_H__
+#define TOKEN_RELOADER_H__
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include "token_store.h"
+
+typedef struct TokenReloader {
+  TokenStore* store;
+  const char* path;
+  sigset_t signals;
+  pthread_t thread;
+} TokenReloader;
+
+// Loads a token file (see token_set_load_path) and publishes it. Reports problems on stderr and
+// leaves the current snapshot in place if the file can't be loaded.
+bool token_store_load_path(TokenStore* store, const char* path);
+
+// Blocks SIGHUP in the calling thread - call it before starting any others, so they inherit that - and
+// starts a thread that reloads path into store each time one arrives.
+bool token_reloader_start(TokenReloader* reloader, TokenStore* store, const char* path);
+
+void token_reloader_stop(TokenReloader* reloader);
+
+#endif
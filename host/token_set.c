@@ -0,0 +1,208 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "line_reader.h"
+#include "token_set.h"
+
+#define HUGE_PAGE_SIZE (2 << 20)
+
+void token_set_init(OTPTokenSet* set) {
+  memset(set, 0, sizeof(OTPTokenSet));
+}
+
+void token_set_free(OTPTokenSet* set) {
+  if (set->tokens) {
+    memset(set->tokens, 0, set->capacity * sizeof(OTPToken));
+  }
+  if (set->map_length) {
+    munmap(set->tokens, set->map_length);
+  } else {
+    free(set->tokens);
+  }
+  token_set_init(set);
+}
+
+OTPToken* token_set_append(OTPTokenSet* set) {
+  if (set->count == set->capacity) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+    OTPToken* tokens = realloc(set->tokens, capacity * sizeof(OTPToken));
+    if (!tokens) return NULL;
+    set->tokens = tokens;
+    set->capacity = capacity;
+  }
+  return &set->tokens[set->count++];
+}
+
+// Stable LSD radix sort on the ID, 16 bits a pass - linear in the token count, and keeps load order among equal IDs.
+static bool token_set_sort(OTPTokenSet* set) {
+  OTPToken* scratch = malloc(set->count * sizeof(OTPToken));
+  size_t* offsets = malloc((1 << 16) * sizeof(size_t));
+  if (!scratch || !offsets) {
+    free(scratch);
+    free(offsets);
+    return false;
+  }
+  OTPToken* from = set->tokens;
+  OTPToken* to = scratch;
+  for (int shift = 0; shift < 32; shift += 16) {
+    memset(offsets, 0, (1 << 16) * sizeof(size_t));
+    for (size_t i = 0; i < set->count; ++i) {
+      offsets[(from[i].id >> shift) & 0xFFFF]++;
+    }
+    size_t total = 0;
+    for (size_t bucket = 0; bucket < (1 << 16); ++bucket) {
+      size_t count = offsets[bucket];
+      offsets[bucket] = total;
+      total += count;
+    }
+    for (size_t i = 0; i < set->count; ++i) {
+      to[offsets[(from[i].id >> shift) & 0xFFFF]++] = from[i];
+    }
+    OTPToken* swap = from;
+    from = to;
+    to = swap;
+  }
+  // An even number of passes leaves the result back in set->tokens.
+  memset(scratch, 0, set->count * sizeof(OTPToken));
+  free(scratch);
+  free(offsets);
+  return true;
+}
+
+bool token_set_finish(OTPTokenSet* set, size_t* duplicates) {
+  if (set->count > 1 && !token_set_sort(set)) return false;
+  size_t kept = 0;
+  for (size_t i = 0; i < set->count; ++i) {
+    if (kept && set->tokens[kept - 1].id == set->tokens[i].id) {
+      kept--;
+    }
+    if (kept != i) {
+      set->tokens[kept] = set->tokens[i];
+    }
+    kept++;
+  }
+  if (duplicates) {
+    *duplicates = set->count - kept;
+  }
+  set->count = kept;
+  return true;
+}
+
+bool token_set_use_huge_pages(OTPTokenSet* set) {
+  if (set->map_length || !set->count) return true;
+  size_t length = (set->count * sizeof(OTPToken) + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+  void* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (map == MAP_FAILED) {
+    // Transparent huge pages only back aligned 2 MiB ranges, so map enough to align the start.
+    size_t padded = length + HUGE_PAGE_SIZE;
+    char* raw = mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return false;
+    char* aligned = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned > raw) {
+      munmap(raw, aligned - raw);
+    }
+    munmap(aligned + length, raw + padded - (aligned + length));
+    madvise(aligned, length, MADV_HUGEPAGE);
+    map = aligned;
+  }
+  memcpy(map, set->tokens, set->count * sizeof(OTPToken));
+  memset(set->tokens, 0, set->capacity * sizeof(OTPToken));
+  free(set->tokens);
+  set->tokens = map;
+  set->capacity = length / sizeof(OTPToken);
+  set->map_length = length;
+  return true;
+}
+
+const OTPToken* token_set_find(const OTPTokenSet* set, uint32_t id) {
+  size_t low = 0;
+  size_t high = set->count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (set->tokens[mid].id < id) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low < set->count && set->tokens[low].id == id ? &set->tokens[low] : NULL;
+}
+
+bool token_set_load(OTPTokenSet* set, int fd, const char* name) {
+  LineReader reader;
+  if (!line_reader_open(&reader, fd, 0)) return false;
+  const char* line;
+  size_t length;
+  while (line_reader_next(&reader, &line, &length)) {
+    OTPToken* token = token_set_append(set);
+    if (!token) {
+      line_reader_close(&reader);
+      return false;
+    }
+    OTPTokenParseResult result = otp_token_parse(line, length, token);
+    if (result != OTPTokenParsed) {
+      set->count--;
+      if (result == OTPTokenInvalid) {
+        fprintf(stderr, "%s:%lu: invalid token\n", name, reader.line_number);
+      }
+    }
+  }
+  bool ok = !reader.failed;
+  line_reader_close(&reader);
+  return ok;
+}
+
+bool token_set_add_records(OTPTokenSet* set, const TokenFile* file, size_t* skipped) {
+  size_t hotp = 0;
+  for (size_t i = 0; i < file->count; ++i) {
+    if (file->records[i].type != TokenFileTOTP) {
+      hotp++;
+      continue;
+    }
+    OTPToken* token = token_set_append(set);
+    if (!token) return false;
+    *token = file->records[i].token;
+  }
+  if (skipped) {
+    *skipped = hotp;
+  }
+  return true;
+}
+
+bool token_set_load_path(OTPTokenSet* set, const char* path) {
+  if (!path || !strcmp(path, "-")) return token_set_load(set, STDIN_FILENO, "<stdin>");
+
+  TokenFile file;
+  if (token_file_open(&file, path)) {
+    size_t skipped;
+    bool ok = token_set_add_records(set, &file, &skipped);
+    token_file_close(&file);
+    if (skipped) {
+      fprintf(stderr, "%s: skipped %zu HOTP tokens\n", path, skipped);
+    }
+    return ok;
+  }
+  if (errno != EINVAL) return false;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  bool ok = token_set_load(set, fd, path);
+  close(fd);
+  return ok;
+}
@@ -0,0 +1,58 @@
+// A flat array of tokens, sorted by ID once loaded.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_SET_H__
+#define TOKEN_SET_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "otp_token.h"
+#include "token_file.h"
+
+typedef struct OTPTokenSet {
+  OTPToken* tokens;
+  size_t count;
+  size_t capacity;
+  size_t map_length; // Non-zero once token_set_use_huge_pages() has moved the tokens into a mapping
+} OTPTokenSet;
+
+void token_set_init(OTPTokenSet* set);
+void token_set_free(OTPTokenSet* set);
+
+// Returns a slot at the end of the set for the caller to fill, or NULL if out of memory.
+OTPToken* token_set_append(OTPTokenSet* set);
+
+// Sorts by ID, keeping the last of any duplicates, and counts the ones dropped into duplicates if given.
+// Returns false if there wasn't the memory to sort.
+bool token_set_finish(OTPTokenSet* set, size_t* duplicates);
+
+// Moves a finished set's tokens onto huge pages - reserved ones if there are any free, else pages the
+// kernel is asked to back with transparent huge pages - so lookups scattered over millions of tokens
+// miss in the TLB far less. Nothing may be appended afterwards. Returns false, leaving the set as it
+// was, if neither could be mapped.
+bool token_set_use_huge_pages(OTPTokenSet* set);
+
+// Only valid after token_set_finish().
+const OTPToken* token_set_find(const OTPTokenSet* set, uint32_t id);
+
+// Loads every line of a token file (see otp_token_parse). Returns false if it couldn't be read; reports bad lines on stderr.
+bool token_set_load(OTPTokenSet* set, int fd, const char* name);
+
+// Adds a token file's TOTP records, counting the HOTP ones left out into skipped if given.
+bool token_set_add_records(OTPTokenSet* set, const TokenFile* file, size_t* skipped);
+
+// Loads a binary token file or a text one, whichever path is - standard input (always text) if NULL or "-".
+bool token_set_load_path(OTPTokenSet* set, const char* path);
+
+#endif
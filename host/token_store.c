@@ -0,0 +1,157 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include "token_store.h"
+
+static void snapshot_free(TokenSnapshot* snapshot) {
+  token_set_free(&snapshot->set);
+  free(snapshot);
+}
+
+bool token_store_init(TokenStore* store) {
+  memset(store, 0, sizeof(TokenStore));
+  TokenSnapshot* empty = calloc(1, sizeof(TokenSnapshot));
+  if (!empty) return false;
+  if (pthread_mutex_init(&store->publish_lock, NULL)) {
+    free(empty);
+    return false;
+  }
+  atomic_init(&store->current, empty);
+  atomic_init(&store->epoch, 1); // 0 marks a reader that isn't inside the store
+  return true;
+}
+
+void token_store_destroy(TokenStore* store) {
+  while (store->retired) {
+    TokenSnapshot* next = store->retired->next_retired;
+    snapshot_free(store->retired);
+    store->retired = next;
+  }
+  snapshot_free(atomic_load(&store->current));
+  pthread_mutex_destroy(&store->publish_lock);
+}
+
+TokenStoreReader* token_store_register(TokenStore* store) {
+  for (int i = 0; i < TOKEN_STORE_MAX_READERS; ++i) {
+    TokenStoreReader* reader = &store->readers[i];
+    if (!atomic_load_explicit(&reader->registered, memory_order_relaxed) && !atomic_exchange(&reader->registered, true)) {
+      return reader;
+    }
+  }
+  return NULL;
+}
+
+void token_store_unregister(TokenStoreReader* reader) {
+  atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+  atomic_store_explicit(&reader->registered, false, memory_order_release);
+}
+
+// The oldest epoch any reader is inside, or UINT64_MAX if none is.
+static uint64_t oldest_reader_epoch(TokenStore* store) {
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < TOKEN_STORE_MAX_READERS; ++i) {
+    uint64_t epoch = atomic_load(&store->readers[i].epoch);
+    if (epoch && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  return oldest;
+}
+
+static size_t reclaim_locked(TokenStore* store) {
+  uint64_t oldest = oldest_reader_epoch(store);
+  TokenSnapshot** link = &store->retired;
+  while (*link) {
+    TokenSnapshot* snapshot = *link;
+    if (snapshot->retired_epoch <= oldest) {
+      *link = snapshot->next_retired;
+      snapshot_free(snapshot);
+      store->retired_count--;
+    } else {
+      link = &snapshot->next_retired;
+    }
+  }
+  return store->retired_count;
+}
+
+static void publish_locked(TokenStore* store, TokenSnapshot* snapshot) {
+  if (store->huge_pages) {
+    token_set_use_huge_pages(&snapshot->set); // Best effort - ordinary pages do if there are none
+  }
+  snapshot->generation = ++store->generation;
+  TokenSnapshot* old = atomic_exchange(&store->current, snapshot);
+  // Readers that announce the new epoch did so after the exchange, so they can only load the new snapshot.
+  old->retired_epoch = atomic_fetch_add(&store->epoch, 1) + 1;
+  old->next_retired = store->retired;
+  store->retired = old;
+  store->retired_count++;
+  reclaim_locked(store);
+}
+
+bool token_store_publish(TokenStore* store, OTPTokenSet* set) {
+  TokenSnapshot* snapshot = calloc(1, sizeof(TokenSnapshot));
+  if (!snapshot) return false;
+  snapshot->set = *set;
+  token_set_init(set);
+  pthread_mutex_lock(&store->publish_lock);
+  publish_locked(store, snapshot);
+  pthread_mutex_unlock(&store->publish_lock);
+  return true;
+}
+
+bool token_store_update(TokenStore* store, const OTPToken* added, size_t added_count, const uint32_t* removed, size_t removed_count) {
+  TokenSnapshot* snapshot = calloc(1, sizeof(TokenSnapshot));
+  if (!snapshot) return false;
+  pthread_mutex_lock(&store->publish_lock);
+  // Only publishers replace the current snapshot, so holding the lock keeps it alive.
+  const OTPTokenSet* current = &atomic_load(&store->current)->set;
+  size_t capacity = current->count + added_count;
+  OTPTokenSet* set = &snapshot->set;
+  set->tokens = malloc((capacity ? capacity : 1) * sizeof(OTPToken));
+  if (!set->tokens) {
+    pthread_mutex_unlock(&store->publish_lock);
+    free(snapshot);
+    return false;
+  }
+  set->capacity = capacity;
+
+  // One merge pass over the current tokens, the additions and the removals, all sorted by ID.
+  size_t c = 0, a = 0, r = 0;
+  while (c < current->count || a < added_count) {
+    const OTPToken* next;
+    if (a == added_count || (c < current->count && current->tokens[c].id < added[a].id)) {
+      next = &current->tokens[c++];
+    } else {
+      if (c < current->count && current->tokens[c].id == added[a].id) {
+        c++;
+      }
+      next = &added[a++];
+    }
+    while (r < removed_count && removed[r] < next->id) {
+      r++;
+    }
+    if (r < removed_count && removed[r] == next->id) continue;
+    set->tokens[set->count++] = *next;
+  }
+  publish_locked(store, snapshot);
+  pthread_mutex_unlock(&store->publish_lock);
+  return true;
+}
+
+size_t token_store_reclaim(TokenStore* store) {
+  pthread_mutex_lock(&store->publish_lock);
+  size_t left = reclaim_locked(store);
+  pthread_mutex_unlock(&store->publish_lock);
+  return left;
+}
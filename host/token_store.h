@@ -0,0 +1,89 @@
+// Tokens shared between the threads of one process, published as immutable snapshots.
+//
+// Readers find the current snapshot through one atomic pointer and never wait. Publishing swaps in a
+// new snapshot and retires the old one, which is freed once every reader has left the epoch it was
+// current in. Each reader announces its epoch in its own cache line, so readers never write to shared
+// lines and a publish only has to scan them.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_STORE_H__
+#define TOKEN_STORE_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "token_set.h"
+
+#define TOKEN_STORE_MAX_READERS 64
+
+typedef struct TokenSnapshot {
+  OTPTokenSet set; // Finished - sorted, no duplicate IDs
+  uint64_t generation;
+  uint64_t retired_epoch; // First epoch in which no new reader can see it
+  struct TokenSnapshot* next_retired;
+} TokenSnapshot;
+
+typedef struct TokenStoreReader {
+  _Atomic uint64_t epoch; // 0 outside token_store_enter()/token_store_exit()
+  _Atomic bool registered;
+} __attribute__((aligned(64))) TokenStoreReader;
+
+typedef struct TokenStore {
+  _Atomic(TokenSnapshot*) current;
+  _Atomic uint64_t epoch;
+  pthread_mutex_t publish_lock; // Serialises publishers only - readers never take it
+  bool huge_pages; // Put snapshots on huge pages (see token_set_use_huge_pages) - set it before the first publish
+  uint64_t generation; // Of the current snapshot; the rest are under publish_lock too
+  TokenSnapshot* retired;
+  size_t retired_count;
+  TokenStoreReader readers[TOKEN_STORE_MAX_READERS];
+} TokenStore;
+
+// Starts with an empty snapshot.
+bool token_store_init(TokenStore* store);
+
+// Frees every snapshot; no reader may be inside the store.
+void token_store_destroy(TokenStore* store);
+
+// Claims a reader slot for the calling thread, or returns NULL if all are taken.
+TokenStoreReader* token_store_register(TokenStore* store);
+void token_store_unregister(TokenStoreReader* reader);
+
+// Returns the current snapshot, which stays valid until the matching token_store_exit().
+static inline const TokenSnapshot* token_store_enter(TokenStore* store, TokenStoreReader* reader) {
+  // The announcement has to be visible before the pointer is read, or a publisher scanning the
+  // readers could miss this one and free the snapshot it's about to load.
+  atomic_store(&reader->epoch, atomic_load_explicit(&store->epoch, memory_order_relaxed));
+  return atomic_load(&store->current);
+}
+
+static inline void token_store_exit(TokenStoreReader* reader) {
+  atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+// Makes set, which must be finished, the current snapshot and takes ownership of its tokens.
+// Returns false, leaving set untouched, if there wasn't the memory for the snapshot.
+bool token_store_publish(TokenStore* store, OTPTokenSet* set);
+
+// Publishes a copy of the current snapshot with the removed IDs dropped and the added tokens put in,
+// replacing any with the same ID. Both lists must be sorted by ID, added without duplicates.
+bool token_store_update(TokenStore* store, const OTPToken* added, size_t added_count, const uint32_t* removed, size_t removed_count);
+
+// Frees the retired snapshots no reader can still see; returns how many are left waiting.
+// Publishing does this too, so it's only needed to release memory when publishes stop.
+size_t token_store_reclaim(TokenStore* store);
+
+#endif
@@ -0,0 +1,66 @@
+// The binary request and response records spoken over ptotpd's Unix socket.
+//
+// A client writes any number of requests back to back and reads one response per request, in the same
+// order. Fields are in the host's byte order - the socket never leaves the machine.
+//
+// A request with the code VERIFY_STATS_CODE asks for one of the daemon's counters instead, the VerifyStat
+// given as its ID. Its answer, in its response's place, is a VerifyStatResponse.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef VERIFY_PROTOCOL_H__
+#define VERIFY_PROTOCOL_H__
+
+#include <stdint.h>
+
+#define VERIFY_DEFAULT_SOCKET "/tmp/ptotpd.sock"
+
+typedef struct VerifyRequest {
+  uint32_t id;
+  uint32_t code;
+  uint64_t time; // Unix time to verify at, or 0 for the daemon's clock
+} VerifyRequest;
+
+typedef enum VerifyStatus {
+  VerifyOK = 0,
+  VerifyFail = 1,
+  VerifyUnknown = 2, // No token with that ID
+  VerifyLocked = 3 // Too many recent failures; the code wasn't checked
+} VerifyStatus;
+
+typedef struct VerifyResponse {
+  uint32_t id;
+  uint8_t status; // VerifyStatus
+  int8_t offset; // Steps from the request's that matched, with VerifyOK
+  uint8_t reserved[2];
+} VerifyResponse;
+
+#define VERIFY_STATS_CODE UINT32_MAX // Never a code - even ten digits stay below 2^31
+
+typedef enum VerifyStat {
+  VerifyStatRequests = 0, // Verifications answered
+  VerifyStatBatches = 1,
+  VerifyStatCompressions = 2, // SHA1 and SHA256 block compressions on every thread, reloads' included
+  VerifyStatCodesGenerated = 3,
+  VerifyStatCount
+} VerifyStat;
+
+typedef struct VerifyStatResponse {
+  uint64_t value; // UINT64_MAX for a stat the daemon doesn't know
+} VerifyStatResponse;
+
+_Static_assert(sizeof(VerifyRequest) == 16, "VerifyRequest is sent as-is");
+_Static_assert(sizeof(VerifyResponse) == 8, "VerifyResponse is sent as-is");
+_Static_assert(sizeof(VerifyStatResponse) == sizeof(VerifyResponse), "VerifyStatResponse takes a VerifyResponse's place");
+
+#endif
@@ -0,0 +1,104 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "code_format.h"
+
+// x / 10^d == (x * magic) >> shift for every x < 2^31, with magic = ceil(2^shift / 10^d)
+// and shift = 31 + ceil(log2(10^d)) - so the modulo is one widening multiply, even on the Cortex-M3.
+static const struct {
+  uint32_t magic;
+  uint8_t shift;
+} pow10_divisors[CODE_MAX_DIGITS] = {
+  {0x00000001, 0},  // 10^0
+  {0xCCCCCCCD, 35}, // 10^1
+  {0xA3D70A3E, 38}, // 10^2
+  {0x83126E98, 41}, // 10^3
+  {0xD1B71759, 45}, // 10^4
+  {0xA7C5AC48, 48}, // 10^5
+  {0x8637BD06, 51}, // 10^6
+  {0xD6BF94D6, 55}, // 10^7
+  {0xABCC7712, 58}, // 10^8
+  {0x89705F42, 61}, // 10^9
+};
+
+static const uint32_t pow10[CODE_MAX_DIGITS] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static const char digit_pairs[200] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+uint32_t code_truncate(uint32_t hash, int digits) {
+  if (digits >= CODE_MAX_DIGITS) return hash;
+  uint32_t quotient = ((uint64_t)hash * pow10_divisors[digits].magic) >> pow10_divisors[digits].shift;
+  return hash - quotient * pow10[digits];
+}
+
+// Fills out[0..digits) from the right, two digits per step.
+static inline void format_digits(uint32_t code, int digits, char* out) {
+  char* p = out + digits;
+  for (int n = digits; n >= 2; n -= 2) {
+    uint32_t quotient = code / 100;
+    uint32_t pair = code - quotient * 100;
+    p -= 2;
+    p[0] = digit_pairs[pair * 2];
+    p[1] = digit_pairs[pair * 2 + 1];
+    code = quotient;
+  }
+  if (digits & 1) {
+    *--p = '0' + code % 10;
+  }
+}
+
+void code_format(uint32_t code, int digits, char* out) {
+  format_digits(code, digits, out);
+  out[digits] = 0;
+}
+
+void code_format_spaced(uint32_t code, int digits, char* out) {
+  int low = digits / 2;
+  format_digits(code, digits, out);
+  memmove(out + digits - low + 1, out + digits - low, low);
+  out[digits - low] = ' ';
+  out[digits + 1] = 0;
+}
+
+void code_truncate_batch(const uint32_t* hashes, size_t count, int digits, uint32_t* out) {
+  if (digits >= CODE_MAX_DIGITS) {
+    memmove(out, hashes, count * sizeof(uint32_t));
+    return;
+  }
+  uint64_t magic = pow10_divisors[digits].magic;
+  int shift = pow10_divisors[digits].shift;
+  uint32_t divisor = pow10[digits];
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t quotient = (hashes[i] * magic) >> shift;
+    out[i] = hashes[i] - quotient * divisor;
+  }
+}
+
+void code_format_batch(const uint32_t* codes, size_t count, int digits, char separator, char* out, size_t stride) {
+  for (size_t i = 0; i < count; ++i, out += stride) {
+    format_digits(codes[i], digits, out);
+    out[digits] = separator;
+  }
+}
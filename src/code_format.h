@@ -0,0 +1,39 @@
+// Reduces truncated hashes to their decimal codes and writes them out as text.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CODE_FORMAT_H__
+#define CODE_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODE_MAX_DIGITS 10 // A 31-bit truncated hash never has more
+
+// hash mod 10^digits, for a 31-bit truncated hash as from generateCode().
+uint32_t code_truncate(uint32_t hash, int digits);
+
+// Writes the low `digits` digits of code, zero padded, and a terminator - out needs digits + 1 bytes.
+void code_format(uint32_t code, int digits, char* out);
+
+// As code_format, but with a space before the last digits / 2 digits - out needs digits + 2 bytes.
+void code_format_spaced(uint32_t code, int digits, char* out);
+
+// Truncates count hashes into out.
+void code_truncate_batch(const uint32_t* hashes, size_t count, int digits, uint32_t* out);
+
+// Writes count codes at out, out + stride, ... as `digits` digits followed by separator, without terminators.
+// stride must be at least digits + 1; any bytes beyond that are left alone.
+void code_format_batch(const uint32_t* codes, size_t count, int digits, char separator, char* out, size_t stride);
+
+#endif
@@ -39,38 +39,81 @@
 #include "sha1.h"
 #include "sha256.h"
 #include "hmac.h"
+#include "otp_stats.h"
 
-int generateCode(uint8_t *secret, uint8_t secret_length, unsigned long tm) {
-  uint8_t challenge[8];
+static int truncate_hash(const uint8_t *hash, int hash_length) {
+  // Pick the offset where to sample our hash value for the actual verification
+  // code.
+  int offset = hash[hash_length - 1] & 0xF;
+
+  // Compute the truncated hash in a byte-order independent loop.
+  unsigned int truncatedHash = 0;
+  for (int i = 0; i < 4; ++i) {
+    truncatedHash <<= 8;
+    truncatedHash  |= hash[offset + i];
+  }
+
+  // Truncate to a smaller number of digits.
+  truncatedHash &= 0x7FFFFFFF;
+
+  return truncatedHash;
+}
+
+static void make_challenge(uint8_t challenge[8], unsigned long tm) {
   for (int i = 8; i--; tm >>= 8) {
     challenge[i] = tm;
   }
+}
+
+int generateCode(uint8_t *secret, uint8_t secret_length, unsigned long tm) {
+  OTP_STATS_INC(codes_generated);
+
+  uint8_t challenge[8];
+  make_challenge(challenge, tm);
 
   // Compute the HMAC_SHA1 of the secrete and the challenge.
   uint8_t hash[SHA256_DIGEST_LENGTH];
-  int offset;
 
   if (secret_length > 48) {
     hmac_sha256(secret, secret_length, challenge, 8, hash, SHA256_DIGEST_LENGTH);
-    offset = hash[SHA256_DIGEST_LENGTH - 1] & 0xF;
+    return truncate_hash(hash, SHA256_DIGEST_LENGTH);
+  }
 
-  } else {
-    hmac_sha1(secret, secret_length, challenge, 8, hash, SHA1_DIGEST_LENGTH);
+  hmac_sha1(secret, secret_length, challenge, 8, hash, SHA1_DIGEST_LENGTH);
+  return truncate_hash(hash, SHA1_DIGEST_LENGTH);
+}
 
-    // Pick the offset where to sample our hash value for the actual verification
-    // code.
-    offset = hash[SHA1_DIGEST_LENGTH - 1] & 0xF;
-  }
+OTPAlgorithm generateAlgorithm(OTPAlgorithm algorithm, int key_length) {
+  if (algorithm != OTPAlgorithmAuto) return algorithm;
+  return key_length > 48 ? OTPAlgorithmSHA256 : OTPAlgorithmSHA1;
+}
 
-  // Compute the truncated hash in a byte-order independent loop.
-  unsigned int truncatedHash = 0;
-  for (int i = 0; i < 4; ++i) {
-    truncatedHash <<= 8;
-    truncatedHash  |= hash[offset + i];
+uint8_t generateMidstateWith(OTPAlgorithm algorithm, const uint8_t *secret, int secret_length, uint8_t *midstate) {
+  if (generateAlgorithm(algorithm, secret_length) == OTPAlgorithmSHA256) {
+    hmac_sha256_midstate(secret, secret_length, midstate);
+    return HMAC_SHA256_MIDSTATE_LENGTH;
   }
+  hmac_sha1_midstate(secret, secret_length, midstate);
+  return HMAC_SHA1_MIDSTATE_LENGTH;
+}
 
-  // Truncate to a smaller number of digits.
-  truncatedHash &= 0x7FFFFFFF;
+uint8_t generateMidstate(const uint8_t *secret, uint8_t secret_length, uint8_t *midstate) {
+  return generateMidstateWith(OTPAlgorithmAuto, secret, secret_length, midstate);
+}
 
-  return truncatedHash;
+int generateCodeFromMidstate(const uint8_t *midstate, uint8_t midstate_length, unsigned long tm) {
+  OTP_STATS_INC(codes_generated);
+
+  uint8_t challenge[8];
+  make_challenge(challenge, tm);
+
+  uint8_t hash[SHA256_DIGEST_LENGTH];
+
+  if (midstate_length == HMAC_SHA256_MIDSTATE_LENGTH) {
+    hmac_sha256_from_midstate(midstate, challenge, 8, hash, SHA256_DIGEST_LENGTH);
+    return truncate_hash(hash, SHA256_DIGEST_LENGTH);
+  }
+
+  hmac_sha1_from_midstate(midstate, challenge, 8, hash, SHA1_DIGEST_LENGTH);
+  return truncate_hash(hash, SHA1_DIGEST_LENGTH);
 }
@@ -34,6 +34,31 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "pebble.h"
+#ifndef _GENERATE_H_
+#define _GENERATE_H_
+
+#include <stdint.h>
+#include "hmac.h"
+
+typedef enum OTPAlgorithm {
+  OTPAlgorithmAuto = 0, // SHA256 for keys over 48 bytes, as the watch has always done
+  OTPAlgorithmSHA1 = 1,
+  OTPAlgorithmSHA256 = 2
+} OTPAlgorithm;
 
 int generateCode(uint8_t *key, uint8_t key_length, unsigned long tm);
+
+// OTPAlgorithmAuto resolved against a key length.
+OTPAlgorithm generateAlgorithm(OTPAlgorithm algorithm, int key_length);
+
+// Derives the HMAC midstate for a key, picking the hash the same way generateCode() does.
+// Returns the midstate length - HMAC_SHA1_MIDSTATE_LENGTH or HMAC_SHA256_MIDSTATE_LENGTH.
+uint8_t generateMidstate(const uint8_t *key, uint8_t key_length, uint8_t *midstate);
+
+// As generateMidstate, with the hash given explicitly - and keys of any length.
+uint8_t generateMidstateWith(OTPAlgorithm algorithm, const uint8_t *key, int key_length, uint8_t *midstate);
+
+// Same result as generateCode() on the original key, from a midstate produced by generateMidstate().
+int generateCodeFromMidstate(const uint8_t *midstate, uint8_t midstate_length, unsigned long tm);
+
+#endif /* _GENERATE_H_ */
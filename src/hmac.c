@@ -133,3 +133,147 @@ void hmac_sha256(uint8_t *key, int keyLength,
   memset(sha, 0, sizeof(sha));
   memset(tmp_key, 0, sizeof(tmp_key));
 }
+
+// Midstates are stored as the big-endian state words, inner state first.
+static void state_to_bytes(const uint32_t *state, int words, uint8_t *out) {
+  for (int i = 0; i < words; ++i) {
+    out[i * 4]     = state[i] >> 24;
+    out[i * 4 + 1] = state[i] >> 16;
+    out[i * 4 + 2] = state[i] >> 8;
+    out[i * 4 + 3] = state[i];
+  }
+}
+
+static void bytes_to_state(const uint8_t *in, int words, uint32_t *state) {
+  for (int i = 0; i < words; ++i) {
+    state[i] = ((uint32_t)in[i * 4] << 24) | ((uint32_t)in[i * 4 + 1] << 16) |
+               ((uint32_t)in[i * 4 + 2] << 8) | in[i * 4 + 3];
+  }
+}
+
+// Picks up a SHA1 computation just after one 64 byte block.
+static void sha1_resume(SHA1_INFO *ctx, const uint8_t *state) {
+  sha1_init(ctx);
+  bytes_to_state(state, 5, ctx->digest);
+  ctx->count_lo = SHA1_BLOCKSIZE << 3;
+}
+
+static void sha256_resume(sha256_context *ctx, const uint8_t *state) {
+  sha256_starts(ctx);
+  bytes_to_state(state, 8, ctx->state);
+  ctx->total[0] = SHA256_BLOCKSIZE;
+}
+
+void hmac_sha1_midstate(const uint8_t *key, int keyLength,
+                        uint8_t midstate[HMAC_SHA1_MIDSTATE_LENGTH]) {
+  SHA1_INFO ctx;
+  uint8_t hashed_key[SHA1_DIGEST_LENGTH];
+  if (keyLength > 64) {
+    sha1_init(&ctx);
+    sha1_update(&ctx, key, keyLength);
+    sha1_final(&ctx, hashed_key);
+    key = hashed_key;
+    keyLength = SHA1_DIGEST_LENGTH;
+  }
+
+  uint8_t tmp_key[64];
+  for (int i = 0; i < keyLength; ++i) {
+    tmp_key[i] = key[i] ^ 0x36;
+  }
+  memset(tmp_key + keyLength, 0x36, 64 - keyLength);
+  sha1_init(&ctx);
+  sha1_update(&ctx, tmp_key, 64);
+  state_to_bytes(ctx.digest, 5, midstate);
+
+  for (int i = 0; i < keyLength; ++i) {
+    tmp_key[i] = key[i] ^ 0x5C;
+  }
+  memset(tmp_key + keyLength, 0x5C, 64 - keyLength);
+  sha1_init(&ctx);
+  sha1_update(&ctx, tmp_key, 64);
+  state_to_bytes(ctx.digest, 5, midstate + HMAC_SHA1_MIDSTATE_LENGTH / 2);
+
+  // Zero out all internal data structures
+  memset(hashed_key, 0, sizeof(hashed_key));
+  memset(tmp_key, 0, sizeof(tmp_key));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+void hmac_sha1_from_midstate(const uint8_t midstate[HMAC_SHA1_MIDSTATE_LENGTH],
+                             const uint8_t *data, int dataLength,
+                             uint8_t *result, int resultLength) {
+  SHA1_INFO ctx;
+  uint8_t sha[SHA1_DIGEST_LENGTH];
+
+  sha1_resume(&ctx, midstate);
+  sha1_update(&ctx, data, dataLength);
+  sha1_final(&ctx, sha);
+
+  sha1_resume(&ctx, midstate + HMAC_SHA1_MIDSTATE_LENGTH / 2);
+  sha1_update(&ctx, sha, SHA1_DIGEST_LENGTH);
+  sha1_final(&ctx, sha);
+
+  memset(result, 0, resultLength);
+  if (resultLength > SHA1_DIGEST_LENGTH) {
+    resultLength = SHA1_DIGEST_LENGTH;
+  }
+  memcpy(result, sha, resultLength);
+  memset(sha, 0, sizeof(sha));
+}
+
+void hmac_sha256_midstate(const uint8_t *key, int keyLength,
+                          uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH]) {
+  sha256_context ctx;
+  uint8_t hashed_key[SHA256_DIGEST_LENGTH];
+  if (keyLength > SHA256_BLOCKSIZE) {
+    sha256_starts(&ctx);
+    sha256_update(&ctx, (uint8_t *)key, keyLength);
+    sha256_finish(&ctx, hashed_key);
+    key = hashed_key;
+    keyLength = SHA256_DIGEST_LENGTH;
+  }
+
+  uint8_t tmp_key[SHA256_BLOCKSIZE];
+  for (int i = 0; i < keyLength; ++i) {
+    tmp_key[i] = key[i] ^ 0x36;
+  }
+  memset(tmp_key + keyLength, 0x36, SHA256_BLOCKSIZE - keyLength);
+  sha256_starts(&ctx);
+  sha256_update(&ctx, tmp_key, SHA256_BLOCKSIZE);
+  state_to_bytes(ctx.state, 8, midstate);
+
+  for (int i = 0; i < keyLength; ++i) {
+    tmp_key[i] = key[i] ^ 0x5C;
+  }
+  memset(tmp_key + keyLength, 0x5C, SHA256_BLOCKSIZE - keyLength);
+  sha256_starts(&ctx);
+  sha256_update(&ctx, tmp_key, SHA256_BLOCKSIZE);
+  state_to_bytes(ctx.state, 8, midstate + HMAC_SHA256_MIDSTATE_LENGTH / 2);
+
+  // Zero out all internal data structures
+  memset(hashed_key, 0, sizeof(hashed_key));
+  memset(tmp_key, 0, sizeof(tmp_key));
+  memset(&ctx, 0, sizeof(ctx));
+}
+
+void hmac_sha256_from_midstate(const uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH],
+                               const uint8_t *data, unsigned int dataLength,
+                               uint8_t *result, int resultLength) {
+  sha256_context ctx;
+  uint8_t sha[SHA256_DIGEST_LENGTH];
+
+  sha256_resume(&ctx, midstate);
+  sha256_update(&ctx, (uint8_t *)data, dataLength);
+  sha256_finish(&ctx, sha);
+
+  sha256_resume(&ctx, midstate + HMAC_SHA256_MIDSTATE_LENGTH / 2);
+  sha256_update(&ctx, sha, SHA256_DIGEST_LENGTH);
+  sha256_finish(&ctx, sha);
+
+  memset(result, 0, resultLength);
+  if (resultLength > SHA256_DIGEST_LENGTH) {
+    resultLength = SHA256_DIGEST_LENGTH;
+  }
+  memcpy(result, sha, resultLength);
+  memset(sha, 0, sizeof(sha));
+}
@@ -20,6 +20,11 @@
 
 #include <stdint.h>
 
+// The inner and outer hash states after absorbing the padded key - enough to
+// compute the HMAC of any message without the key itself.
+#define HMAC_SHA1_MIDSTATE_LENGTH   40
+#define HMAC_SHA256_MIDSTATE_LENGTH 64
+
 void hmac_sha1(const uint8_t *key, int keyLength,
                const uint8_t *data, int dataLength,
                uint8_t *result, int resultLength)
@@ -30,4 +35,22 @@ void hmac_sha256(uint8_t *key, int keyLength,
                uint8_t *result, int resultLength)
  __attribute__((visibility("hidden")));
 
+void hmac_sha1_midstate(const uint8_t *key, int keyLength,
+                        uint8_t midstate[HMAC_SHA1_MIDSTATE_LENGTH])
+ __attribute__((visibility("hidden")));
+
+void hmac_sha1_from_midstate(const uint8_t midstate[HMAC_SHA1_MIDSTATE_LENGTH],
+                             const uint8_t *data, int dataLength,
+                             uint8_t *result, int resultLength)
+ __attribute__((visibility("hidden")));
+
+void hmac_sha256_midstate(const uint8_t *key, int keyLength,
+                          uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH])
+ __attribute__((visibility("hidden")));
+
+void hmac_sha256_from_midstate(const uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH],
+                               const uint8_t *data, unsigned int dataLength,
+                               uint8_t *result, int resultLength)
+ __attribute__((visibility("hidden")));
+
 #endif /* _HMAC_H_ */
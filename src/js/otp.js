@@ -0,0 +1,117 @@
+// TOTP code generation for tokens whose secrets stay on the phone.
+// Mirrors generateCode() in src/generate.c, down to picking SHA256 for keys over 48 bytes, so the watch formats these exactly as it would its own.
+
+var ROTL = function(x, n) {
+    return (x << n) | (x >>> (32 - n));
+};
+
+var ROTR = function(x, n) {
+    return (x >>> n) | (x << (32 - n));
+};
+
+// Pads the message and splits it into big-endian words, as SHA1 and SHA256 share the same framing.
+var HashBlocks = function(bytes) {
+    var words = [];
+    var idx;
+    for (idx = 0; idx < bytes.length; idx++) {
+        words[idx >> 2] |= bytes[idx] << (24 - (idx % 4) * 8);
+    }
+    words[bytes.length >> 2] |= 0x80 << (24 - (bytes.length % 4) * 8);
+    var total = (((bytes.length + 8) >> 6) + 1) * 16;
+    for (idx = 0; idx < total; idx++) words[idx] |= 0;
+    words[total - 2] = Math.floor(bytes.length / 0x20000000);
+    words[total - 1] = (bytes.length * 8) | 0;
+    return words;
+};
+
+var WordsToBytes = function(words) {
+    var bytes = [];
+    for (var idx = 0; idx < words.length; idx++) {
+        bytes.push((words[idx] >>> 24) & 0xff, (words[idx] >>> 16) & 0xff, (words[idx] >>> 8) & 0xff, words[idx] & 0xff);
+    }
+    return bytes;
+};
+
+var SHA1 = function(bytes) {
+    var words = HashBlocks(bytes);
+    var H = [0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0];
+    var W = [];
+    for (var block = 0; block < words.length; block += 16) {
+        var a = H[0], b = H[1], c = H[2], d = H[3], e = H[4];
+        for (var t = 0; t < 80; t++) {
+            W[t] = t < 16 ? words[block + t] : ROTL(W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16], 1);
+            var f, k;
+            if (t < 20) {
+                f = (b & c) | (~b & d); k = 0x5a827999;
+            } else if (t < 40) {
+                f = b ^ c ^ d; k = 0x6ed9eba1;
+            } else if (t < 60) {
+                f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d; k = 0xca62c1d6;
+            }
+            var temp = (ROTL(a, 5) + f + e + k + W[t]) | 0;
+            e = d; d = c; c = ROTL(b, 30); b = a; a = temp;
+        }
+        H[0] = (H[0] + a) | 0; H[1] = (H[1] + b) | 0; H[2] = (H[2] + c) | 0; H[3] = (H[3] + d) | 0; H[4] = (H[4] + e) | 0;
+    }
+    return WordsToBytes(H);
+};
+
+var SHA256_K = [
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+];
+
+var SHA256 = function(bytes) {
+    var words = HashBlocks(bytes);
+    var H = [0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19];
+    var W = [];
+    for (var block = 0; block < words.length; block += 16) {
+        var a = H[0], b = H[1], c = H[2], d = H[3], e = H[4], f = H[5], g = H[6], h = H[7];
+        for (var t = 0; t < 64; t++) {
+            if (t < 16) {
+                W[t] = words[block + t];
+            } else {
+                var s0 = ROTR(W[t - 15], 7) ^ ROTR(W[t - 15], 18) ^ (W[t - 15] >>> 3);
+                var s1 = ROTR(W[t - 2], 17) ^ ROTR(W[t - 2], 19) ^ (W[t - 2] >>> 10);
+                W[t] = (W[t - 16] + s0 + W[t - 7] + s1) | 0;
+            }
+            var temp1 = (h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + (g ^ (e & (f ^ g))) + SHA256_K[t] + W[t]) | 0;
+            var temp2 = ((ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) | (c & (a | b)))) | 0;
+            h = g; g = f; f = e; e = (d + temp1) | 0; d = c; c = b; b = a; a = (temp1 + temp2) | 0;
+        }
+        H[0] = (H[0] + a) | 0; H[1] = (H[1] + b) | 0; H[2] = (H[2] + c) | 0; H[3] = (H[3] + d) | 0;
+        H[4] = (H[4] + e) | 0; H[5] = (H[5] + f) | 0; H[6] = (H[6] + g) | 0; H[7] = (H[7] + h) | 0;
+    }
+    return WordsToBytes(H);
+};
+
+var HMAC = function(hash, key, message) {
+    if (key.length > 64) key = hash(key); // Both hashes use 64 byte blocks.
+    var inner = [];
+    var outer = [];
+    for (var idx = 0; idx < 64; idx++) {
+        inner.push((key[idx] || 0) ^ 0x36);
+        outer.push((key[idx] || 0) ^ 0x5c);
+    }
+    return hash(outer.concat(hash(inner.concat(message))));
+};
+
+// Returns the same 31-bit truncated hash as generateCode(); the watch reduces it to the token's digits.
+var GenerateCode = function(secret, step) {
+    var challenge = [];
+    for (var idx = 7; idx >= 0; idx--) {
+        challenge[idx] = step % 256;
+        step = Math.floor(step / 256);
+    }
+    var hash = HMAC(secret.length > 48 ? SHA256 : SHA1, secret, challenge);
+    var offset = hash[hash.length - 1] & 0xf;
+    return ((hash[offset] & 0x7f) << 24 | hash[offset + 1] << 16 | hash[offset + 2] << 8 | hash[offset + 3]) >>> 0;
+};
@@ -1,13 +1,112 @@
 var Tokens = [];
 var TokenLoadFinished = false;
+var SyncPending = false;
 
 Pebble.addEventListener("ready",
     function(e) {
-        QueueAppMessage({ "AMReadTokenList": 1});
-        QueueAppMessage({ "AMSetUTCOffset": (new Date()).getTimezoneOffset() * -60});
+        // Ask what the watch holds first - we only fetch the list or push the offset if they differ from what we last saw.
+        SyncPending = true;
+        QueueAppMessage({ "AMSyncState": 1});
     }
 );
 
+var LocalUTCOffset = function() {
+    return (new Date()).getTimezoneOffset() * -60;
+};
+
+// The cache holds IDs and names only - never secrets.
+var LoadSyncCache = function() {
+    try {
+        return JSON.parse(localStorage.getItem("SyncCache"));
+    } catch (exc) {
+        return null;
+    }
+};
+
+var SaveSyncCache = function(version, digest) {
+    localStorage.setItem("SyncCache", JSON.stringify({
+        "Version": version,
+        "Digest": digest,
+        "Tokens": Tokens.map(function(e){return {"ID": e.ID, "Name": e.Name};})
+    }));
+};
+
+var CodeScheduleLength = 20; // Matches CODE_SCHEDULE_LENGTH on the watch.
+
+// Secrets of tokens created with PhoneCodes live here, keyed by ID - the watch only ever sees their codes.
+var LoadPhoneSecrets = function() {
+    try {
+        return JSON.parse(localStorage.getItem("PhoneSecrets")) || {};
+    } catch (exc) {
+        return {};
+    }
+};
+
+var SavePhoneSecrets = function(secrets) {
+    localStorage.setItem("PhoneSecrets", JSON.stringify(secrets));
+};
+
+var ToUInt32Bytes = function(value) {
+    return [value & 0xff, (value >>> 8) & 0xff, (value >>> 16) & 0xff, (value >>> 24) & 0xff];
+};
+
+// Sends the next CodeScheduleLength codes for each of the given phone-computed tokens (or all of them).
+var QueueCodeSchedules = function(ids) {
+    var secrets = LoadPhoneSecrets();
+    if (!ids) ids = Object.keys(secrets);
+    var first_step = Math.floor(Date.now() / 1000 / 30);
+    var schedules = [];
+    for (var idx in ids) {
+        var secret = secrets[ids[idx]];
+        if (!secret) continue;
+        var secretArray = ToByteArray(atob(secret));
+        var record = ToUInt16Bytes(+ids[idx]).concat(ToUInt32Bytes(first_step), [CodeScheduleLength]);
+        for (var step = first_step; step < first_step + CodeScheduleLength; step++) {
+            record = record.concat(ToUInt32Bytes(GenerateCode(secretArray, step)));
+        }
+        if (schedules.length && schedules.length + record.length > AMBatchBudget) {
+            QueueAppMessage({"AMCodeSchedule": schedules});
+            schedules = [];
+        }
+        schedules = schedules.concat(record);
+    }
+    if (schedules.length) QueueAppMessage({"AMCodeSchedule": schedules});
+};
+
+// Field order of OTPStats in src/otp_stats.h.
+var StatsFields = ["compressions", "codes_generated", "refreshes", "refresh_ms_last", "refresh_ms_max", "refresh_ms_total",
+                   "persist_writes", "persist_bytes", "messages_received", "messages_sent", "messages_failed", "heap_peak"];
+
+var LogStats = function(data) {
+    var stats = {};
+    for (var idx = 0; idx < StatsFields.length && idx * 4 + 3 < data.length; idx++) {
+        stats[StatsFields[idx]] = (data[idx * 4] | data[idx * 4 + 1] << 8 | data[idx * 4 + 2] << 16 | data[idx * 4 + 3] << 24) >>> 0;
+    }
+    console.log("Watch stats " + JSON.stringify(stats));
+};
+
+var HandleSyncState = function(payload) {
+    if (!SyncPending) {
+        // Unprompted (after a commit) or riding along with the end of a list read - either way Tokens now matches the watch.
+        SaveSyncCache(payload.AMSyncState_Version, payload.AMSyncState_Digest);
+        return;
+    }
+    SyncPending = false;
+    var cache = LoadSyncCache();
+    if (cache && cache.Version === payload.AMSyncState_Version && cache.Digest === payload.AMSyncState_Digest) {
+        Tokens = cache.Tokens;
+        TokenLoadFinished = true;
+    } else {
+        Tokens = [];
+        TokenLoadFinished = false;
+        QueueAppMessage({ "AMReadTokenList": 1});
+    }
+    if (payload.AMSyncState_UTCOffset !== LocalUTCOffset()) {
+        QueueAppMessage({ "AMSetUTCOffset": LocalUTCOffset()});
+    }
+    QueueCodeSchedules();
+};
+
 var UnCString = function(array, offset) {
     var string = "";
     for (var i = offset; i < array.length; i++){
@@ -22,6 +121,15 @@ var ToByteArray = function(input) {
     return input.split('').map(function(e){return e.charCodeAt(0);});
 };
 
+var ToUTF8ByteArray = function(input) {
+    // The watch truncates names by byte, so send them the way it stores them.
+    return ToByteArray(unescape(encodeURIComponent(input))).slice(0, 32);
+};
+
+var ToUInt16Bytes = function(value) {
+    return [value & 0xff, (value >> 8) & 0xff];
+};
+
 var TokenByID = function(id) {
     for (var idx in Tokens) {
         if (Tokens[idx].ID == id) return Tokens[idx];
@@ -53,21 +161,65 @@ var AMTransmitQueue = function() {
     Pebble.sendAppMessage(message, AMTransmitQueue, AMQueueFail);
 };
 
+var BatchOp = {"Create": 1, "Update": 2, "Delete": 3};
+var TokenFlags = {"PhoneCodes": 1, "Midstate": 2};
+var AMBatchBudget = 512; // Bytes of packed records (or list order) per message - comfortably inside the watch's 1024 byte inbox.
+
+// Packs the records into AMBatch messages, then pages the list order after them; the last message carries AMBatch_Commit.
+var QueueBatch = function(records, order) {
+    var batch = [];
+    var idx;
+    for (idx in records) {
+        if (batch.length && batch.length + records[idx].length > AMBatchBudget) {
+            QueueAppMessage({"AMBatch": batch});
+            batch = [];
+        }
+        batch = batch.concat(records[idx]);
+    }
+    if (batch.length) QueueAppMessage({"AMBatch": batch});
+
+    var page_ids = AMBatchBudget / 2;
+    for (var offset = 0; offset < order.length || offset === 0; offset += page_ids) {
+        var page = [];
+        var ids = order.slice(offset, offset + page_ids);
+        for (idx in ids) page = page.concat(ToUInt16Bytes(ids[idx]));
+        var message = {"AMSetTokenListOrder_Offset": offset, "AMSetTokenListOrder_Total": order.length};
+        if (page.length) message.AMSetTokenListOrder = page;
+        if (offset + page_ids >= order.length) message.AMBatch_Commit = 1;
+        QueueAppMessage(message);
+    }
+};
+
 Pebble.addEventListener("appmessage",
   function(e) {
     if (e.payload.AMReadTokenList_Result) {
         var token = {};
-        token.ID = e.payload.AMReadTokenList_Result[0];
+        token.ID = e.payload.AMReadTokenList_Result[0] | (e.payload.AMReadTokenList_Result[1] << 8);
         token.Name = UnCString(e.payload.AMReadTokenList_Result, 2);
         Tokens.push(token);
     }
     if (e.payload.AMReadTokenList_Finished) {
         TokenLoadFinished = true;
     }
+    if (e.payload.AMSyncState_Version !== undefined) {
+        HandleSyncState(e.payload);
+    }
+    if (e.payload.AMReadStats_Result) {
+        LogStats(e.payload.AMReadStats_Result);
+    }
+    if (e.payload.AMRequestCodeSchedule) {
+        var ids = [];
+        for (var idx = 0; idx + 1 < e.payload.AMRequestCodeSchedule.length; idx += 2) {
+            ids.push(e.payload.AMRequestCodeSchedule[idx] | (e.payload.AMRequestCodeSchedule[idx + 1] << 8));
+        }
+        QueueCodeSchedules(ids);
+    }
   }
 );
 
 var OpenConfiguration = function(){
+    // Opening the configuration page is a good moment to capture what the watch has been up to in the logs.
+    QueueAppMessage({"AMReadStats": 1});
     // You used to be able to defer opening the config page till the tokens were loaded.
     // You can't any more...
     if (TokenLoadFinished) {
@@ -109,21 +261,38 @@ var ReconcileConfiguration = function(newTokens) {
     console.log("Updating " + JSON.stringify(to_update));
     console.log("Deleting " + JSON.stringify(to_delete_ids));
 
-    // Apply updates
+    // Apply updates - all of them ride in as few AMBatch messages as possible, so the watch only regenerates and persists once.
+    var records = [];
+    var phone_secrets = LoadPhoneSecrets();
+    var phone_ids = [];
     for(idx in to_delete_ids) {
-        QueueAppMessage({"AMDeleteToken": [to_delete_ids[idx]]});
+        records.push([BatchOp.Delete].concat(ToUInt16Bytes(to_delete_ids[idx])));
+        delete phone_secrets[to_delete_ids[idx]];
     }
     for (idx in to_create) {
         token = to_create[idx];
-		var secretArray = ToByteArray(atob(token.Secret));
-		secretArray.unshift(secretArray.length);
-        QueueAppMessage({"AMCreateToken": secretArray, "AMCreateToken_ID": token.ID, "AMCreateToken_Name": token.Name, "AMCreateToken_Digits": token.Digits});
+        var secretArray = ToByteArray(atob(token.Secret));
+        var createName = ToUTF8ByteArray(token.Name);
+        var flags = 0;
+        if (token.PhoneCodes) {
+            // Keep the secret here and send the watch an empty one - it gets code schedules instead.
+            phone_secrets[token.ID] = token.Secret;
+            phone_ids.push(token.ID);
+            secretArray = [];
+            flags |= TokenFlags.PhoneCodes;
+        } else if (token.Midstate) {
+            flags |= TokenFlags.Midstate; // The watch swaps the key for its HMAC midstate as soon as it arrives.
+        }
+        records.push([BatchOp.Create].concat(ToUInt16Bytes(token.ID), [token.Digits, flags, createName.length], createName, [secretArray.length], secretArray));
     }
+    SavePhoneSecrets(phone_secrets);
     for (idx in to_update) {
         token = to_update[idx];
-        QueueAppMessage({"AMUpdateToken": [token.ID, 0, token.Name, 0]});
+        var updateName = ToUTF8ByteArray(token.Name);
+        records.push([BatchOp.Update].concat(ToUInt16Bytes(token.ID), [updateName.length], updateName));
     }
-    QueueAppMessage({"AMSetTokenListOrder": new_ids});
+    QueueBatch(records, new_ids);
+    if (phone_ids.length) QueueCodeSchedules(phone_ids);
     Tokens = newTokens.map(function(e){e.Secret = null; return e;}); // Strip out the secrets so they don't appear in further log messages.
 };
 
@@ -0,0 +1,85 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "otp_stats.h"
+
+#ifdef OTP_STATS_THREAD_LOCAL
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+__thread OTPStatsBlock* otp_stats_block;
+
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static OTPStatsBlock* blocks; // Every block ever registered, owned or not
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t block_key;
+static bool have_key;
+// Shared by any thread that couldn't get a block of its own; counts there can be lost to each other.
+static OTPStatsBlock spare_block = {.owned = true};
+
+// Run as a thread exits. Counting after this (from a later destructor) registers again.
+static void release_block(void* value) {
+  OTPStatsBlock* block = value;
+  otp_stats_block = NULL;
+  pthread_mutex_lock(&blocks_lock);
+  block->owned = false;
+  pthread_mutex_unlock(&blocks_lock);
+}
+
+static void create_key(void) {
+  have_key = !pthread_key_create(&block_key, release_block);
+}
+
+OTPStatsBlock* otp_stats_register(void) {
+  pthread_once(&key_once, create_key);
+  pthread_mutex_lock(&blocks_lock);
+  OTPStatsBlock* block = blocks;
+  while (block && block->owned) {
+    block = block->next;
+  }
+  if (!block && (block = calloc(1, sizeof(OTPStatsBlock)))) {
+    block->next = blocks;
+    blocks = block;
+  }
+  if (block) {
+    block->owned = true;
+  }
+  pthread_mutex_unlock(&blocks_lock);
+  // Without a key the block could never be handed back, so the thread shares the spare instead.
+  if (block && (!have_key || pthread_setspecific(block_key, block))) {
+    release_block(block);
+    block = NULL;
+  }
+  otp_stats_block = block ? block : &spare_block;
+  return otp_stats_block;
+}
+
+void otp_stats_snapshot(OTPStats* totals) {
+  OTPStatsCounter sums[OTP_STATS_FIELDS] = {0};
+  pthread_mutex_lock(&blocks_lock);
+  for (const OTPStatsBlock* block = blocks; block; block = block->next) {
+    for (size_t i = 0; i < OTP_STATS_FIELDS; ++i) {
+      sums[i] += atomic_load_explicit(&block->counts[i], memory_order_relaxed);
+    }
+  }
+  pthread_mutex_unlock(&blocks_lock);
+  for (size_t i = 0; i < OTP_STATS_FIELDS; ++i) {
+    sums[i] += atomic_load_explicit(&spare_block.counts[i], memory_order_relaxed);
+  }
+  memcpy(totals, sums, sizeof(OTPStats));
+}
+
+#else
+OTPStats otp_stats;
+#endif
@@ -0,0 +1,86 @@
+// Counters for the work behind each code, so battery complaints can be tied to what the app actually did.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef OTP_STATS_H__
+#define OTP_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host builds count in 64 bits, where a busy daemon would wrap 32 in hours.
+#ifdef OTP_STATS_THREAD_LOCAL
+typedef uint64_t OTPStatsCounter;
+#else
+typedef uint32_t OTPStatsCounter;
+#endif
+
+// On the watch every field is a UInt32 so the struct can be sent as-is; append new fields at the end.
+typedef struct OTPStats {
+  OTPStatsCounter compressions; // SHA1 and SHA256 block compressions
+  OTPStatsCounter codes_generated; // generateCode() calls
+  OTPStatsCounter refreshes; // refresh_all() passes that regenerated codes
+  OTPStatsCounter refresh_ms_last;
+  OTPStatsCounter refresh_ms_max;
+  OTPStatsCounter refresh_ms_total;
+  OTPStatsCounter persist_writes;
+  OTPStatsCounter persist_bytes;
+  OTPStatsCounter messages_received;
+  OTPStatsCounter messages_sent;
+  OTPStatsCounter messages_failed;
+  OTPStatsCounter heap_peak;
+} OTPStats;
+
+#ifdef OTP_STATS_THREAD_LOCAL
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define OTP_STATS_FIELDS (sizeof(OTPStats) / sizeof(OTPStatsCounter))
+
+// Host builds that hash on several threads give each its own block of counters rather than racing on one.
+// A thread's block is registered the first time it counts, and goes to the next new thread once it exits,
+// so totals keep what exited threads counted.
+typedef struct OTPStatsBlock {
+  _Atomic OTPStatsCounter counts[OTP_STATS_FIELDS]; // Indexed as OTPStats' fields; only the owner writes
+  bool owned;
+  struct OTPStatsBlock* next;
+} OTPStatsBlock;
+
+extern __thread OTPStatsBlock* otp_stats_block;
+
+OTPStatsBlock* otp_stats_register(void);
+
+// Fills totals with the sums over every block. Each counter is read whole, but the set of them isn't
+// taken at one instant, so counters still moving on other threads may be a little apart.
+void otp_stats_snapshot(OTPStats* totals);
+
+static inline void otp_stats_add(size_t field, OTPStatsCounter n) {
+  OTPStatsBlock* block = otp_stats_block ? otp_stats_block : otp_stats_register();
+  // A load and a store rather than a locked add: only this thread writes the block.
+  atomic_store_explicit(&block->counts[field], atomic_load_explicit(&block->counts[field], memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+#define OTP_STATS_INC(field) OTP_STATS_ADD(field, 1)
+#define OTP_STATS_ADD(field, n) otp_stats_add(offsetof(OTPStats, field) / sizeof(OTPStatsCounter), (n))
+
+#else
+
+extern OTPStats otp_stats;
+
+#define OTP_STATS_INC(field) (otp_stats.field++)
+#define OTP_STATS_ADD(field, n) (otp_stats.field += (n))
+
+#endif
+
+#endif
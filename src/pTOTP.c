@@ -12,8 +12,11 @@
 
 #include "pebble.h"
 
+#include "code_format.h"
 #include "generate.h"
+#include "otp_stats.h"
 #include "persist_error_msg.h"
+#include "token_info.h"
 
 #define min(a,b) \
    ({ __typeof__ (a) _a = (a); \
@@ -21,14 +24,11 @@
      _a < _b ? _a : _b; })
 
 // #define TEST_TOKEN 1
+// #define PROFILE_FRAMES 1
 
-#define P_UTCOFFSET       1
-#define P_TOKENS_COUNT    2
-#define P_SELECTED_LIST_INDEX    3
-#define P_TOKENS_START    10000
-#define P_SECRETS_START   20000
-
-#define MAX_NAME_LENGTH   32
+#define CODE_SCHEDULE_REFILL 8 // Ask the phone for more once fewer steps than this remain
+#define PREVIEW_LEAD_SECONDS 5 // Compute and show the coming codes this long before the boundary
+#define PREVIEW_TOKENS_PER_TICK 4 // Spreads the preview hashing over several ticks
 
 static Window *window;
 
@@ -36,7 +36,8 @@ typedef enum PersistenceWritebackFlags {
   PWNone = 0,
   PWUTCOffset = 1,
   PWTokens = 1 << 1,
-  PWSecrets = 1 << 2
+  PWSecrets = 1 << 2,
+  PWSchedules = 1 << 3
 } PersistenceWritebackFlags;
 
 PersistenceWritebackFlags persist_writeback = PWNone;
@@ -48,7 +49,7 @@ typedef enum AMKey {
   AMCreateToken_ID = 2, // Short with ID for token (provided by phone)
   AMCreateToken_Name = 3, // Char array with name for token (provided by phone)
 
-  AMDeleteToken = 4, // Short with token ID
+  AMDeleteToken = 4, // Integer with token ID
   AMClearTokens = 5,
 
   AMReadTokenList = 6, // Starts token list read
@@ -57,23 +58,41 @@ typedef enum AMKey {
 
   AMUpdateToken = 9, // Struct with token info
 
-  AMSetTokenListOrder = 10, // array of shorts of token IDs
+  AMSetTokenListOrder = 10, // UInt8 array of little-endian UInt16 token IDs - one page of the full order
 
   AMCreateToken_Digits = 11, // Short with length of code (provided by phone)
 
+  AMBatch = 12, // UInt8 array of packed BatchOp records, applied in order
+  AMBatch_Commit = 13, // Included in the last AMBatch message - codes are regenerated and persisted only then
+
+  AMSyncState = 14, // Requests the sync state; also sent unprompted after a batch commits
+  AMSyncState_Version = 15, // UInt32 bumped every time the token list is written back
+  AMSyncState_Digest = 16, // UInt32 digest of the token IDs, names and order
+  AMSyncState_UTCOffset = 17, // Int32 with the offset the watch currently holds
+
+  AMSetTokenListOrder_Offset = 18, // Int32 position of this page's first ID in the full order (0 if absent)
+  AMSetTokenListOrder_Total = 19, // Int32 number of IDs across all pages (this page's count if absent)
+
+  AMCodeSchedule = 20, // UInt8 array of packed schedules: UInt16 ID, UInt32 first step, UInt8 count, then count UInt32 codes (all little-endian)
+  AMRequestCodeSchedule = 21, // UInt8 array of little-endian UInt16 IDs whose schedules are running low
+
+  AMReadStats = 22, // Requests the OTPStats counters
+  AMReadStats_Result = 23, // OTPStats struct, as little-endian UInt32s
+
 } AMKey;
 
-typedef struct TokenInfo {
-  char name[MAX_NAME_LENGTH + 1];
-  short id;
-  uint8_t secret_length; // Since persistence is limited to this size anyways.
-  uint8_t* secret;
-  char code[12];
-  short digits;
-} TokenInfo;
+// Records in an AMBatch array are packed back-to-back, with IDs as little-endian UInt16:
+//   BatchOpCreate: op, id, digits, flags, name length, name, secret length, secret
+//   BatchOpUpdate: op, id, name length, name
+//   BatchOpDelete: op, id
+typedef enum BatchOp {
+  BatchOpCreate = 1,
+  BatchOpUpdate = 2,
+  BatchOpDelete = 3
+} BatchOp;
 
 typedef struct PublicTokenInfo {
-  short id;
+  uint16_t id;
   char name[MAX_NAME_LENGTH + 1];
 } PublicTokenInfo;
 
@@ -85,6 +104,16 @@ typedef struct TokenListNode {
 TokenListNode* token_list = NULL;
 bool key_list_is_dirty = false;
 
+// Rows are drawn from this rather than by walking the list - rebuilt lazily whenever the list changes shape.
+TokenInfo** token_index = NULL;
+short token_index_length = 0;
+bool token_index_stale = true;
+
+GFont name_font;
+GFont code_font;
+GFont code_font_spaced;
+GFont code_font_long;
+
 Layer *bar_layer;
 
 TextLayer *no_tokens_layer;
@@ -93,12 +122,45 @@ MenuLayer *code_list_layer;
 
 int utc_offset;
 
+uint32_t token_set_version = 0;
+
 int token_list_retrieve_index = 0;
 
+// Accumulates AMSetTokenListOrder pages until the full order has arrived.
+uint16_t* pending_order = NULL;
+int pending_order_total = 0;
+int pending_order_received = 0;
+
 int startup_selected_list_index = 0;
 
 static void persist_do_writeback(void);
 
+uint32_t clock_ms(void) {
+  time_t sec;
+  uint16_t ms;
+  time_ms(&sec, &ms);
+  return sec * 1000 + ms;
+}
+
+void stats_sample_heap(void) {
+  uint32_t used = heap_bytes_used();
+  if (used > otp_stats.heap_peak) {
+    otp_stats.heap_peak = used;
+  }
+}
+
+static int stats_persist_write_int(const uint32_t key, const int32_t value) {
+  OTP_STATS_INC(persist_writes);
+  OTP_STATS_ADD(persist_bytes, sizeof(value));
+  return persist_write_int(key, value);
+}
+
+static int stats_persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  OTP_STATS_INC(persist_writes);
+  OTP_STATS_ADD(persist_bytes, size);
+  return persist_write_data(key, data, size);
+}
+
 void token_list_add(TokenInfo* key) {
   TokenListNode* node = malloc(sizeof(TokenListNode));
   node->next = NULL;
@@ -114,6 +176,7 @@ void token_list_add(TokenInfo* key) {
     tail->next = node;
   }
   key_list_is_dirty = true;
+  token_index_stale = true;
 }
 
 TokenInfo* token_by_list_index(int index) {
@@ -125,7 +188,7 @@ TokenInfo* token_by_list_index(int index) {
   return node->key;
 }
 
-TokenInfo* token_by_id(short id) {
+TokenInfo* token_by_id(uint16_t id) {
   TokenListNode* node = token_list;
   while (node) {
     if (node->key->id == id) {
@@ -146,16 +209,30 @@ short token_list_length(void){
   return size;
 }
 
+void token_index_refresh(void) {
+  if (!token_index_stale) return;
+  free(token_index);
+  token_index_length = token_list_length();
+  token_index = malloc(token_index_length * sizeof(TokenInfo*));
+  int i = 0;
+  for (TokenListNode* node = token_list; node; node = node->next) {
+    token_index[i++] = node->key;
+  }
+  token_index_stale = false;
+}
+
 void token_list_clear(void){
   TokenListNode* temp;
   while (token_list) {
     temp = token_list;
     token_list = temp->next;
     free(temp->key->secret);
+    free(temp->key->schedule);
     free(temp->key); // Since it'd be a pain to do this otherwise.
     free(temp);
   }
   key_list_is_dirty = true;
+  token_index_stale = true;
 }
 
 bool token_list_delete(TokenInfo* key){
@@ -173,6 +250,7 @@ bool token_list_delete(TokenInfo* key){
     }
     free(node);
     key_list_is_dirty = true;
+    token_index_stale = true;
     return true;
   }
   return false;
@@ -188,6 +266,7 @@ void token_list_supplant(TokenListNode* newList) {
   }
   token_list = newList;
   key_list_is_dirty = true;
+  token_index_stale = true;
 }
 
 void tokeninfo2publicinfo(TokenInfo* key, PublicTokenInfo* public) {
@@ -202,23 +281,363 @@ void publicinfo2tokeninfo(PublicTokenInfo* public, TokenInfo* key) {
   key->name[MAX_NAME_LENGTH] = 0;
 }
 
-void code2char(unsigned int code, char* out, int length) {
-  out[length] = 0;
-  for(int x=0; x<length; x++) {
-    out[length-1-x] = '0' + (code % 10);
-    code /= 10;
+void token_create(uint16_t id, const char* name, size_t name_length, short digits, uint8_t flags, const uint8_t* secret, uint8_t secret_length) {
+  TokenInfo* newKey = malloc(sizeof(TokenInfo));
+  memset(newKey, 0, sizeof(TokenInfo));
+  newKey->id = id;
+  name_length = min(name_length, (size_t)MAX_NAME_LENGTH);
+  memcpy(newKey->name, name, name_length);
+  newKey->name[name_length] = 0;
+  newKey->digits = digits;
+  if ((flags & TokenFlagMidstate) && secret_length) {
+    // The raw key never gets persisted - only the hash states it leads to.
+    uint8_t midstate[HMAC_SHA256_MIDSTATE_LENGTH];
+    newKey->secret_length = generateMidstate(secret, secret_length, midstate);
+    newKey->secret = malloc(newKey->secret_length);
+    memcpy(newKey->secret, midstate, newKey->secret_length);
+    memset(midstate, 0, sizeof(midstate));
+  } else {
+    flags &= ~TokenFlagMidstate;
+    newKey->secret_length = secret_length;
+    newKey->secret = malloc(secret_length);
+    memcpy(newKey->secret, secret, secret_length);
+  }
+  newKey->flags = flags;
+  if (flags & TokenFlagPhoneCodes) {
+    newKey->schedule = malloc(sizeof(CodeSchedule));
+    memset(newKey->schedule, 0, sizeof(CodeSchedule));
   }
+
+  token_list_add(newKey);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Create token %d", newKey->id);
 }
 
-void code2charspace(unsigned int code, char* out, int length) {
-  out[length+1] = 0;
-  for(int x=0; x<=length; x++) {
-    if (x == length/2) {
-      out[length-x] = ' ';
-      x++;
+bool token_rename(uint16_t id, const char* name, size_t name_length) {
+  TokenInfo* key = token_by_id(id);
+  if (!key) return false;
+  name_length = min(name_length, (size_t)MAX_NAME_LENGTH);
+  memcpy(key->name, name, name_length);
+  key->name[name_length] = 0;
+  key_list_is_dirty = true;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Update token %d", id);
+  return true;
+}
+
+bool token_delete_by_id(uint16_t id) {
+  TokenInfo* key = token_by_id(id);
+  if (!key) return false;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Delete token %d", id);
+  persist_delete(P_SECRETS_START + key->id); // Ensure the secret gets deleted.
+  if (key->schedule) {
+    persist_delete(P_SCHEDULES_START + key->id);
+  }
+  token_list_delete(key);
+  free(key->secret);
+  free(key->schedule);
+  free(key);
+  return true;
+}
+
+// Applies every record in an AMBatch array; returns the PersistenceWritebackFlags the records require.
+PersistenceWritebackFlags batch_apply(const uint8_t* data, size_t length) {
+  PersistenceWritebackFlags writeback = PWNone;
+  size_t pos = 0;
+  while (pos + 3 <= length) {
+    uint8_t op = data[pos++];
+    uint16_t id = data[pos] | (data[pos + 1] << 8);
+    pos += 2;
+    switch (op) {
+      case BatchOpCreate: {
+        if (pos + 3 > length) return writeback;
+        short digits = data[pos++];
+        uint8_t flags = data[pos++];
+        uint8_t name_length = data[pos++];
+        if (pos + name_length + 1 > length) return writeback;
+        const char* name = (const char*)&data[pos];
+        pos += name_length;
+        uint8_t secret_length = data[pos++];
+        if (pos + secret_length > length) return writeback;
+        token_create(id, name, name_length, digits, flags, &data[pos], secret_length);
+        pos += secret_length;
+        writeback |= PWTokens | PWSecrets;
+        break;
+      }
+      case BatchOpUpdate: {
+        if (pos + 1 > length) return writeback;
+        uint8_t name_length = data[pos++];
+        if (pos + name_length > length) return writeback;
+        if (token_rename(id, (const char*)&data[pos], name_length)) {
+          writeback |= PWTokens;
+        }
+        pos += name_length;
+        break;
+      }
+      case BatchOpDelete:
+        if (token_delete_by_id(id)) {
+          writeback |= PWTokens;
+        }
+        break;
+      default:
+        APP_LOG(APP_LOG_LEVEL_WARNING, "Unknown batch op %d", op);
+        return writeback;
+    }
+  }
+  return writeback;
+}
+
+typedef struct ReorderEntry {
+  TokenListNode* node;
+  bool placed;
+} ReorderEntry;
+
+// Relinks the list's nodes in the given ID order, finding each through an index of the IDs built once.
+// Returns false, leaving the list as it was, if there wasn't the memory for the index.
+bool token_list_reorder(const uint16_t* ids, int count) {
+  int length = token_list_length();
+  int slots = 1;
+  while (slots < length * 2) {
+    slots *= 2;
+  }
+  // entries keeps the old order for whatever the phone leaves out; index maps an ID to its entry + 1.
+  ReorderEntry* entries = malloc((length ? length : 1) * sizeof(ReorderEntry));
+  uint16_t* index = malloc(slots * sizeof(uint16_t));
+  if (!entries || !index) {
+    free(entries);
+    free(index);
+    return false;
+  }
+  memset(index, 0, slots * sizeof(uint16_t));
+  int n = 0;
+  for (TokenListNode* node = token_list; node; node = node->next, ++n) {
+    entries[n].node = node;
+    entries[n].placed = false;
+    int slot = node->key->id & (slots - 1);
+    while (index[slot]) {
+      slot = (slot + 1) & (slots - 1);
+    }
+    index[slot] = n + 1;
+  }
+
+  TokenListNode* newList = NULL;
+  TokenListNode** tail = &newList;
+  for (int i = 0; i < count; ++i) {
+    int slot = ids[i] & (slots - 1);
+    while (index[slot] && entries[index[slot] - 1].node->key->id != ids[i]) {
+      slot = (slot + 1) & (slots - 1);
     }
-    out[length-x] = '0' + (code % 10);
-    code /= 10;
+    // Unknown IDs, and repeats of one already placed, are skipped.
+    if (!index[slot] || entries[index[slot] - 1].placed) continue;
+    ReorderEntry* entry = &entries[index[slot] - 1];
+    entry->placed = true;
+    *tail = entry->node;
+    tail = &entry->node->next;
+  }
+
+  // Anything the phone left out keeps its place at the end rather than being dropped.
+  for (int i = 0; i < length; ++i) {
+    if (entries[i].placed) continue;
+    *tail = entries[i].node;
+    tail = &entries[i].node->next;
+  }
+  *tail = NULL;
+
+  free(entries);
+  free(index);
+  token_list = newList;
+  key_list_is_dirty = true;
+  token_index_stale = true;
+  return true;
+}
+
+// Integers may arrive at any width - and older phones sent IDs as a one-element byte array.
+uint32_t tuple_uint(const Tuple* tuple) {
+  switch (tuple->length) {
+    case 1: return tuple->value->uint8;
+    case 2: return tuple->value->uint16;
+    default: return tuple->value->uint32;
+  }
+}
+
+static uint32_t read_uint32_le(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// Merges count codes starting at first_step into the ring, keeping the newest CODE_SCHEDULE_LENGTH steps.
+void code_schedule_store(CodeSchedule* schedule, uint32_t first_step, const uint8_t* codes, uint8_t count) {
+  if (count > CODE_SCHEDULE_LENGTH) {
+    codes += (count - CODE_SCHEDULE_LENGTH) * 4;
+    first_step += count - CODE_SCHEDULE_LENGTH;
+    count = CODE_SCHEDULE_LENGTH;
+  }
+
+  uint32_t held_end = schedule->first_step + schedule->count;
+  if (!schedule->count || first_step < schedule->first_step || first_step > held_end) {
+    // Not contiguous with what we hold - start over.
+    schedule->first_step = first_step;
+    held_end = first_step;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    schedule->codes[(first_step + i) % CODE_SCHEDULE_LENGTH] = read_uint32_le(&codes[i * 4]);
+  }
+
+  uint32_t end = first_step + count > held_end ? first_step + count : held_end;
+  if (end - schedule->first_step > CODE_SCHEDULE_LENGTH) {
+    schedule->first_step = end - CODE_SCHEDULE_LENGTH;
+  }
+  schedule->count = end - schedule->first_step;
+}
+
+bool code_schedule_lookup(const CodeSchedule* schedule, uint32_t step, unsigned int* code) {
+  if (!schedule || step < schedule->first_step || step >= schedule->first_step + schedule->count) {
+    return false;
+  }
+  *code = schedule->codes[step % CODE_SCHEDULE_LENGTH];
+  return true;
+}
+
+// Applies every schedule in an AMCodeSchedule array; returns whether any token took one.
+bool code_schedules_apply(const uint8_t* data, size_t length) {
+  bool applied = false;
+  size_t pos = 0;
+  while (pos + 7 <= length) {
+    uint16_t id = data[pos] | (data[pos + 1] << 8);
+    uint32_t first_step = read_uint32_le(&data[pos + 2]);
+    uint8_t count = data[pos + 6];
+    pos += 7;
+    if (pos + count * 4 > length) break;
+
+    TokenInfo* key = token_by_id(id);
+    if (key && key->schedule) {
+      code_schedule_store(key->schedule, first_step, &data[pos], count);
+      applied = true;
+    }
+    pos += count * 4;
+  }
+  return applied;
+}
+
+// Asks the phone to top up any schedule about to run dry - at most once per step, since it may well not be listening.
+void code_schedule_request_refill(uint32_t step) {
+  static uint32_t last_request_step = 0;
+  if (step == last_request_step) return;
+  last_request_step = step;
+
+  int ct = 0;
+  uint8_t* ids = malloc(token_list_length() * 2);
+  for (TokenListNode* node = token_list; node; node = node->next) {
+    CodeSchedule* schedule = node->key->schedule;
+    if (schedule && schedule->first_step + schedule->count < step + CODE_SCHEDULE_REFILL) {
+      ids[ct * 2] = node->key->id & 0xff;
+      ids[ct * 2 + 1] = node->key->id >> 8;
+      ct++;
+    }
+  }
+
+  DictionaryIterator *iter;
+  if (ct && app_message_outbox_begin(&iter) == APP_MSG_OK) {
+    dict_write_data(iter, AMRequestCodeSchedule, ids, ct * 2);
+    app_message_outbox_send();
+  }
+  free(ids);
+}
+
+// Takes any codes the background worker left for this step, so we don't have to hash them ourselves.
+void code_cache_load(uint32_t step) {
+  CodeCachePage page;
+  for (int i = 0; i < CODE_CACHE_BANK_PAGES && persist_exists(P_CODE_CACHE_PAGE(step, i)); ++i) {
+    persist_read_data(P_CODE_CACHE_PAGE(step, i), &page, sizeof(CodeCachePage));
+    if (page.step != step || page.version != token_set_version) break;
+    for (int j = 0; j < page.count && j < CODE_CACHE_PAGE_ENTRIES; ++j) {
+      TokenInfo* key = token_by_id(page.entries[j].id);
+      if (key) {
+        key->precomputed_step = step;
+        key->precomputed_code = page.entries[j].code;
+      }
+    }
+  }
+}
+
+// Whether any token is hashed on the watch - phone-computed ones get nothing from the worker's cache.
+static bool code_cache_wanted(void) {
+  for (TokenListNode* node = token_list; node; node = node->next) {
+    if (!(node->key->flags & TokenFlagPhoneCodes) && node->key->secret_length) return true;
+  }
+  return false;
+}
+
+// Keeps the worker running only while some token uses its code cache, and tells it when the tokens change.
+static void worker_update(bool tokens_changed) {
+  bool running = app_worker_is_running();
+  if (!code_cache_wanted()) {
+    if (running) {
+      app_worker_kill();
+    }
+  } else if (!running) {
+    app_worker_launch(); // It fills the cache for the current step as it starts.
+  } else if (tokens_changed) {
+    AppWorkerMessage message = {0};
+    app_worker_send_message(WORKER_MESSAGE_TOKENS_CHANGED, &message);
+  }
+}
+
+// Produces the 31-bit truncated hash for the given step, wherever this token's codes come from.
+bool token_code(TokenInfo* key, uint32_t step, unsigned int* code) {
+  if (key->precomputed_step == step && step) {
+    *code = key->precomputed_code;
+    return true;
+  }
+  if (key->flags & TokenFlagPhoneCodes) {
+    return code_schedule_lookup(key->schedule, step, code);
+  }
+  if (key->flags & TokenFlagMidstate) {
+    *code = generateCodeFromMidstate(key->secret, key->secret_length, step);
+  } else {
+    *code = generateCode(key->secret, key->secret_length, step);
+  }
+  return true;
+}
+
+// FNV-1a over each token's ID, name and terminator, in list order - so the phone can tell a renamed, reordered or replaced set from the one it cached.
+uint32_t token_set_digest(void) {
+  uint32_t hash = 2166136261u;
+  for (TokenListNode* node = token_list; node; node = node->next) {
+    uint16_t id = node->key->id;
+    uint8_t id_bytes[2] = {id & 0xff, id >> 8};
+    for (int i = 0; i < 2; ++i) {
+      hash = (hash ^ id_bytes[i]) * 16777619u;
+    }
+    for (const char* c = node->key->name; ; ++c) {
+      hash = (hash ^ (uint8_t)*c) * 16777619u;
+      if (!*c) break;
+    }
+  }
+  return hash;
+}
+
+void sync_state_write(DictionaryIterator *iter) {
+  dict_write_uint32(iter, AMSyncState_Version, token_set_version);
+  dict_write_uint32(iter, AMSyncState_Digest, token_set_digest());
+  dict_write_int32(iter, AMSyncState_UTCOffset, utc_offset);
+}
+
+void sync_state_send(void) {
+  DictionaryIterator *iter;
+  if (app_message_outbox_begin(&iter) != APP_MSG_OK) return;
+  sync_state_write(iter);
+  app_message_outbox_send();
+}
+
+void code_placeholder(char* out, int length) {
+  memset(out, '-', length);
+  out[length] = 0;
+}
+
+void format_code(short digits, unsigned int code, char* out) {
+  if (digits > 6) {
+    code_format_spaced(code, digits, out);
+  } else {
+    code_format(code, digits, out);
   }
 }
 
@@ -242,28 +661,93 @@ void refresh_all(void){
     return;
   }
 
+  uint32_t started_ms = clock_ms();
+  bool list_changed = key_list_is_dirty;
   key_list_is_dirty = false;
 
   bool hasKeys = false;
+  bool codes_changed = false;
 
+  if (quantized_time != lastQuantizedTimeGenerated) {
+    code_cache_load(quantized_time);
+  }
   lastQuantizedTimeGenerated = quantized_time;
 
   TokenListNode* keyNode = token_list;
+  char text[sizeof(keyNode->key->code)];
   while (keyNode) {
-    unsigned int code = generateCode(keyNode->key->secret, keyNode->key->secret_length, quantized_time);
-    if (keyNode->key->digits > 6) {
-      code2charspace(code, (char*)&keyNode->key->code, keyNode->key->digits);
+    unsigned int code;
+    // A preview computed for exactly this step comes straight back from token_code() - it's just promoted.
+    if (!token_code(keyNode->key, quantized_time, &code)) {
+      code_placeholder(text, keyNode->key->digits);
     } else {
-      code2char(code, (char*)&keyNode->key->code, keyNode->key->digits);
+      format_code(keyNode->key->digits, code, text);
+    }
+    if (keyNode->key->precomputed_step <= quantized_time) {
+      keyNode->key->previewing = false;
+    }
+    if (strcmp(text, keyNode->key->code)) {
+      strcpy(keyNode->key->code, text);
+      codes_changed = true;
     }
     keyNode = keyNode->next;
     hasKeys = true;
   }
 
-  if (hasKeys) {
+  // Only re-query the menu's shape when the list itself changed; new codes alone just need a repaint.
+  if (hasKeys && list_changed) {
     menu_layer_reload_data(code_list_layer);
+  } else if (hasKeys && codes_changed) {
+    layer_mark_dirty(menu_layer_get_layer(code_list_layer));
   }
   show_no_tokens_message(!hasKeys);
+
+  code_schedule_request_refill(quantized_time);
+
+  uint32_t elapsed_ms = clock_ms() - started_ms;
+  OTP_STATS_INC(refreshes);
+  otp_stats.refresh_ms_last = elapsed_ms;
+  OTP_STATS_ADD(refresh_ms_total, elapsed_ms);
+  if (elapsed_ms > otp_stats.refresh_ms_max) {
+    otp_stats.refresh_ms_max = elapsed_ms;
+  }
+  stats_sample_heap();
+}
+
+TokenInfo* selected_token(void) {
+  token_index_refresh();
+  int row = menu_layer_get_selected_index(code_list_layer).row;
+  return row < token_index_length ? token_index[row] : NULL;
+}
+
+// Computes one token's code for the coming step, if it hasn't been already. Returns whether it did.
+static bool token_preview(TokenInfo* key, uint32_t step) {
+  if (key->previewing && key->precomputed_step == step) return false;
+  unsigned int code;
+  if (!token_code(key, step, &code)) return false;
+  key->precomputed_step = step;
+  key->precomputed_code = code;
+  key->previewing = true;
+  return true;
+}
+
+// In the last few seconds of a step, works out the next step's codes a few at a time - the selected token's first, as that's the one being shown as a preview.
+// The rollover in refresh_all() then only has to promote them.
+void preview_next_codes(time_t now) {
+  if (now % 30 < 30 - PREVIEW_LEAD_SECONDS) return;
+  uint32_t next_step = now / 30 + 1;
+
+  TokenInfo* selected = selected_token();
+  int budget = PREVIEW_TOKENS_PER_TICK;
+  if (selected && token_preview(selected, next_step)) {
+    layer_mark_dirty(menu_layer_get_layer(code_list_layer));
+    budget--;
+  }
+  for (TokenListNode* node = token_list; node && budget; node = node->next) {
+    if (token_preview(node->key, next_step)) {
+      budget--;
+    }
+  }
 }
 
 static void wrap_angle(int *angle) {
@@ -275,6 +759,43 @@ static void wrap_angle(int *angle) {
   }
 }
 
+#ifdef PROFILE_FRAMES
+// Logs the average time from the first row drawn to the end of the bar, over every PROFILE_FRAMES_WINDOW frames.
+#define PROFILE_FRAMES_WINDOW 64
+
+static uint32_t profile_frame_start = 0;
+static uint32_t profile_frame_count = 0;
+static uint32_t profile_frame_ms = 0;
+static uint32_t profile_window_start = 0;
+
+static void profile_frame_begin(void) {
+  if (!profile_frame_start) {
+    profile_frame_start = clock_ms();
+  }
+}
+
+static void profile_frame_end(void) {
+  uint32_t now = clock_ms();
+  if (!profile_frame_start) {
+    profile_frame_start = now;
+  }
+  if (!profile_window_start) {
+    profile_window_start = now;
+  }
+  profile_frame_ms += now - profile_frame_start;
+  profile_frame_start = 0;
+  if (++profile_frame_count == PROFILE_FRAMES_WINDOW) {
+    uint32_t elapsed = now - profile_window_start;
+    APP_LOG(APP_LOG_LEVEL_INFO, "%d frames in %dms, %d.%02dms/frame", (int)profile_frame_count, (int)elapsed, (int)(profile_frame_ms / profile_frame_count), (int)(profile_frame_ms * 100 / profile_frame_count % 100));
+    profile_frame_count = 0;
+    profile_frame_ms = 0;
+    profile_window_start = now;
+  }
+}
+#endif
+
+#define RING_ARC_PIXELS 565 // Circumference of the ring on Chalk's 180px display
+
 void bar_layer_update(Layer *l, GContext* ctx) {
 #ifdef PBL_PLATFORM_BASALT
   graphics_context_set_fill_color(ctx, GColorVividCerulean);
@@ -305,19 +826,30 @@ void bar_layer_update(Layer *l, GContext* ctx) {
   #else
   graphics_fill_rect(ctx, GRect(0, 0, ((MAX_SLICE_TIME-slice) * 144) / MAX_SLICE_TIME, 5), 0, GCornerNone);
   #endif
+
+#ifdef PROFILE_FRAMES
+  profile_frame_end();
+#endif
 }
 
 void draw_code_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index, void *callback_context){
   GRect bounds = layer_get_bounds(cell_layer);
   GColor fg = GColorBlack;
   GColor active_fg = GColorWhite;
-  GFont code_font = fonts_get_system_font(FONT_KEY_BITHAM_34_MEDIUM_NUMBERS);
   #ifdef PBL_COLOR
   GColor active_bg = GColorCobaltBlue;
   #else
   GColor active_bg = GColorBlack;
   #endif
 
+#ifdef PROFILE_FRAMES
+  profile_frame_begin();
+#endif
+
+  token_index_refresh();
+  if (cell_index->row >= token_index_length) return;
+  TokenInfo* key = token_index[cell_index->row];
+
   graphics_context_set_fill_color(ctx, active_bg);
   if (menu_cell_layer_is_highlighted(cell_layer)) {
     graphics_context_set_text_color(ctx, active_fg);
@@ -326,20 +858,24 @@ void draw_code_row(GContext *ctx, const Layer *cell_layer, MenuIndex *cell_index
     graphics_context_set_text_color(ctx, fg);
   }
 
-  TokenInfo* key = token_by_list_index(cell_index->row);
-  graphics_draw_text(ctx, (char*)key->name, fonts_get_system_font(FONT_KEY_GOTHIC_14), GRect(0, 36, bounds.size.w, 20), GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
-  if (key->digits > 8) {
-    code_font = fonts_get_system_font(FONT_KEY_GOTHIC_28_BOLD);
-  } else if (key->digits > 6) {
-    code_font = fonts_get_system_font(FONT_KEY_DROID_SERIF_28_BOLD);
+  if (key->previewing && menu_cell_layer_is_highlighted(cell_layer)) {
+    char next_code[sizeof(key->code)];
+    char preview[sizeof(next_code) + 6];
+    format_code(key->digits, key->precomputed_code, next_code);
+    snprintf(preview, sizeof(preview), "Next: %s", next_code);
+    graphics_draw_text(ctx, preview, name_font, GRect(0, 36, bounds.size.w, 20), GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
+  } else {
+    graphics_draw_text(ctx, (char*)key->name, name_font, GRect(0, 36, bounds.size.w, 20), GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
   }
-  graphics_draw_text(ctx, (char*)key->code, code_font, GRect(0, 0, bounds.size.w, 100), GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
+  GFont font = key->digits > 8 ? code_font_long : key->digits > 6 ? code_font_spaced : code_font;
+  graphics_draw_text(ctx, (char*)key->code, font, GRect(0, 0, bounds.size.w, 100), GTextOverflowModeTrailingEllipsis, GTextAlignmentCenter, NULL);
 
 }
 
 uint16_t num_code_rows(struct MenuLayer *menu_layer, uint16_t section_index, void *callback_context){
   if (section_index) return 0;
-  return token_list_length();
+  token_index_refresh();
+  return token_index_length;
 }
 
 int16_t get_cell_height(struct MenuLayer *menu_layer, MenuIndex *cell_index, void *callback_context) {
@@ -371,6 +907,7 @@ void token_list_retrieve_iter() {
       // We have to send the AMReadTokenList_Finished message by its own, otherwise the configuration screen will block forever waiting for tokens that will never arrive.
       app_message_outbox_begin(&iter);
       dict_write_tuplet(iter, &TupletInteger(AMReadTokenList_Finished, 1));
+      sync_state_write(iter);
       app_message_outbox_send();
     }
     return;
@@ -386,6 +923,7 @@ void token_list_retrieve_iter() {
 
   if (token_list_retrieve_index + 1 == token_list_length()) {
     dict_write_tuplet(iter, &TupletInteger(AMReadTokenList_Finished, 1));
+    sync_state_write(iter);
   }
 
   app_message_outbox_send();
@@ -395,7 +933,9 @@ void token_list_retrieve_iter() {
 }
 
 void in_received_handler(DictionaryIterator *received, void *context) {
-  static bool delta = false;
+  bool delta = false;
+  OTP_STATS_INC(messages_received);
+  stats_sample_heap();
   Tuple *utcoffset_tuple = dict_find(received, AMSetUTCOffset);
   if (utcoffset_tuple) {
     if (utc_offset != utcoffset_tuple->value->int32){
@@ -417,46 +957,64 @@ void in_received_handler(DictionaryIterator *received, void *context) {
 
   Tuple *delete_token = dict_find(received, AMDeleteToken);
   if (delete_token) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Delete token %d", delete_token->value->int8);
-    TokenInfo* key = token_by_id(delete_token->value->int8);
-    persist_delete(P_SECRETS_START + key->id); // Ensure the secret gets deleted.
-    token_list_delete(key);
-    free(key->secret);
-    free(key);
-
-    persist_writeback |= PWTokens;
-    delta = true;
+    if (token_delete_by_id(tuple_uint(delete_token))) {
+      persist_writeback |= PWTokens;
+      delta = true;
+    }
   }
 
   Tuple *update_token = dict_find(received, AMUpdateToken);
   if (update_token) {
     PublicTokenInfo* public = (PublicTokenInfo*)&update_token->value->data;
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Update token %d", public->id);
-    publicinfo2tokeninfo(public, token_by_id(public->id));
-
-    persist_writeback |= PWTokens;
-    delta = true;
+    if (token_rename(public->id, public->name, strnlen(public->name, MAX_NAME_LENGTH))) {
+      persist_writeback |= PWTokens;
+      delta = true;
+    }
   }
 
   Tuple *create_token = dict_find(received, AMCreateToken);
   if (create_token) {
     uint8_t* secret = create_token->value->data;
-    TokenInfo* newKey = malloc(sizeof(TokenInfo));
-  newKey->secret_length = secret[0]; // First byte is secret length
-  newKey->secret = malloc(newKey->secret_length);
-    memcpy(newKey->secret, secret + 1, newKey->secret_length); // While the rest is the key itself
-    newKey->id = dict_find(received, AMCreateToken_ID)->value->int32;
-    strncpy((char*)&newKey->name, dict_find(received, AMCreateToken_Name)->value->cstring, MAX_NAME_LENGTH);
-    newKey->name[MAX_NAME_LENGTH] = 0;
-    newKey->digits = dict_find(received, AMCreateToken_Digits)->value->int32;
-
-    token_list_add(newKey);
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Create token %d", newKey->id);
-
-  persist_writeback |= PWTokens | PWSecrets;
+    const char* name = dict_find(received, AMCreateToken_Name)->value->cstring;
+    // First byte is secret length, while the rest is the key itself
+    token_create(dict_find(received, AMCreateToken_ID)->value->int32, name, strlen(name), dict_find(received, AMCreateToken_Digits)->value->int32, TokenFlagNone, secret + 1, secret[0]);
+
+    persist_writeback |= PWTokens | PWSecrets;
     delta = true;
   }
 
+  // Batches may span several messages; we only regenerate codes and write back once the last one arrives.
+  Tuple *batch = dict_find(received, AMBatch);
+  bool batch_open = false;
+  if (batch) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Applying %d byte batch", batch->length);
+    persist_writeback |= batch_apply(batch->value->data, batch->length);
+    batch_open = !dict_find(received, AMBatch_Commit);
+    delta = true;
+  }
+
+  Tuple *schedule_tuple = dict_find(received, AMCodeSchedule);
+  if (schedule_tuple) {
+    if (code_schedules_apply(schedule_tuple->value->data, schedule_tuple->length)) {
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Stored code schedules");
+      persist_writeback |= PWSchedules;
+      key_list_is_dirty = true;
+      delta = true;
+    }
+  }
+
+  if (dict_find(received, AMSyncState)) {
+    sync_state_send();
+  }
+
+  if (dict_find(received, AMReadStats)) {
+    DictionaryIterator *iter;
+    if (app_message_outbox_begin(&iter) == APP_MSG_OK) {
+      dict_write_data(iter, AMReadStats_Result, (uint8_t*)&otp_stats, sizeof(OTPStats));
+      app_message_outbox_send();
+    }
+  }
+
   if (dict_find(received, AMReadTokenList)) {
     APP_LOG(APP_LOG_LEVEL_DEBUG, "Listing tokens");
     token_list_retrieve_index = 0;
@@ -465,63 +1023,98 @@ void in_received_handler(DictionaryIterator *received, void *context) {
 
   Tuple *reorder_list = dict_find(received, AMSetTokenListOrder);
   if (reorder_list) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Reordering tokens");
-    TokenListNode* newList = NULL;
-    TokenListNode* node = NULL;
-    TokenListNode* last = NULL;
-
-    // Build a new list using the existing TokenInfos
-    int ct = token_list_length();
-    for (int i = 0; i < ct; ++i)
-    {
-      node = malloc(sizeof(TokenListNode));
-      if (last) {
-        last->next = node;
-      } else {
-        newList = node;
+    int count = reorder_list->length / 2;
+    Tuple *offset_tuple = dict_find(received, AMSetTokenListOrder_Offset);
+    Tuple *total_tuple = dict_find(received, AMSetTokenListOrder_Total);
+    int offset = offset_tuple ? offset_tuple->value->int32 : 0;
+    int total = total_tuple ? total_tuple->value->int32 : count;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Reordering tokens %d-%d of %d", offset, offset + count, total);
+
+    if (offset == 0) {
+      free(pending_order);
+      // An empty order changes nothing; one too big to hold is dropped rather than half applied.
+      pending_order = total > 0 && total <= UINT16_MAX + 1 ? malloc(total * sizeof(uint16_t)) : NULL;
+      pending_order_total = pending_order ? total : 0;
+      pending_order_received = 0;
+      if (!pending_order && total > 0) {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "No room to reorder %d tokens", total);
       }
-      node->next = NULL;
-      node->key = token_by_id(reorder_list->value->data[i]);
-      last = node;
+    }
+    if (pending_order && offset == pending_order_received && offset + count <= pending_order_total) {
+      for (int i = 0; i < count; ++i) {
+        const uint8_t* id = &reorder_list->value->data[i * 2];
+        pending_order[offset + i] = id[0] | (id[1] << 8);
+      }
+      pending_order_received += count;
     }
 
-    // Free the existing list and replace.
-    token_list_supplant(newList);
+    if (pending_order && pending_order_received == pending_order_total) {
+      if (token_list_reorder(pending_order, pending_order_total)) {
+        persist_writeback |= PWTokens;
+        delta = true;
+      } else {
+        APP_LOG(APP_LOG_LEVEL_WARNING, "No room to reorder tokens");
+      }
+      free(pending_order);
+      pending_order = NULL;
+    }
+  }
 
-    persist_writeback |= PWTokens;
+  if (dict_find(received, AMBatch_Commit)) {
     delta = true;
   }
 
-  if (delta){
+  if (delta && !batch_open){
     refresh_all();
     persist_do_writeback();
   }
+
+  // Let the phone cache what it just pushed under the new version.
+  if (dict_find(received, AMBatch_Commit)) {
+    sync_state_send();
+  }
 }
 
 void out_sent_handler(DictionaryIterator *sent, void *context) {
+  OTP_STATS_INC(messages_sent);
   if (dict_find(sent, AMReadTokenList_Result)) {
     token_list_retrieve_iter();
   }
 }
 
+void out_failed_handler(DictionaryIterator *failed, AppMessageResult reason, void *context) {
+  OTP_STATS_INC(messages_failed);
+}
+
 // Animations on Chalk (only)
 // We also drive code refreshes from here (rather than a tick handler) so they line up
+// The ring only moves about a pixel every 53ms, so we wake at that rate and skip the repaint if it hasn't.
 void bar_animation_tick(void* unused) {
   static uint32_t current_code_gen;
-  uint32_t code_gen = time(NULL) / 30;
+  static uint32_t current_ring_pixel;
+  time_t now_sec;
+  uint16_t now_msec;
+  time_ms(&now_sec, &now_msec);
+  uint32_t code_gen = now_sec / 30;
 
   if (code_gen != current_code_gen) {
     refresh_all();
     current_code_gen = code_gen;
   }
+  preview_next_codes(now_sec);
 
-  layer_mark_dirty(bar_layer);
+  uint32_t ring_pixel = ((now_sec % 60) * 1000 + now_msec) * RING_ARC_PIXELS / 30000;
+  if (ring_pixel != current_ring_pixel) {
+    layer_mark_dirty(bar_layer);
+    current_ring_pixel = ring_pixel;
+  }
 
-  app_timer_register(1000/29, bar_animation_tick, NULL);
+  app_timer_register(30000 / RING_ARC_PIXELS, bar_animation_tick, NULL);
 }
 
 void handle_tick(struct tm* tick_time, TimeUnits units_changed) {
   refresh_all();
+  preview_next_codes(time(NULL));
   layer_mark_dirty(bar_layer);
 }
 
@@ -529,27 +1122,46 @@ void handle_init() {
 
   app_message_register_inbox_received(in_received_handler);
   app_message_register_outbox_sent(out_sent_handler);
+  app_message_register_outbox_failed(out_failed_handler);
 
   const uint32_t inbound_size = 1024;
   const uint32_t outbound_size = 1024;
   app_message_open(inbound_size, outbound_size);
 
+  name_font = fonts_get_system_font(FONT_KEY_GOTHIC_14);
+  code_font = fonts_get_system_font(FONT_KEY_BITHAM_34_MEDIUM_NUMBERS);
+  code_font_spaced = fonts_get_system_font(FONT_KEY_DROID_SERIF_28_BOLD);
+  code_font_long = fonts_get_system_font(FONT_KEY_GOTHIC_28_BOLD);
+
   // Load persisted data
   utc_offset = persist_exists(P_UTCOFFSET) ? persist_read_int(P_UTCOFFSET) : 0;
+  token_set_version = persist_exists(P_TOKENS_VERSION) ? persist_read_int(P_TOKENS_VERSION) : 0;
   if (persist_exists(P_TOKENS_COUNT)) {
     int ct = persist_read_int(P_TOKENS_COUNT);
     APP_LOG(APP_LOG_LEVEL_INFO, "Starting with %d tokens & secrets", ct);
     for (int i = 0; i < ct; ++i) {
       TokenInfo* key = malloc(sizeof(TokenInfo));
-      persist_read_data(P_TOKENS_START + i, key, sizeof(TokenInfo));
+      memset(key, 0, sizeof(TokenInfo)); // Records written before flags existed are shorter.
+      persist_read_data(P_TOKENS_START + i, key, TOKEN_RECORD_SIZE);
     key->secret = malloc(key->secret_length);
-    persist_read_data(P_SECRETS_START + key->id, key->secret, key->secret_length);
+    if (key->secret_length) {
+      persist_read_data(P_SECRETS_START + key->id, key->secret, key->secret_length);
+    }
+      key->schedule = NULL;
+      key->precomputed_step = 0;
+      key->previewing = false;
+      if (key->flags & TokenFlagPhoneCodes) {
+        key->schedule = malloc(sizeof(CodeSchedule));
+        memset(key->schedule, 0, sizeof(CodeSchedule));
+        persist_read_data(P_SCHEDULES_START + key->id, key->schedule, sizeof(CodeSchedule));
+      }
       token_list_add(key);
     }
   }
 #ifdef TEST_TOKEN
   token_list_clear();
   TokenInfo* key = malloc(sizeof(TokenInfo));
+  memset(key, 0, sizeof(TokenInfo));
   strcpy(key->name, "TEST TOKEN!");
   key->id = 0;
   void* secret = malloc(10);
@@ -560,6 +1172,7 @@ void handle_init() {
   token_list_add(key);
   
   key = malloc(sizeof(TokenInfo));
+  memset(key, 0, sizeof(TokenInfo));
   strcpy(key->name, "TEST TOKEN 2!");
   key->id = 1;
   secret = malloc(10);
@@ -626,6 +1239,9 @@ void handle_init() {
   layer_add_child(rootLayer, bar_layer);
   layer_add_child(rootLayer, (Layer*)no_tokens_layer);
 
+  // The worker keeps codes for the coming step in the cache, so launches and rollovers don't wait on hashing.
+  worker_update(false);
+
   // Start draining their batteries
   #ifdef PBL_PLATFORM_CHALK
   bar_animation_tick(NULL);
@@ -649,26 +1265,29 @@ static void persist_do_writeback(void) {
   int writeback_status = S_SUCCESS;
   if ((persist_writeback & PWUTCOffset) == PWUTCOffset) {
     // Write back persistent things
-    writeback_status = min(0, persist_write_int(P_UTCOFFSET, utc_offset));
+    writeback_status = min(0, stats_persist_write_int(P_UTCOFFSET, utc_offset));
     writeback_ok &= writeback_status == S_SUCCESS;
     // APP_LOG(APP_LOG_LEVEL_DEBUG, "Wrote UTC offset, status %d", writeback_status);
   }
 
   if (startup_selected_list_index != menu_layer_get_selected_index(code_list_layer).row && writeback_ok) {
-    writeback_status = min(0, persist_write_int(P_SELECTED_LIST_INDEX, menu_layer_get_selected_index(code_list_layer).row));
+    writeback_status = min(0, stats_persist_write_int(P_SELECTED_LIST_INDEX, menu_layer_get_selected_index(code_list_layer).row));
     writeback_ok &= writeback_status == S_SUCCESS;
     // APP_LOG(APP_LOG_LEVEL_DEBUG, "Wrote list index, status %d", writeback_status);
   }
 
   if ((persist_writeback & PWTokens) == PWTokens && writeback_ok) {
-    writeback_status = min(0, persist_write_int(P_TOKENS_COUNT, token_list_length()));
+    writeback_status = min(0, stats_persist_write_int(P_TOKENS_COUNT, token_list_length()));
     writeback_ok &= writeback_status == S_SUCCESS;
+
+    // Cache pages the worker stamped with the old version stop matching from here on.
+    token_set_version++;
     // APP_LOG(APP_LOG_LEVEL_DEBUG, "Wrote token count, status %d", writeback_status);
 
     TokenListNode* node = token_list;
-    short idx = 0;
+    int idx = 0;
     while (node && writeback_ok) {
-      writeback_status = (persist_write_data(P_TOKENS_START + idx, node->key, sizeof(TokenInfo)) == sizeof(TokenInfo)) ? S_SUCCESS : -64;
+      writeback_status = (stats_persist_write_data(P_TOKENS_START + idx, node->key, TOKEN_RECORD_SIZE) == TOKEN_RECORD_SIZE) ? S_SUCCESS : -64;
       writeback_ok &= writeback_status == S_SUCCESS;
       idx++;
       node = node->next;
@@ -681,14 +1300,37 @@ static void persist_do_writeback(void) {
   if ((persist_writeback & PWSecrets) == PWSecrets && writeback_ok) {
     TokenListNode* node = token_list;
     while (node && writeback_ok) {
-      writeback_status = (persist_write_data(P_SECRETS_START + node->key->id, node->key->secret, node->key->secret_length) == node->key->secret_length) ? S_SUCCESS : -63;
-      writeback_ok &= writeback_status == S_SUCCESS;
+      if (node->key->secret_length) {
+        writeback_status = (stats_persist_write_data(P_SECRETS_START + node->key->id, node->key->secret, node->key->secret_length) == node->key->secret_length) ? S_SUCCESS : -63;
+        writeback_ok &= writeback_status == S_SUCCESS;
+      }
       node = node->next;
     }
 
     // APP_LOG(APP_LOG_LEVEL_INFO, "Wrote secrets, status %d", writeback_status);
   }
 
+  // Written only once the records and secrets are, so a worker that reads this version reads them too.
+  if ((persist_writeback & PWTokens) == PWTokens && writeback_ok) {
+    writeback_status = min(0, stats_persist_write_int(P_TOKENS_VERSION, token_set_version));
+    writeback_ok &= writeback_status == S_SUCCESS;
+  }
+
+  if ((persist_writeback & PWSchedules) == PWSchedules && writeback_ok) {
+    TokenListNode* node = token_list;
+    while (node && writeback_ok) {
+      if (node->key->schedule) {
+        writeback_status = (stats_persist_write_data(P_SCHEDULES_START + node->key->id, node->key->schedule, sizeof(CodeSchedule)) == sizeof(CodeSchedule)) ? S_SUCCESS : -62;
+        writeback_ok &= writeback_status == S_SUCCESS;
+      }
+      node = node->next;
+    }
+  }
+
+  if ((persist_writeback & (PWTokens | PWSecrets)) && writeback_ok) {
+    worker_update(true);
+  }
+
   if (!writeback_ok) {
     persist_error_push(writeback_status);
   }
@@ -699,6 +1341,8 @@ void handle_deinit() {
   persist_do_writeback();
 
   token_list_clear();
+  free(token_index);
+  free(pending_order);
   menu_layer_destroy(code_list_layer);
   layer_destroy(bar_layer);
   text_layer_destroy(no_tokens_layer);
@@ -40,24 +40,10 @@
  *
  *****************************************************************************
 */
-#include <machine/endian.h> // Defines BYTE_ORDER
 #include <string.h>
 
 #include "sha1.h"
-
-#if !defined(BYTE_ORDER)
-#if defined(_BIG_ENDIAN)
-#define BYTE_ORDER 4321
-#elif defined(_LITTLE_ENDIAN)
-#define BYTE_ORDER 1234
-#else
-#error Need to define BYTE_ORDER
-#endif
-#endif
-
-#ifndef TRUNC32
-  #define TRUNC32(x)  ((x) & 0xffffffffL)
-#endif
+#include "otp_stats.h"
 
 /* SHA f()-functions */
 #define f1(x,y,z)    ((x & y) | (~x & z))
@@ -77,141 +63,55 @@
 /* 32-bit rotate */
 #define R32(x,n)    T32(((x << n) | (x >> (32 - n))))
 
-/* the generic case, for when the overall rotation is not unraveled */
-#define FG(n)    \
-    T = T32(R32(A,5) + f##n(B,C,D) + E + *WP++ + CONST##n);    \
-    E = D; D = C; C = R32(B,30); B = A; A = T
-
-/* specific cases, for when the overall rotation is unraveled */
-#define FA(n)    \
-    T = T32(R32(A,5) + f##n(B,C,D) + E + *WP++ + CONST##n); B = R32(B,30)
-
-#define FB(n)    \
-    E = T32(R32(T,5) + f##n(A,B,C) + D + *WP++ + CONST##n); A = R32(A,30)
-
-#define FC(n)    \
-    D = T32(R32(E,5) + f##n(T,A,B) + C + *WP++ + CONST##n); T = R32(T,30)
-
-#define FD(n)    \
-    C = T32(R32(D,5) + f##n(E,T,A) + B + *WP++ + CONST##n); E = R32(E,30)
-
-#define FE(n)    \
-    B = T32(R32(C,5) + f##n(D,E,T) + A + *WP++ + CONST##n); D = R32(D,30)
+/* the message schedule only ever looks 16 words back, so it rolls
+   through a 16 word window instead of being expanded to 80 words up front */
+#define SCHEDULE(i)    ((i) < 16 ? W[(i)] : \
+    (W[(i) & 15] = R32((W[((i) + 13) & 15] ^ W[((i) + 8) & 15] ^ \
+                        W[((i) + 2) & 15] ^ W[(i) & 15]), 1)))
 
-#define FT(n)    \
-    A = T32(R32(B,5) + f##n(C,D,E) + T + *WP++ + CONST##n); C = R32(C,30)
+#define FG(n, i)    \
+    T = T32(R32(A,5) + f##n(B,C,D) + E + SCHEDULE(i) + CONST##n);    \
+    E = D; D = C; C = R32(B,30); B = A; A = T
 
+#define FG5(n, i)     FG(n, i); FG(n, i + 1); FG(n, i + 2); FG(n, i + 3); FG(n, i + 4)
+#define FG20(n, i)    FG5(n, i); FG5(n, i + 5); FG5(n, i + 10); FG5(n, i + 15)
 
 static void
 sha1_transform(SHA1_INFO *sha1_info)
 {
     int i;
     uint8_t *dp;
-    uint32_t T, A, B, C, D, E, W[80], *WP;
+    uint32_t T, A, B, C, D, E, W[16];
 
+    OTP_STATS_INC(compressions);
     dp = sha1_info->data;
 
-#undef SWAP_DONE
-
-#if BYTE_ORDER == 1234
-#define SWAP_DONE
-    for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
-        dp += 4;
-        W[i] = 
-            ((T << 24) & 0xff000000) |
-            ((T <<  8) & 0x00ff0000) |
-            ((T >>  8) & 0x0000ff00) | ((T >> 24) & 0x000000ff);
-    }
-#endif
-
-#if BYTE_ORDER == 4321
-#define SWAP_DONE
-    for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
-        dp += 4;
-        W[i] = TRUNC32(T);
-    }
-#endif
-
-#if BYTE_ORDER == 12345678
-#define SWAP_DONE
-    for (i = 0; i < 16; i += 2) {
-        T = *((uint32_t *) dp);
-        dp += 8;
-        W[i] =  ((T << 24) & 0xff000000) | ((T <<  8) & 0x00ff0000) |
-            ((T >>  8) & 0x0000ff00) | ((T >> 24) & 0x000000ff);
-        T >>= 32;
-        W[i+1] = ((T << 24) & 0xff000000) | ((T <<  8) & 0x00ff0000) |
-            ((T >>  8) & 0x0000ff00) | ((T >> 24) & 0x000000ff);
+    for (i = 0; i < 16; ++i, dp += 4) {
+        W[i] = ((uint32_t) dp[0] << 24) | ((uint32_t) dp[1] << 16) |
+               ((uint32_t) dp[2] <<  8) |  (uint32_t) dp[3];
     }
-#endif
 
-#if BYTE_ORDER == 87654321
-#define SWAP_DONE
-    for (i = 0; i < 16; i += 2) {
-        T = *((uint32_t *) dp);
-        dp += 8;
-        W[i] = TRUNC32(T >> 32);
-        W[i+1] = TRUNC32(T);
-    }
-#endif
-
-#ifndef SWAP_DONE
-#define SWAP_DONE
-    for (i = 0; i < 16; ++i) {
-        T = *((uint32_t *) dp);
-        dp += 4;
-        W[i] = TRUNC32(T);
-    }
-#endif /* SWAP_DONE */
-
-    for (i = 16; i < 80; ++i) {
-    W[i] = W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16];
-    W[i] = R32(W[i], 1);
-    }
     A = sha1_info->digest[0];
     B = sha1_info->digest[1];
     C = sha1_info->digest[2];
     D = sha1_info->digest[3];
     E = sha1_info->digest[4];
-    WP = W;
-#ifdef UNRAVEL
-    FA(1); FB(1); FC(1); FD(1); FE(1); FT(1); FA(1); FB(1); FC(1); FD(1);
-    FE(1); FT(1); FA(1); FB(1); FC(1); FD(1); FE(1); FT(1); FA(1); FB(1);
-    FC(2); FD(2); FE(2); FT(2); FA(2); FB(2); FC(2); FD(2); FE(2); FT(2);
-    FA(2); FB(2); FC(2); FD(2); FE(2); FT(2); FA(2); FB(2); FC(2); FD(2);
-    FE(3); FT(3); FA(3); FB(3); FC(3); FD(3); FE(3); FT(3); FA(3); FB(3);
-    FC(3); FD(3); FE(3); FT(3); FA(3); FB(3); FC(3); FD(3); FE(3); FT(3);
-    FA(4); FB(4); FC(4); FD(4); FE(4); FT(4); FA(4); FB(4); FC(4); FD(4);
-    FE(4); FT(4); FA(4); FB(4); FC(4); FD(4); FE(4); FT(4); FA(4); FB(4);
-    sha1_info->digest[0] = T32(sha1_info->digest[0] + E);
-    sha1_info->digest[1] = T32(sha1_info->digest[1] + T);
-    sha1_info->digest[2] = T32(sha1_info->digest[2] + A);
-    sha1_info->digest[3] = T32(sha1_info->digest[3] + B);
-    sha1_info->digest[4] = T32(sha1_info->digest[4] + C);
-#else /* !UNRAVEL */
 #ifdef UNROLL_LOOPS
-    FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1);
-    FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1); FG(1);
-    FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2);
-    FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2); FG(2);
-    FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3);
-    FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3); FG(3);
-    FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4);
-    FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4); FG(4);
+    FG20(1, 0);
+    FG20(2, 20);
+    FG20(3, 40);
+    FG20(4, 60);
 #else /* !UNROLL_LOOPS */
-    for (i =  0; i < 20; ++i) { FG(1); }
-    for (i = 20; i < 40; ++i) { FG(2); }
-    for (i = 40; i < 60; ++i) { FG(3); }
-    for (i = 60; i < 80; ++i) { FG(4); }
+    for (i =  0; i < 20; ++i) { FG(1, i); }
+    for (i = 20; i < 40; ++i) { FG(2, i); }
+    for (i = 40; i < 60; ++i) { FG(3, i); }
+    for (i = 60; i < 80; ++i) { FG(4, i); }
 #endif /* !UNROLL_LOOPS */
     sha1_info->digest[0] = T32(sha1_info->digest[0] + A);
     sha1_info->digest[1] = T32(sha1_info->digest[1] + B);
     sha1_info->digest[2] = T32(sha1_info->digest[2] + C);
     sha1_info->digest[3] = T32(sha1_info->digest[3] + D);
     sha1_info->digest[4] = T32(sha1_info->digest[4] + E);
-#endif /* !UNRAVEL */
 }
 
 /* initialize the SHA digest */
@@ -325,4 +225,78 @@ sha1_final(SHA1_INFO *sha1_info, uint8_t digest[20])
     sha1_transform_and_copy(digest, sha1_info);
 }
 
+#ifdef TEST
+
+#include <stdio.h>
+
+/*
+ * the standard FIPS-180-2 test vectors
+ */
+
+static char *msg[] =
+{
+    "abc",
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+    NULL
+};
+
+static char *val[] =
+{
+    "a9993e364706816aba3e25717850c26c9cd0d89d",
+    "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+    "34aa973cd4c4daa4f61eeb2bdbad27316534016f"
+};
+
+int main( int argc, char *argv[] )
+{
+    int i, j;
+    char output[41];
+    SHA1_INFO ctx;
+    uint8_t buf[1000];
+    uint8_t sha1sum[SHA1_DIGEST_LENGTH];
+
+    printf( "\n SHA-1 Validation Tests:\n\n" );
+
+    for( i = 0; i < 3; i++ )
+    {
+        printf( " Test %d ", i + 1 );
+
+        sha1_init( &ctx );
+
+        if( i < 2 )
+        {
+            sha1_update( &ctx, (uint8_t *) msg[i], strlen( msg[i] ) );
+        }
+        else
+        {
+            memset( buf, 'a', 1000 );
+
+            for( j = 0; j < 1000; j++ )
+            {
+                sha1_update( &ctx, buf, 1000 );
+            }
+        }
+
+        sha1_final( &ctx, sha1sum );
+
+        for( j = 0; j < SHA1_DIGEST_LENGTH; j++ )
+        {
+            sprintf( output + j * 2, "%02x", sha1sum[j] );
+        }
+
+        if( memcmp( output, val[i], 40 ) )
+        {
+            printf( "failed!\n" );
+            return( 1 );
+        }
+
+        printf( "passed.\n" );
+    }
+
+    printf( "\n" );
+    return( 0 );
+}
+
+#endif
+
 /***EOF***/
@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "sha256.h"
+#include "otp_stats.h"
 
 #define GET_UINT32(n,b,i)                       \
 {                                               \
@@ -53,11 +54,27 @@ void sha256_starts( sha256_context *ctx )
     ctx->state[7] = 0x5BE0CD19;
 }
 
+#ifndef UNROLL_LOOPS
+static const uint32 K[64] =
+{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+#endif
+
 void sha256_process( sha256_context *ctx, uint8 data[64] )
 {
-    uint32 temp1, temp2, W[64];
+    uint32 temp1, temp2, W[16];
     uint32 A, B, C, D, E, F, G, H;
 
+    OTP_STATS_INC(compressions);
+
     GET_UINT32( W[0],  data,  0 );
     GET_UINT32( W[1],  data,  4 );
     GET_UINT32( W[2],  data,  8 );
@@ -87,10 +104,13 @@ void sha256_process( sha256_context *ctx, uint8 data[64] )
 #define F0(x,y,z) ((x & y) | (z & (x | y)))
 #define F1(x,y,z) (z ^ (x & (y ^ z)))
 
+/* the schedule rolls through a 16 word window rather than expanding to 64 */
 #define R(t)                                    \
 (                                               \
-    W[t] = S1(W[t -  2]) + W[t -  7] +          \
-           S0(W[t - 15]) + W[t - 16]            \
+    W[(t) & 15] = S1(W[((t) -  2) & 15]) +      \
+                  W[((t) -  7) & 15] +          \
+                  S0(W[((t) - 15) & 15]) +      \
+                  W[(t) & 15]                   \
 )
 
 #define P(a,b,c,d,e,f,g,h,x,K)                  \
@@ -109,6 +129,18 @@ void sha256_process( sha256_context *ctx, uint8 data[64] )
     G = ctx->state[6];
     H = ctx->state[7];
 
+#ifndef UNROLL_LOOPS
+    {
+        int t;
+        for( t = 0; t < 64; t++ )
+        {
+            temp1 = H + S3(E) + F1(E,F,G) + K[t] + ( t < 16 ? W[t] : R(t) );
+            temp2 = S2(A) + F0(A,B,C);
+            H = G; G = F; F = E; E = D + temp1;
+            D = C; C = B; B = A; A = temp1 + temp2;
+        }
+    }
+#else /* UNROLL_LOOPS */
     P( A, B, C, D, E, F, G, H, W[ 0], 0x428A2F98 );
     P( H, A, B, C, D, E, F, G, W[ 1], 0x71374491 );
     P( G, H, A, B, C, D, E, F, W[ 2], 0xB5C0FBCF );
@@ -173,6 +205,7 @@ void sha256_process( sha256_context *ctx, uint8 data[64] )
     P( D, E, F, G, H, A, B, C, R(61), 0xA4506CEB );
     P( C, D, E, F, G, H, A, B, R(62), 0xBEF9A3F7 );
     P( B, C, D, E, F, G, H, A, R(63), 0xC67178F2 );
+#endif /* UNROLL_LOOPS */
 
     ctx->state[0] += A;
     ctx->state[1] += B;
@@ -1,12 +1,14 @@
 #ifndef _SHA256_H
 #define _SHA256_H
 
+#include <stdint.h>
+
 #ifndef uint8
-#define uint8  unsigned char
+#define uint8  uint8_t
 #endif
 
 #ifndef uint32
-#define uint32 unsigned long int
+#define uint32 uint32_t
 #endif
 
 #define SHA256_BLOCKSIZE 64
@@ -0,0 +1,87 @@
+// Token records and the persistent storage layout, shared by the app and the background worker.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef TOKEN_INFO_H__
+#define TOKEN_INFO_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define P_UTCOFFSET       1
+#define P_TOKENS_COUNT    2
+#define P_SELECTED_LIST_INDEX    3
+#define P_TOKENS_VERSION  4
+#define P_CODE_CACHE_START 1000 // + page (see P_CODE_CACHE_PAGE), written by the worker
+#define P_TOKENS_START    10000 // + list index
+#define P_SECRETS_START   20000 // + token ID, which spans the full 16 bits - keep 20000..85535 clear
+#define P_SCHEDULES_START 100000 // + token ID, for tokens whose codes are computed on the phone
+
+#define MAX_NAME_LENGTH   32
+
+#define CODE_SCHEDULE_LENGTH 20 // Steps of phone-computed codes held per token - 10 minutes' worth
+
+#define CODE_CACHE_PAGE_ENTRIES 40 // Keeps a page inside the 256 byte persist limit
+#define CODE_CACHE_LEAD_SECONDS 5 // How long before the boundary the worker computes the next step
+#define CODE_CACHE_BANK_PAGES 1 // Pages per step - the app and worker share a 4 KB persist quota, and tokens come first
+
+// Alternate steps' codes go to separate banks of pages, so writing the coming step never touches the current one.
+#define P_CODE_CACHE_PAGE(step, page) (P_CODE_CACHE_START + ((step) % 2) * CODE_CACHE_BANK_PAGES + (page))
+
+#define WORKER_MESSAGE_TOKENS_CHANGED 1 // Sent by the app after writing back tokens or secrets
+
+typedef enum TokenFlags {
+  TokenFlagNone = 0,
+  TokenFlagPhoneCodes = 1, // The secret stays on the phone, which sends a CodeSchedule instead
+  TokenFlagMidstate = 2 // The secret is replaced by its HMAC midstate (see generateMidstate) when created
+} TokenFlags;
+
+typedef struct CodeSchedule {
+  uint32_t first_step;
+  uint8_t count;
+  uint32_t codes[CODE_SCHEDULE_LENGTH]; // Ring indexed by step % CODE_SCHEDULE_LENGTH
+} CodeSchedule;
+
+typedef struct TokenInfo {
+  char name[MAX_NAME_LENGTH + 1];
+  uint16_t id;
+  uint8_t secret_length; // Since persistence is limited to this size anyways.
+  uint8_t* secret; // Or the midstate, with TokenFlagMidstate
+  char code[12];
+  short digits;
+  uint8_t flags;
+  // Runtime-only from here on - never persisted (see TOKEN_RECORD_SIZE).
+  CodeSchedule* schedule; // Only for TokenFlagPhoneCodes
+  uint32_t precomputed_step; // precomputed_code is valid for this step only; 0 if none
+  unsigned int precomputed_code;
+  bool previewing; // precomputed_code is the coming step's, shown as a preview - formatted when drawn, not kept
+} TokenInfo;
+
+// The bytes of a TokenInfo that are persisted as its record; records written before flags existed are shorter.
+#define TOKEN_RECORD_SIZE offsetof(TokenInfo, schedule)
+
+typedef struct __attribute__((__packed__)) CodeCacheEntry {
+  uint16_t id;
+  uint32_t code; // 31-bit truncated hash, as from generateCode()
+} CodeCacheEntry;
+
+// Codes the worker computed for one step, for the token set as of `version` (see P_TOKENS_VERSION).
+typedef struct __attribute__((__packed__)) CodeCachePage {
+  uint32_t step;
+  uint32_t version;
+  uint8_t count;
+  CodeCacheEntry entries[CODE_CACHE_PAGE_ENTRIES];
+} CodeCachePage;
+
+#endif
@@ -10,7 +10,7 @@ var TokenByID = function(id) {
 };
 
 var NextTokenID = function(){
-    for (var id = 0; id < 256; id++) {
+    for (var id = 0; id < 65536; id++) {
         if (!TokenByID(id) && BlockedIDs.indexOf(id) < 0) return id;
     }
 };
@@ -55,6 +55,8 @@ $(document).ready(function(e) {
 
     $("#token-new").on("pagebeforeshow", function(){
         $("#token-new input[type='text']").val("");
+        $("#new-token-phone-codes").prop("checked", false).checkboxradio("refresh");
+        $("#new-token-midstate").prop("checked", true).checkboxradio("refresh");
     });
 
     $("#config-save-btn").bind("click", ConfigurationSave).hide();
@@ -133,7 +135,9 @@ var TokenCreated = function(e){
         "ID": NextTokenID(),
         "Name": $("#new-token-name").val(),
         "Secret": base64_secret,
-        "Digits": parseInt($("#new-token-digits").val())
+        "Digits": parseInt($("#new-token-digits").val()),
+        "PhoneCodes": $("#new-token-phone-codes").is(":checked"),
+        "Midstate": $("#new-token-midstate").is(":checked")
     };
     if (!token.Name || !token.Secret) {
         alert("You must enter a name and key for the new token");
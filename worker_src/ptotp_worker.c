@@ -0,0 +1,159 @@
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Background worker that computes the coming step's codes shortly before each boundary
+// and leaves them in the code cache, so the app can show them without hashing. Each step
+// has its own bank of pages, so the current step's codes stay valid until the boundary.
+// It sleeps on a timer between boundaries, and tokens past what the banks hold are left
+// for the app to hash.
+
+#include <pebble_worker.h>
+
+#include "../src/generate.h"
+#include "../src/token_info.h"
+
+static uint32_t cached_step = 0;
+static AppTimer* fill_timer = NULL;
+
+// Writes only the entries in use, and reports whether they all fit.
+static bool write_page(uint32_t step, int page_index, CodeCachePage* page) {
+  int size = offsetof(CodeCachePage, entries) + page->count * sizeof(CodeCacheEntry);
+  return persist_write_data(P_CODE_CACHE_PAGE(step, page_index), page, size) == size;
+}
+
+static void delete_bank(uint32_t step) {
+  for (int i = 0; i < CODE_CACHE_BANK_PAGES; ++i) {
+    persist_delete(P_CODE_CACHE_PAGE(step, i));
+  }
+}
+
+static uint32_t tokens_version(void) {
+  return persist_exists(P_TOKENS_VERSION) ? persist_read_int(P_TOKENS_VERSION) : 0;
+}
+
+// Returns false, having dropped the step's bank, if storage is too full to hold it.
+static bool code_cache_write(uint32_t step, uint32_t version) {
+  int ct = persist_read_int(P_TOKENS_COUNT);
+  CodeCachePage page;
+  memset(&page, 0, sizeof(CodeCachePage));
+  page.step = step;
+  page.version = version;
+  int page_index = 0;
+  bool ok = true;
+
+  TokenInfo key;
+  uint8_t secret[UINT8_MAX];
+  for (int i = 0; i < ct && ok; ++i) {
+    memset(&key, 0, sizeof(TokenInfo));
+    persist_read_data(P_TOKENS_START + i, &key, TOKEN_RECORD_SIZE);
+    // Phone-computed tokens already come from a schedule, and have no secret here to hash.
+    if ((key.flags & TokenFlagPhoneCodes) || !key.secret_length) continue;
+    persist_read_data(P_SECRETS_START + key.id, secret, key.secret_length);
+
+    page.entries[page.count].id = key.id;
+    page.entries[page.count].code = (key.flags & TokenFlagMidstate) ?
+      generateCodeFromMidstate(secret, key.secret_length, step) :
+      generateCode(secret, key.secret_length, step);
+    page.count++;
+    if (page.count == CODE_CACHE_PAGE_ENTRIES) {
+      ok = write_page(step, page_index++, &page);
+      page.count = 0;
+      if (page_index == CODE_CACHE_BANK_PAGES) break;
+    }
+  }
+  memset(secret, 0, sizeof(secret));
+
+  if (ok && (page.count || !page_index)) {
+    ok = write_page(step, page_index++, &page);
+  }
+  if (!ok) {
+    // Storage is short - give the space back to the tokens rather than compete with them for it.
+    delete_bank(step);
+    return false;
+  }
+  // Drop pages left over from a larger token set.
+  while (page_index < CODE_CACHE_BANK_PAGES && persist_exists(P_CODE_CACHE_PAGE(step, page_index))) {
+    persist_delete(P_CODE_CACHE_PAGE(step, page_index++));
+  }
+  return true;
+}
+
+static void code_cache_fill(uint32_t step) {
+  if (!persist_exists(P_TOKENS_COUNT)) return;
+  // The app writes the version after the records and secrets, so if it's unchanged once we've read them,
+  // none were rewritten under us; if it moved, the pages may mix two token sets - go again.
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    uint32_t version = tokens_version();
+    if (!code_cache_write(step, version)) return;
+    if (tokens_version() == version) {
+      cached_step = step;
+      return;
+    }
+  }
+}
+
+// Whether it's late enough in the step to compute the next one.
+static bool in_lead_time(time_t now) {
+  return now % 30 >= 30 - CODE_CACHE_LEAD_SECONDS;
+}
+
+static void handle_fill_timer(void* context);
+
+// Sleeps until the next step's lead time starts.
+static void schedule_fill(void) {
+  time_t now = time(NULL);
+  int seconds = (30 - CODE_CACHE_LEAD_SECONDS) - now % 30;
+  if (seconds <= 0) {
+    seconds += 30;
+  }
+  fill_timer = app_timer_register(seconds * 1000, handle_fill_timer, NULL);
+}
+
+static void handle_fill_timer(void* context) {
+  time_t now = time(NULL);
+  uint32_t next_step = now / 30 + 1;
+  if (in_lead_time(now) && cached_step != next_step) {
+    code_cache_fill(next_step);
+  }
+  schedule_fill();
+}
+
+static void handle_app_message(uint16_t type, AppWorkerMessage* message) {
+  if (type == WORKER_MESSAGE_TOKENS_CHANGED) {
+    // The cache no longer matches the app's token set - redo the current step, and the next if it's already been done.
+    time_t now = time(NULL);
+    code_cache_fill(now / 30);
+    if (in_lead_time(now)) {
+      code_cache_fill(now / 30 + 1);
+    }
+  }
+}
+
+static void handle_init(void) {
+  time_t now = time(NULL);
+  code_cache_fill(now / 30);
+  if (in_lead_time(now)) {
+    code_cache_fill(now / 30 + 1);
+  }
+  app_worker_message_subscribe(handle_app_message);
+  schedule_fill();
+}
+
+static void handle_deinit(void) {
+  app_timer_cancel(fill_timer);
+}
+
+int main(void) {
+  handle_init();
+  worker_event_loop();
+  handle_deinit();
+}